@@ -38,6 +38,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include	"Array.h"
 #include	"DynArray.h"
 #include	"FFTRealFixLenParam.h"
+#include	"FFTRealSimd.h"
 #include	"OscSinCos.h"
 
 
@@ -63,6 +64,10 @@ public:
 	inline long		get_length () const;
 	void				do_fft (DataType f [], const DataType x []);
 	void				do_ifft (const DataType f [], DataType x []);
+
+	// Reentrant versions, buffer is caller-owned scratch of FFT_LEN elements
+	void				do_fft (DataType f [], const DataType x [], DataType buffer []) const;
+	void				do_ifft (const DataType f [], DataType x [], DataType buffer []) const;
 	void				rescale (DataType x []) const;
 
 
@@ -91,9 +96,21 @@ private:
 	enum {			NBR_TRIGO_OSC			= FFT_LEN_L2 - TRIGO_BD	};
 	enum {			TRIGO_OSC_ARR_SIZE	=	(NBR_TRIGO_OSC > 0) ? NBR_TRIGO_OSC : 1	};
 
+	typedef	Array <OscType, TRIGO_OSC_ARR_SIZE>	OscArray;
+
+	// The vectorized passes need the fused first ones and tables for all
+	// the others, they are not used with the oscillators
+	enum {			SIMD_FLAG		= (FFT_LEN_L2 >= 5 && NBR_TRIGO_OSC == 0) ? 1 : 0	};
+	enum {			SIMD_TRIGO_ARR_SIZE	= SIMD_FLAG ? FFT_LEN - 8 : 0	};
+
 	void				build_br_lut ();
 	void				build_trigo_lut ();
 	void				build_trigo_osc ();
+	static void		build_trigo_osc (OscArray &osc_list);
+	void				build_simd_trigo_lut ();
+
+	void				do_fft_simd (DataType f [], const DataType x [], DataType buffer []) const;
+	void				do_ifft_simd (const DataType f [], DataType x [], DataType buffer []) const;
 
 	DynArray <DataType>
 						_buffer;
@@ -101,8 +118,11 @@ private:
 						_br_data;
 	DynArray <DataType>
 						_trigo_data;
-   Array <OscType, TRIGO_OSC_ARR_SIZE>
-						_trigo_osc;
+	OscArray			_trigo_osc;
+	const FFTRealSimd::Kernels *
+						_simd_ptr;
+	DynArray <DataType>
+						_simd_trigo_data;
 
 
 
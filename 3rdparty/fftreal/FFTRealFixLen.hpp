@@ -57,10 +57,16 @@ FFTRealFixLen <LL2>::FFTRealFixLen ()
 ,	_br_data (BR_ARR_SIZE)
 ,	_trigo_data (TRIGO_TABLE_ARR_SIZE)
 ,	_trigo_osc ()
+,	_simd_ptr (SIMD_FLAG ? FFTRealSimd::get_kernels () : 0)
+,	_simd_trigo_data ((_simd_ptr != 0) ? SIMD_TRIGO_ARR_SIZE : 0)
 {
 	build_br_lut ();
 	build_trigo_lut ();
 	build_trigo_osc ();
+	if (_simd_ptr != 0)
+	{
+		build_simd_trigo_lut ();
+	}
 }
 
 
@@ -82,6 +88,12 @@ void	FFTRealFixLen <LL2>::do_fft (DataType f [], const DataType x [])
 	assert (x != f);
 	assert (FFT_LEN_L2 >= 3);
 
+	if (_simd_ptr != 0)
+	{
+		do_fft_simd (f, x, &_buffer [0]);
+		return;
+	}
+
 	// Do the transform in several passes
 	const DataType	*	cos_ptr = &_trigo_data [0];
 	const long *	br_ptr = &_br_data [0];
@@ -98,9 +110,40 @@ void	FFTRealFixLen <LL2>::do_fft (DataType f [], const DataType x [])
 	);
 }
 
+// The oscillators are stepped during the passes, so every call gets its own
+template <int LL2>
+void	FFTRealFixLen <LL2>::do_fft (DataType f [], const DataType x [], DataType buffer []) const
+{
+	assert (f != 0);
+	assert (x != 0);
+	assert (buffer != 0);
+	assert (x != f);
+	assert (FFT_LEN_L2 >= 3);
+
+	if (_simd_ptr != 0)
+	{
+		do_fft_simd (f, x, buffer);
+		return;
+	}
+
+	OscArray			trigo_osc;
+	build_trigo_osc (trigo_osc);
+
+	FFTRealPassDirect <FFT_LEN_L2 - 1>::process (
+		FFT_LEN,
+		f,
+		buffer,
+		x,
+		&_trigo_data [0],
+		TRIGO_TABLE_ARR_SIZE,
+		&_br_data [0],
+		&trigo_osc [0]
+	);
+}
+
 // 4-point FFT
 template <>
-void	FFTRealFixLen <2>::do_fft (DataType f [], const DataType x [])
+void	FFTRealFixLen <2>::do_fft (DataType f [], const DataType x [], DataType buffer []) const
 {
 	assert (f != 0);
 	assert (x != 0);
@@ -118,7 +161,7 @@ void	FFTRealFixLen <2>::do_fft (DataType f [], const DataType x [])
 
 // 2-point FFT
 template <>
-void	FFTRealFixLen <1>::do_fft (DataType f [], const DataType x [])
+void	FFTRealFixLen <1>::do_fft (DataType f [], const DataType x [], DataType buffer []) const
 {
 	assert (f != 0);
 	assert (x != 0);
@@ -130,7 +173,7 @@ void	FFTRealFixLen <1>::do_fft (DataType f [], const DataType x [])
 
 // 1-point FFT
 template <>
-void	FFTRealFixLen <0>::do_fft (DataType f [], const DataType x [])
+void	FFTRealFixLen <0>::do_fft (DataType f [], const DataType x [], DataType buffer []) const
 {
 	assert (f != 0);
 	assert (x != 0);
@@ -140,6 +183,27 @@ void	FFTRealFixLen <0>::do_fft (DataType f [], const DataType x [])
 
 
 
+// Small sizes need neither tables nor buffer
+template <>
+void	FFTRealFixLen <2>::do_fft (DataType f [], const DataType x [])
+{
+	do_fft (f, x, 0);
+}
+
+template <>
+void	FFTRealFixLen <1>::do_fft (DataType f [], const DataType x [])
+{
+	do_fft (f, x, 0);
+}
+
+template <>
+void	FFTRealFixLen <0>::do_fft (DataType f [], const DataType x [])
+{
+	do_fft (f, x, 0);
+}
+
+
+
 // General case
 template <int LL2>
 void	FFTRealFixLen <LL2>::do_ifft (const DataType f [], DataType x [])
@@ -149,6 +213,12 @@ void	FFTRealFixLen <LL2>::do_ifft (const DataType f [], DataType x [])
 	assert (x != f);
 	assert (FFT_LEN_L2 >= 3);
 
+	if (_simd_ptr != 0)
+	{
+		do_ifft_simd (f, x, &_buffer [0]);
+		return;
+	}
+
 	// Do the transform in several passes
 	DataType *		s_ptr =
 		FFTRealSelect <FFT_LEN_L2 & 1>::sel_bin (&_buffer [0], x);
@@ -169,9 +239,44 @@ void	FFTRealFixLen <LL2>::do_ifft (const DataType f [], DataType x [])
 	);
 }
 
+template <int LL2>
+void	FFTRealFixLen <LL2>::do_ifft (const DataType f [], DataType x [], DataType buffer []) const
+{
+	assert (f != 0);
+	assert (x != 0);
+	assert (buffer != 0);
+	assert (x != f);
+	assert (FFT_LEN_L2 >= 3);
+
+	if (_simd_ptr != 0)
+	{
+		do_ifft_simd (f, x, buffer);
+		return;
+	}
+
+	OscArray			trigo_osc;
+	build_trigo_osc (trigo_osc);
+
+	DataType *		s_ptr =
+		FFTRealSelect <FFT_LEN_L2 & 1>::sel_bin (buffer, x);
+	DataType *		d_ptr =
+		FFTRealSelect <FFT_LEN_L2 & 1>::sel_bin (x, buffer);
+
+	FFTRealPassInverse <FFT_LEN_L2 - 1>::process (
+		FFT_LEN,
+		d_ptr,
+		s_ptr,
+		f,
+		&_trigo_data [0],
+		TRIGO_TABLE_ARR_SIZE,
+		&_br_data [0],
+		&trigo_osc [0]
+	);
+}
+
 // 4-point IFFT
 template <>
-void	FFTRealFixLen <2>::do_ifft (const DataType f [], DataType x [])
+void	FFTRealFixLen <2>::do_ifft (const DataType f [], DataType x [], DataType buffer []) const
 {
 	assert (f != 0);
 	assert (x != 0);
@@ -188,7 +293,7 @@ void	FFTRealFixLen <2>::do_ifft (const DataType f [], DataType x [])
 
 // 2-point IFFT
 template <>
-void	FFTRealFixLen <1>::do_ifft (const DataType f [], DataType x [])
+void	FFTRealFixLen <1>::do_ifft (const DataType f [], DataType x [], DataType buffer []) const
 {
 	assert (f != 0);
 	assert (x != 0);
@@ -200,7 +305,7 @@ void	FFTRealFixLen <1>::do_ifft (const DataType f [], DataType x [])
 
 // 1-point IFFT
 template <>
-void	FFTRealFixLen <0>::do_ifft (const DataType f [], DataType x [])
+void	FFTRealFixLen <0>::do_ifft (const DataType f [], DataType x [], DataType buffer []) const
 {
 	assert (f != 0);
 	assert (x != 0);
@@ -211,6 +316,26 @@ void	FFTRealFixLen <0>::do_ifft (const DataType f [], DataType x [])
 
 
 
+// Small sizes need neither tables nor buffer
+template <>
+void	FFTRealFixLen <2>::do_ifft (const DataType f [], DataType x [])
+{
+	do_ifft (f, x, 0);
+}
+
+template <>
+void	FFTRealFixLen <1>::do_ifft (const DataType f [], DataType x [])
+{
+	do_ifft (f, x, 0);
+}
+
+template <>
+void	FFTRealFixLen <0>::do_ifft (const DataType f [], DataType x [])
+{
+	do_ifft (f, x, 0);
+}
+
+
 
 template <int LL2>
 void	FFTRealFixLen <LL2>::rescale (DataType x []) const
@@ -300,10 +425,18 @@ void	FFTRealFixLen <LL2>::build_trigo_lut ()
 
 template <int LL2>
 void	FFTRealFixLen <LL2>::build_trigo_osc ()
+{
+	build_trigo_osc (_trigo_osc);
+}
+
+
+
+template <int LL2>
+void	FFTRealFixLen <LL2>::build_trigo_osc (OscArray &osc_list)
 {
 	for (int i = 0; i < NBR_TRIGO_OSC; ++i)
 	{
-		OscType &		osc = _trigo_osc [i];
+		OscType &		osc = osc_list [i];
 
 		const long		len = static_cast <long> (TRIGO_TABLE_ARR_SIZE) << (i + 1);
 		const double	mul = (0.5 * PI) / len;
@@ -313,6 +446,81 @@ void	FFTRealFixLen <LL2>::build_trigo_osc ()
 
 
 
+// The twiddles of each radix pass, laid out contiguously: for the pass on
+// groups of 4 * dist coefficients, dist cosines then dist sines from offset
+// 2 * (dist - 4). Index 0 holds the real extreme, it is not used.
+template <int LL2>
+void	FFTRealFixLen <LL2>::build_simd_trigo_lut ()
+{
+	const DataType	*	cos_ptr = &_trigo_data [0];
+
+	for (long dist = 4; dist < FFT_LEN / 2; dist <<= 1)
+	{
+		DataType *		c_ptr = &_simd_trigo_data [2 * (dist - 4)];
+		DataType *		s_ptr = c_ptr + dist;
+		const long		table_step = TRIGO_TABLE_ARR_SIZE / dist;
+
+		c_ptr [0] = 1;
+		s_ptr [0] = 0;
+		for (long i = 1; i < dist; ++ i)
+		{
+			c_ptr [i] = cos_ptr [i * table_step];
+			s_ptr [i] = cos_ptr [(dist - i) * table_step];
+		}
+	}
+}
+
+
+
+// The passes ping-pong between f and buffer, the first one writes where the
+// last one ends up in f
+template <int LL2>
+void	FFTRealFixLen <LL2>::do_fft_simd (DataType f [], const DataType x [], DataType buffer []) const
+{
+	DataType *		d_ptr = (((FFT_LEN_L2 - 3) & 1) != 0) ? buffer : f;
+	DataType *		s_ptr = (d_ptr == f) ? buffer : f;
+
+	_simd_ptr->_direct_first (FFT_LEN, d_ptr, x, &_br_data [0]);
+
+	const DataType	*	trigo_ptr = &_simd_trigo_data [0];
+	for (long dist = 4; dist < FFT_LEN / 2; dist <<= 1)
+	{
+		DataType *		tmp_ptr = s_ptr;
+		s_ptr = d_ptr;
+		d_ptr = tmp_ptr;
+
+		_simd_ptr->_direct_pass (FFT_LEN, d_ptr, s_ptr, dist, trigo_ptr, trigo_ptr + dist);
+		trigo_ptr += 2 * dist;
+	}
+}
+
+
+
+// The first pass reads f, then they ping-pong between x and buffer. The
+// last one scatters into x, so the one before it writes to buffer.
+template <int LL2>
+void	FFTRealFixLen <LL2>::do_ifft_simd (const DataType f [], DataType x [], DataType buffer []) const
+{
+	DataType *		d_ptr = (((FFT_LEN_L2 - 3) & 1) != 0) ? buffer : x;
+	DataType *		o_ptr = (d_ptr == x) ? buffer : x;
+
+	const DataType	*	src_ptr = f;
+	for (long dist = FFT_LEN / 4; dist >= 4; dist >>= 1)
+	{
+		const DataType	*	trigo_ptr = &_simd_trigo_data [2 * (dist - 4)];
+		_simd_ptr->_inverse_pass (FFT_LEN, d_ptr, src_ptr, dist, trigo_ptr, trigo_ptr + dist);
+
+		DataType *		tmp_ptr = d_ptr;
+		src_ptr = d_ptr;
+		d_ptr = o_ptr;
+		o_ptr = tmp_ptr;
+	}
+
+	_simd_ptr->_inverse_last (FFT_LEN, x, src_ptr, &_br_data [0]);
+}
+
+
+
 #endif	// FFTRealFixLen_CODEHEADER_INCLUDED
 
 #undef FFTRealFixLen_CURRENT_CODEHEADER
@@ -0,0 +1,289 @@
+/*****************************************************************************
+
+        FFTRealSimd.cpp
+        Copyright (c) 2019 Artem Yamshanov
+
+--- Legal stuff ---
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*Tab=3***********************************************************************/
+
+
+
+#if defined (_MSC_VER)
+	#pragma warning (4 : 4786) // "identifier was truncated to '255' characters in the debug information"
+#endif
+
+
+
+/*\\\ INCLUDE FILES \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+#include	"def.h"
+#include	"FFTRealSimd.h"
+
+#if ! defined (FFTREAL_NO_SIMD)
+	#if defined (__SSE__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 1)
+		#define	FFTRealSimd_X86
+		#if defined (_MSC_VER)
+			#include	<intrin.h>
+		#endif
+		#include	<immintrin.h>
+	#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+		#define	FFTRealSimd_NEON
+		#include	<arm_neon.h>
+	#endif
+#endif
+
+
+
+/*\\\ SSE \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+#if defined (FFTRealSimd_X86)
+
+namespace FFTRealSimd_sse
+{
+
+class Vec
+{
+public:
+	typedef	__m128	V;
+	enum {			WIDTH	= 4	};
+
+	static FORCEINLINE V	load (const float ptr []) { return (_mm_loadu_ps (ptr)); }
+	static FORCEINLINE void	store (float ptr [], V a) { _mm_storeu_ps (ptr, a); }
+	static FORCEINLINE V	set1 (float a) { return (_mm_set1_ps (a)); }
+	static FORCEINLINE V	set4 (float a, float b, float c, float d) { return (_mm_setr_ps (a, b, c, d)); }
+	static FORCEINLINE V	add (V a, V b) { return (_mm_add_ps (a, b)); }
+	static FORCEINLINE V	sub (V a, V b) { return (_mm_sub_ps (a, b)); }
+	static FORCEINLINE V	mul (V a, V b) { return (_mm_mul_ps (a, b)); }
+	static FORCEINLINE V	reverse (V a) { return (_mm_shuffle_ps (a, a, _MM_SHUFFLE (0, 1, 2, 3))); }
+	static FORCEINLINE void	transpose4 (V &a, V &b, V &c, V &d) { _MM_TRANSPOSE4_PS (a, b, c, d); }
+};
+
+#include	"FFTRealSimdPasses.hpp"
+
+}	// namespace FFTRealSimd_sse
+
+
+
+/*\\\ AVX \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+// Only the radix passes get 8-wide versions, the gathers and scatters of the
+// first and last ones would not gain from them. Everything below is built
+// for AVX whatever the compiler flags, and only run when the CPU has it.
+#if defined (__clang__)
+	#pragma clang attribute push (__attribute__ ((target ("avx"))), apply_to = function)
+#elif defined (__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target ("avx")
+#endif
+
+namespace FFTRealSimd_avx
+{
+
+class Vec
+{
+public:
+	typedef	__m256	V;
+	enum {			WIDTH	= 8	};
+
+	static FORCEINLINE V	load (const float ptr []) { return (_mm256_loadu_ps (ptr)); }
+	static FORCEINLINE void	store (float ptr [], V a) { _mm256_storeu_ps (ptr, a); }
+	static FORCEINLINE V	set1 (float a) { return (_mm256_set1_ps (a)); }
+	static FORCEINLINE V	add (V a, V b) { return (_mm256_add_ps (a, b)); }
+	static FORCEINLINE V	sub (V a, V b) { return (_mm256_sub_ps (a, b)); }
+	static FORCEINLINE V	mul (V a, V b) { return (_mm256_mul_ps (a, b)); }
+	static FORCEINLINE V	reverse (V a)
+	{
+		const V			r = _mm256_permute_ps (a, _MM_SHUFFLE (0, 1, 2, 3));
+		return (_mm256_permute2f128_ps (r, r, 0x01));
+	}
+};
+
+#include	"FFTRealSimdPasses.hpp"
+
+// Smaller groups leave too few coefficients for 8-wide vectors
+static void	direct_pass_any (long len, DataType dest_ptr [], const DataType src_ptr [], long dist, const DataType cos_ptr [], const DataType sin_ptr [])
+{
+	if (dist < 16)
+	{
+		FFTRealSimd_sse::direct_pass <FFTRealSimd_sse::Vec> (len, dest_ptr, src_ptr, dist, cos_ptr, sin_ptr);
+	}
+	else
+	{
+		direct_pass <Vec> (len, dest_ptr, src_ptr, dist, cos_ptr, sin_ptr);
+	}
+}
+
+static void	inverse_pass_any (long len, DataType dest_ptr [], const DataType src_ptr [], long dist, const DataType cos_ptr [], const DataType sin_ptr [])
+{
+	if (dist < 16)
+	{
+		FFTRealSimd_sse::inverse_pass <FFTRealSimd_sse::Vec> (len, dest_ptr, src_ptr, dist, cos_ptr, sin_ptr);
+	}
+	else
+	{
+		inverse_pass <Vec> (len, dest_ptr, src_ptr, dist, cos_ptr, sin_ptr);
+	}
+}
+
+}	// namespace FFTRealSimd_avx
+
+#if defined (__clang__)
+	#pragma clang attribute pop
+#elif defined (__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+
+
+static bool	FFTRealSimd_has_avx ()
+{
+#if defined (_MSC_VER)
+	int				info [4];
+	__cpuid (info, 1);
+	const bool		osxsave = (info [2] & (1 << 27)) != 0;
+	const bool		avx = (info [2] & (1 << 28)) != 0;
+
+	// The OS must also save the upper halves of the registers
+	return (osxsave && avx && (_xgetbv (0) & 6) == 6);
+#elif defined (__GNUC__)
+	__builtin_cpu_init ();
+	return (__builtin_cpu_supports ("avx") != 0);
+#else
+	return (false);
+#endif
+}
+
+#endif	// FFTRealSimd_X86
+
+
+
+/*\\\ NEON \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+#if defined (FFTRealSimd_NEON)
+
+namespace FFTRealSimd_neon
+{
+
+class Vec
+{
+public:
+	typedef	float32x4_t	V;
+	enum {			WIDTH	= 4	};
+
+	static FORCEINLINE V	load (const float ptr []) { return (vld1q_f32 (ptr)); }
+	static FORCEINLINE void	store (float ptr [], V a) { vst1q_f32 (ptr, a); }
+	static FORCEINLINE V	set1 (float a) { return (vdupq_n_f32 (a)); }
+	static FORCEINLINE V	set4 (float a, float b, float c, float d)
+	{
+		const float		tmp [4] = { a, b, c, d };
+		return (vld1q_f32 (tmp));
+	}
+	static FORCEINLINE V	add (V a, V b) { return (vaddq_f32 (a, b)); }
+	static FORCEINLINE V	sub (V a, V b) { return (vsubq_f32 (a, b)); }
+	static FORCEINLINE V	mul (V a, V b) { return (vmulq_f32 (a, b)); }
+	static FORCEINLINE V	reverse (V a)
+	{
+		const V			r = vrev64q_f32 (a);
+		return (vcombine_f32 (vget_high_f32 (r), vget_low_f32 (r)));
+	}
+	static FORCEINLINE void	transpose4 (V &a, V &b, V &c, V &d)
+	{
+		const float32x4x2_t	ab = vtrnq_f32 (a, b);
+		const float32x4x2_t	cd = vtrnq_f32 (c, d);
+		a = vcombine_f32 (vget_low_f32 (ab.val [0]), vget_low_f32 (cd.val [0]));
+		b = vcombine_f32 (vget_low_f32 (ab.val [1]), vget_low_f32 (cd.val [1]));
+		c = vcombine_f32 (vget_high_f32 (ab.val [0]), vget_high_f32 (cd.val [0]));
+		d = vcombine_f32 (vget_high_f32 (ab.val [1]), vget_high_f32 (cd.val [1]));
+	}
+};
+
+#include	"FFTRealSimdPasses.hpp"
+
+}	// namespace FFTRealSimd_neon
+
+#endif	// FFTRealSimd_NEON
+
+
+
+/*\\\ PUBLIC \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+
+
+const FFTRealSimd::Kernels *	FFTRealSimd::get_kernels ()
+{
+	static const Kernels * const	kernels_ptr = select_kernels ();
+
+	return (kernels_ptr);
+}
+
+
+
+/*\\\ PROTECTED \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+
+
+/*\\\ PRIVATE \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+
+
+const FFTRealSimd::Kernels *	FFTRealSimd::select_kernels ()
+{
+#if defined (FFTRealSimd_X86)
+
+	static const Kernels	sse =
+	{
+		"SSE",
+		&FFTRealSimd_sse::direct_first <FFTRealSimd_sse::Vec>,
+		&FFTRealSimd_sse::direct_pass <FFTRealSimd_sse::Vec>,
+		&FFTRealSimd_sse::inverse_pass <FFTRealSimd_sse::Vec>,
+		&FFTRealSimd_sse::inverse_last <FFTRealSimd_sse::Vec>
+	};
+	static const Kernels	avx =
+	{
+		"AVX",
+		&FFTRealSimd_sse::direct_first <FFTRealSimd_sse::Vec>,
+		&FFTRealSimd_avx::direct_pass_any,
+		&FFTRealSimd_avx::inverse_pass_any,
+		&FFTRealSimd_sse::inverse_last <FFTRealSimd_sse::Vec>
+	};
+
+	return (FFTRealSimd_has_avx () ? &avx : &sse);
+
+#elif defined (FFTRealSimd_NEON)
+
+	static const Kernels	neon =
+	{
+		"NEON",
+		&FFTRealSimd_neon::direct_first <FFTRealSimd_neon::Vec>,
+		&FFTRealSimd_neon::direct_pass <FFTRealSimd_neon::Vec>,
+		&FFTRealSimd_neon::inverse_pass <FFTRealSimd_neon::Vec>,
+		&FFTRealSimd_neon::inverse_last <FFTRealSimd_neon::Vec>
+	};
+
+	return (&neon);
+
+#else
+
+	return (0);
+
+#endif
+}
+
+
+
+/*\\\ EOF \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
@@ -0,0 +1,114 @@
+/*****************************************************************************
+
+        FFTRealSimd.h
+        Copyright (c) 2019 Artem Yamshanov
+
+Vectorized passes of FFTRealFixLen for float data. The kernels are built for
+SSE and AVX on x86 and for NEON on ARM, the best set the CPU supports is
+picked on the first use. Defining FFTREAL_NO_SIMD leaves only the scalar
+template passes.
+
+--- Legal stuff ---
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*Tab=3***********************************************************************/
+
+
+
+#if ! defined (FFTRealSimd_HEADER_INCLUDED)
+#define	FFTRealSimd_HEADER_INCLUDED
+
+#if defined (_MSC_VER)
+	#pragma once
+	#pragma warning (4 : 4250) // "Inherits via dominance."
+#endif
+
+
+
+/*\\\ INCLUDE FILES \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+
+
+class FFTRealSimd
+{
+
+/*\\\ PUBLIC \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+public:
+
+	typedef	float	DataType;
+
+	// Direct passes 1 to 3 at once, from x in bit-reversed order. len >= 32
+	typedef	void	(*FirstPassesPtr) (long len, DataType dest_ptr [], const DataType x_ptr [], const long br_ptr []);
+
+	// Inverse passes 3 to 1 at once, to x in bit-reversed order. len >= 32
+	typedef	void	(*LastPassesPtr) (long len, DataType dest_ptr [], const DataType src_ptr [], const long br_ptr []);
+
+	// Generic radix pass over groups of 4 * dist coefficients, cos_ptr and
+	// sin_ptr hold the dist twiddles of the pass contiguously
+	typedef	void	(*PassPtr) (long len, DataType dest_ptr [], const DataType src_ptr [], long dist, const DataType cos_ptr [], const DataType sin_ptr []);
+
+	class Kernels
+	{
+	public:
+		const char *	_name_0;
+		FirstPassesPtr	_direct_first;
+		PassPtr			_direct_pass;
+		PassPtr			_inverse_pass;
+		LastPassesPtr	_inverse_last;
+	};
+
+	// Null when the CPU has no supported vector unit
+	static const Kernels *
+						get_kernels ();
+
+
+
+/*\\\ PROTECTED \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+protected:
+
+
+
+/*\\\ PRIVATE \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+private:
+
+	static const Kernels *
+						select_kernels ();
+
+
+
+/*\\\ FORBIDDEN MEMBER FUNCTIONS \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+private:
+
+						FFTRealSimd ();
+						~FFTRealSimd ();
+						FFTRealSimd (const FFTRealSimd &other);
+	FFTRealSimd &	operator = (const FFTRealSimd &other);
+	bool				operator == (const FFTRealSimd &other);
+	bool				operator != (const FFTRealSimd &other);
+
+};	// class FFTRealSimd
+
+
+
+#endif	// FFTRealSimd_HEADER_INCLUDED
+
+
+
+/*\\\ EOF \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
@@ -0,0 +1,377 @@
+/*****************************************************************************
+
+        FFTRealSimdPasses.hpp
+        Copyright (c) 2019 Artem Yamshanov
+
+Pass kernels of FFTRealSimd, written against a vector class VEC which
+provides the type V, its WIDTH and load (), store (), set1 (), add (),
+sub (), mul () and reverse (). The first and last passes also need set4 ()
+and transpose4 (), so they are only instantiated for 4-wide vectors.
+
+Included once per instruction set, inside a namespace of its own, with the
+code generation options of that set in effect. Hence no inclusion guard.
+
+--- Legal stuff ---
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*Tab=3***********************************************************************/
+
+
+
+typedef	FFTRealSimd::DataType	DataType;
+
+
+
+/*\\\ FUNCTIONS \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
+
+
+
+// Coefficients i to i + WIDTH - 1 of a group of the direct radix pass
+template <class VEC>
+FORCEINLINE void	direct_butterflies (DataType df [], const DataType sf [], long dist, const DataType cos_ptr [], const DataType sin_ptr [], long i)
+{
+	typedef	typename VEC::V	V;
+
+	const long		c1_r = 0;
+	const long		c1_i = dist;
+	const long		c2_r = dist * 2;
+	const long		c2_i = dist * 3;
+	const long		cend = dist * 4;
+	const long		back = VEC::WIDTH - 1;
+
+	const V			c = VEC::load (cos_ptr + i);
+	const V			s = VEC::load (sin_ptr + i);
+
+	const V			sf_r_i = VEC::load (sf + c1_r + i);
+	const V			sf_i_i = VEC::load (sf + c1_i + i);
+	const V			sf_2r = VEC::load (sf + c2_r + i);
+	const V			sf_2i = VEC::load (sf + c2_i + i);
+
+	const V			v1 = VEC::sub (VEC::mul (sf_2r, c), VEC::mul (sf_2i, s));
+	VEC::store (df + c1_r + i, VEC::add (sf_r_i, v1));
+	VEC::store (df + c2_r - i - back, VEC::reverse (VEC::sub (sf_r_i, v1)));
+
+	const V			v2 = VEC::add (VEC::mul (sf_2r, s), VEC::mul (sf_2i, c));
+	VEC::store (df + c2_r + i, VEC::add (v2, sf_i_i));
+	VEC::store (df + cend - i - back, VEC::reverse (VEC::sub (v2, sf_i_i)));
+}
+
+
+
+// Coefficients i to i + WIDTH - 1 of a group of the inverse radix pass
+template <class VEC>
+FORCEINLINE void	inverse_butterflies (DataType df [], const DataType sf [], long dist, const DataType cos_ptr [], const DataType sin_ptr [], long i)
+{
+	typedef	typename VEC::V	V;
+
+	const long		c1_r = 0;
+	const long		c1_i = dist;
+	const long		c2_r = dist * 2;
+	const long		c2_i = dist * 3;
+	const long		cend = dist * 4;
+	const long		back = VEC::WIDTH - 1;
+
+	const V			c = VEC::load (cos_ptr + i);
+	const V			s = VEC::load (sin_ptr + i);
+
+	const V			sf_r_i = VEC::load (sf + c1_r + i);
+	const V			sf_r_m = VEC::reverse (VEC::load (sf + c2_r - i - back));
+	const V			sf_2r = VEC::load (sf + c2_r + i);
+	const V			sf_e_m = VEC::reverse (VEC::load (sf + cend - i - back));
+
+	VEC::store (df + c1_r + i, VEC::add (sf_r_i, sf_r_m));
+	VEC::store (df + c1_i + i, VEC::sub (sf_2r, sf_e_m));
+
+	const V			vr = VEC::sub (sf_r_i, sf_r_m);
+	const V			vi = VEC::add (sf_2r, sf_e_m);
+
+	VEC::store (df + c2_r + i, VEC::add (VEC::mul (vr, c), VEC::mul (vi, s)));
+	VEC::store (df + c2_i + i, VEC::sub (VEC::mul (vi, c), VEC::mul (vr, s)));
+}
+
+
+
+// Same as FFTRealPassDirect <PASS>::process () for a table-driven pass.
+// Vectors cover the coefficients 1 to dist - 1 of each group, the last one
+// overlapping the one before when dist - 1 is not a multiple of the width.
+template <class VEC>
+void	direct_pass (long len, DataType dest_ptr [], const DataType src_ptr [], long dist, const DataType cos_ptr [], const DataType sin_ptr [])
+{
+	const long		c1_r = 0;
+	const long		c1_i = dist;
+	const long		c2_r = dist * 2;
+	const long		c2_i = dist * 3;
+	const long		cend = dist * 4;
+	const long		last = dist - VEC::WIDTH;
+
+	long				coef_index = 0;
+	do
+	{
+		const DataType	* const	sf = src_ptr + coef_index;
+		DataType			* const	df = dest_ptr + coef_index;
+
+		// Extreme coefficients are always real
+		df [c1_r] = sf [c1_r] + sf [c2_r];
+		df [c2_r] = sf [c1_r] - sf [c2_r];
+		df [c1_i] = sf [c1_i];
+		df [c2_i] = sf [c2_i];
+
+		if (last >= 1)
+		{
+			for (long i = 1; i < last; i += VEC::WIDTH)
+			{
+				direct_butterflies <VEC> (df, sf, dist, cos_ptr, sin_ptr, i);
+			}
+			direct_butterflies <VEC> (df, sf, dist, cos_ptr, sin_ptr, last);
+		}
+
+		else
+		{
+			for (long i = 1; i < dist; ++ i)
+			{
+				const DataType	c = cos_ptr [i];
+				const DataType	s = sin_ptr [i];
+
+				const DataType	sf_r_i = sf [c1_r + i];
+				const DataType	sf_i_i = sf [c1_i + i];
+
+				const DataType	v1 = sf [c2_r + i] * c - sf [c2_i + i] * s;
+				df [c1_r + i] = sf_r_i + v1;
+				df [c2_r - i] = sf_r_i - v1;
+
+				const DataType	v2 = sf [c2_r + i] * s + sf [c2_i + i] * c;
+				df [c2_r + i] = v2 + sf_i_i;
+				df [cend - i] = v2 - sf_i_i;
+			}
+		}
+
+		coef_index += cend;
+	}
+	while (coef_index < len);
+}
+
+
+
+// Same as FFTRealPassInverse <PASS>::process_internal () for a table-driven
+// pass, vectors as in direct_pass ()
+template <class VEC>
+void	inverse_pass (long len, DataType dest_ptr [], const DataType src_ptr [], long dist, const DataType cos_ptr [], const DataType sin_ptr [])
+{
+	const long		c1_r = 0;
+	const long		c1_i = dist;
+	const long		c2_r = dist * 2;
+	const long		c2_i = dist * 3;
+	const long		cend = dist * 4;
+	const long		last = dist - VEC::WIDTH;
+
+	long				coef_index = 0;
+	do
+	{
+		const DataType	* const	sf = src_ptr + coef_index;
+		DataType			* const	df = dest_ptr + coef_index;
+
+		// Extreme coefficients are always real
+		df [c1_r] = sf [c1_r] + sf [c2_r];
+		df [c2_r] = sf [c1_r] - sf [c2_r];
+		df [c1_i] = sf [c1_i] * 2;
+		df [c2_i] = sf [c2_i] * 2;
+
+		if (last >= 1)
+		{
+			for (long i = 1; i < last; i += VEC::WIDTH)
+			{
+				inverse_butterflies <VEC> (df, sf, dist, cos_ptr, sin_ptr, i);
+			}
+			inverse_butterflies <VEC> (df, sf, dist, cos_ptr, sin_ptr, last);
+		}
+
+		else
+		{
+			for (long i = 1; i < dist; ++ i)
+			{
+				df [c1_r + i] = sf [c1_r + i] + sf [c2_r - i];
+				df [c1_i + i] = sf [c2_r + i] - sf [cend - i];
+
+				const DataType	c = cos_ptr [i];
+				const DataType	s = sin_ptr [i];
+
+				const DataType	vr = sf [c1_r + i] - sf [c2_r - i];
+				const DataType	vi = sf [c2_r + i] + sf [cend - i];
+
+				df [c2_r + i] = vr * c + vi * s;
+				df [c2_i + i] = vi * c - vr * s;
+			}
+		}
+
+		coef_index += cend;
+	}
+	while (coef_index < len);
+}
+
+
+
+// FFTRealPassDirect <2>::process () without the intermediate buffer. Each
+// step takes 32 coefficients: lane j of the vectors is the third pass group
+// j, made of the first pass groups 2 * j (s_0 to s_3) and 2 * j + 1 (s_4 to
+// s_7). The first passes are gathered straight into the lanes.
+template <class VEC>
+void	direct_first (long len, DataType dest_ptr [], const DataType x_ptr [], const long br_ptr [])
+{
+	typedef	typename VEC::V	V;
+
+	const long		qlen = len >> 2;
+	const V			sqrt2_2 = VEC::set1 (DataType (SQRT2 * 0.5));
+
+	long				coef_index = 0;
+	do
+	{
+		const long *	br = br_ptr + (coef_index >> 2);
+
+		V					s [8];
+		for (int h = 0; h < 2; ++ h)
+		{
+			// First pass group of each lane
+			const long		ri_0 = br [h];
+			const long		ri_1 = br [h + 2];
+			const long		ri_2 = br [h + 4];
+			const long		ri_3 = br [h + 6];
+
+			const V			x_0 = VEC::set4 (x_ptr [ri_0           ], x_ptr [ri_1           ], x_ptr [ri_2           ], x_ptr [ri_3           ]);
+			const V			x_1 = VEC::set4 (x_ptr [ri_0 + 2 * qlen], x_ptr [ri_1 + 2 * qlen], x_ptr [ri_2 + 2 * qlen], x_ptr [ri_3 + 2 * qlen]);
+			const V			x_2 = VEC::set4 (x_ptr [ri_0 + 1 * qlen], x_ptr [ri_1 + 1 * qlen], x_ptr [ri_2 + 1 * qlen], x_ptr [ri_3 + 1 * qlen]);
+			const V			x_3 = VEC::set4 (x_ptr [ri_0 + 3 * qlen], x_ptr [ri_1 + 3 * qlen], x_ptr [ri_2 + 3 * qlen], x_ptr [ri_3 + 3 * qlen]);
+
+			const V			sf_0 = VEC::add (x_0, x_1);
+			const V			sf_2 = VEC::add (x_2, x_3);
+
+			s [h * 4    ] = VEC::add (sf_0, sf_2);
+			s [h * 4 + 1] = VEC::sub (x_0, x_1);
+			s [h * 4 + 2] = VEC::sub (sf_0, sf_2);
+			s [h * 4 + 3] = VEC::sub (x_2, x_3);
+		}
+
+		const V			v_1 = VEC::mul (VEC::sub (s [5], s [7]), sqrt2_2);
+		const V			v_2 = VEC::mul (VEC::add (s [5], s [7]), sqrt2_2);
+
+		V					d_0 = VEC::add (s [0], s [4]);
+		V					d_1 = VEC::add (s [1], v_1);
+		V					d_2 = s [2];
+		V					d_3 = VEC::sub (s [1], v_1);
+		V					d_4 = VEC::sub (s [0], s [4]);
+		V					d_5 = VEC::add (v_2, s [3]);
+		V					d_6 = s [6];
+		V					d_7 = VEC::sub (v_2, s [3]);
+
+		VEC::transpose4 (d_0, d_1, d_2, d_3);
+		VEC::transpose4 (d_4, d_5, d_6, d_7);
+
+		DataType	* const	df = dest_ptr + coef_index;
+		VEC::store (df     , d_0);
+		VEC::store (df +  4, d_4);
+		VEC::store (df +  8, d_1);
+		VEC::store (df + 12, d_5);
+		VEC::store (df + 16, d_2);
+		VEC::store (df + 20, d_6);
+		VEC::store (df + 24, d_3);
+		VEC::store (df + 28, d_7);
+
+		coef_index += 32;
+	}
+	while (coef_index < len);
+}
+
+
+
+// FFTRealPassInverse <2>::process () without the intermediate buffer, lanes
+// as in direct_first (). The results are scattered in bit-reversed order.
+template <class VEC>
+void	inverse_last (long len, DataType dest_ptr [], const DataType src_ptr [], const long br_ptr [])
+{
+	typedef	typename VEC::V	V;
+
+	const long		qlen = len >> 2;
+	const V			sqrt2_2 = VEC::set1 (DataType (SQRT2 * 0.5));
+	const V			two = VEC::set1 (DataType (2));
+
+	long				coef_index = 0;
+	do
+	{
+		const DataType	* const	sf = src_ptr + coef_index;
+
+		V					s_0 = VEC::load (sf     );
+		V					s_4 = VEC::load (sf +  4);
+		V					s_1 = VEC::load (sf +  8);
+		V					s_5 = VEC::load (sf + 12);
+		V					s_2 = VEC::load (sf + 16);
+		V					s_6 = VEC::load (sf + 20);
+		V					s_3 = VEC::load (sf + 24);
+		V					s_7 = VEC::load (sf + 28);
+
+		VEC::transpose4 (s_0, s_1, s_2, s_3);
+		VEC::transpose4 (s_4, s_5, s_6, s_7);
+
+		// Antepenultimate pass
+		const V			vr = VEC::sub (s_1, s_3);
+		const V			vi = VEC::add (s_5, s_7);
+
+		V					d [8];
+		d [0] = VEC::add (s_0, s_4);
+		d [1] = VEC::add (s_1, s_3);
+		d [2] = VEC::mul (s_2, two);
+		d [3] = VEC::sub (s_5, s_7);
+		d [4] = VEC::sub (s_0, s_4);
+		d [5] = VEC::mul (VEC::add (vr, vi), sqrt2_2);
+		d [6] = VEC::mul (s_6, two);
+		d [7] = VEC::mul (VEC::sub (vi, vr), sqrt2_2);
+
+		// Penultimate and last pass, lane j of o [h * 4 + k] goes to the
+		// position k of the group 2 * j + h
+		DataType			o [8] [4];
+		for (int h = 0; h < 2; ++ h)
+		{
+			const V			b_0 = VEC::add (d [h * 4], d [h * 4 + 2]);
+			const V			b_2 = VEC::sub (d [h * 4], d [h * 4 + 2]);
+			const V			b_1 = VEC::mul (d [h * 4 + 1], two);
+			const V			b_3 = VEC::mul (d [h * 4 + 3], two);
+
+			VEC::store (o [h * 4    ], VEC::add (b_0, b_1));
+			VEC::store (o [h * 4 + 1], VEC::sub (b_0, b_1));
+			VEC::store (o [h * 4 + 2], VEC::add (b_2, b_3));
+			VEC::store (o [h * 4 + 3], VEC::sub (b_2, b_3));
+		}
+
+		const long *	br = br_ptr + (coef_index >> 2);
+		for (int j = 0; j < 4; ++ j)
+		{
+			for (int h = 0; h < 2; ++ h)
+			{
+				const long		ri_0 = br [j * 2 + h];
+
+				dest_ptr [ri_0           ] = o [h * 4    ] [j];
+				dest_ptr [ri_0 + 2 * qlen] = o [h * 4 + 1] [j];
+				dest_ptr [ri_0 + 1 * qlen] = o [h * 4 + 2] [j];
+				dest_ptr [ri_0 + 3 * qlen] = o [h * 4 + 3] [j];
+			}
+		}
+
+		coef_index += 32;
+	}
+	while (coef_index < len);
+}
+
+
+
+/*\\\ EOF \\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\*/
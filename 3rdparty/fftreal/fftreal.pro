@@ -17,11 +17,14 @@ HEADERS  += Array.h \
             FFTRealPassInverse.hpp \
             FFTRealSelect.h \
             FFTRealSelect.hpp \
+            FFTRealSimd.h \
+            FFTRealSimdPasses.hpp \
             FFTRealUseTrigo.h \
             FFTRealUseTrigo.hpp \
             OscSinCos.h \
             OscSinCos.hpp \
             def.h
+SOURCES  += FFTRealSimd.cpp
 
 # Wrapper used to export the required instantiation of the FFTRealFixLen template
 HEADERS  += fftreal_wrapper.h
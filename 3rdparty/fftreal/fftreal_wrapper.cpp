@@ -33,12 +33,60 @@
 
 class FFTRealWrapperPrivate {
 public:
-    FFTRealFixLen<FFTLengthPowerOfTwo> m_fft;
+    virtual ~FFTRealWrapperPrivate() {}
+    virtual int length() const = 0;
+    virtual void do_fft(float f[], const float x[]) = 0;
+    virtual void do_fft(float f[], const float x[], float buffer[]) const = 0;
+    virtual void do_fft(float f[], const float x[], int count, float buffer[]) const = 0;
+    virtual void do_ifft(const float f[], float x[], float buffer[]) const = 0;
 };
 
+template <int LL2>
+class FFTRealWrapperFixLen : public FFTRealWrapperPrivate {
+public:
+    int length() const override
+    { return int(m_fft.get_length()); }
+    void do_fft(float f[], const float x[]) override
+    { m_fft.do_fft(f, x); }
+    void do_fft(float f[], const float x[], float buffer[]) const override
+    { m_fft.do_fft(f, x, buffer); }
+    void do_fft(float f[], const float x[], int count, float buffer[]) const override
+    {
+        const long length = m_fft.get_length();
+        for (int i = 0; i < count; ++i)
+            m_fft.do_fft(f + i * length, x + i * length, buffer);
+    }
+    void do_ifft(const float f[], float x[], float buffer[]) const override
+    { m_fft.do_ifft(f, x, buffer); }
+
+private:
+    FFTRealFixLen<LL2> m_fft;
+};
+
+static FFTRealWrapperPrivate *createPrivate(int lengthPowerOfTwo)
+{
+    switch (lengthPowerOfTwo) {
+    case 8: return new FFTRealWrapperFixLen<8>;
+    case 9: return new FFTRealWrapperFixLen<9>;
+    case 10: return new FFTRealWrapperFixLen<10>;
+    case 11: return new FFTRealWrapperFixLen<11>;
+    case 12: return new FFTRealWrapperFixLen<12>;
+    case 13: return new FFTRealWrapperFixLen<13>;
+    case 14: return new FFTRealWrapperFixLen<14>;
+    }
+    Q_ASSERT_X(false, "FFTRealWrapper", "unsupported length");
+    return new FFTRealWrapperFixLen<FFTLengthPowerOfTwo>;
+}
+
 
 FFTRealWrapper::FFTRealWrapper()
-    :   m_private(new FFTRealWrapperPrivate)
+    :   m_private(createPrivate(FFTLengthPowerOfTwo))
+{
+
+}
+
+FFTRealWrapper::FFTRealWrapper(int lengthPowerOfTwo)
+    :   m_private(createPrivate(lengthPowerOfTwo))
 {
 
 }
@@ -48,7 +96,30 @@ FFTRealWrapper::~FFTRealWrapper()
     delete m_private;
 }
 
+int FFTRealWrapper::length() const
+{
+    return m_private->length();
+}
+
 void FFTRealWrapper::calculateFFT(DataType in[], const DataType out[])
 {
-    m_private->m_fft.do_fft(in, out);
+    m_private->do_fft(in, out);
+}
+
+void FFTRealWrapper::calculateFFT(DataType out[], const DataType in[], DataType scratch[]) const
+{
+    const FFTRealWrapperPrivate *fft = m_private;
+    fft->do_fft(out, in, scratch);
+}
+
+void FFTRealWrapper::calculateFFT(DataType out[], const DataType in[], int count, DataType scratch[]) const
+{
+    const FFTRealWrapperPrivate *fft = m_private;
+    fft->do_fft(out, in, count, scratch);
+}
+
+void FFTRealWrapper::calculateIFFT(DataType out[], const DataType in[], DataType scratch[]) const
+{
+    const FFTRealWrapperPrivate *fft = m_private;
+    fft->do_ifft(in, out, scratch);
 }
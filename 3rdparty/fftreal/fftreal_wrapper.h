@@ -34,6 +34,10 @@ class FFTRealWrapperPrivate;
 // number below.
 static const int FFTLengthPowerOfTwo = 8;
 
+// Range of the other lengths a wrapper can be created for
+static const int FFTMinLengthPowerOfTwo = 8;
+static const int FFTMaxLengthPowerOfTwo = 14;
+
 /**
  * Wrapper around the FFTRealFixLen template provided by the FFTReal
  * library
@@ -44,18 +48,40 @@ static const int FFTLengthPowerOfTwo = 8;
  * function, thereby allowing an application to dynamically link
  * against the FFTReal implementation.
  *
+ * The overload taking a scratch buffer is const and reentrant, so a single
+ * instance with its tables can serve any number of threads, each of them
+ * with its own FFTLength elements of scratch.
+ *
+ * Other lengths between 2^FFTMinLengthPowerOfTwo and 2^FFTMaxLengthPowerOfTwo
+ * are instantiated as well and chosen at construction, for analyses which
+ * need longer windows than FFTLength.
+ *
  * See http://ldesoras.free.fr/prod.html
  */
 class FFTREAL_EXPORT FFTRealWrapper
 {
 public:
     FFTRealWrapper();
+    explicit FFTRealWrapper(int lengthPowerOfTwo);
     ~FFTRealWrapper();
 
     typedef float DataType;
+    static const int FFTLength = 1 << FFTLengthPowerOfTwo;
+
+    int length() const;
+
     void calculateFFT(DataType in[], const DataType out[]);
+    void calculateFFT(DataType out[], const DataType in[], DataType scratch[]) const;
+
+    // count transforms of consecutive blocks of length() elements
+    void calculateFFT(DataType out[], const DataType in[], int count, DataType scratch[]) const;
+
+    // Not scaled, the result is length() times the original signal
+    void calculateIFFT(DataType out[], const DataType in[], DataType scratch[]) const;
 
 private:
+    Q_DISABLE_COPY(FFTRealWrapper)
+
     FFTRealWrapperPrivate*  m_private;
 };
 
@@ -0,0 +1,588 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "analysis.h"
+#include "jobcontrol.h"
+#include "wavfile.h"
+#include "utils.h"
+#include "trace.h"
+#include "fftreal_wrapper.h"
+#include "pitch.h"
+#include "tapers.h"
+
+#include <math.h>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <limits>
+
+template<int N> class PowerOfTwo
+{ public: static const int Result = PowerOfTwo<N-1>::Result * 2; };
+
+template<> class PowerOfTwo<0>
+{ public: static const int Result = 1; };
+
+const int SpectrumLengthSamples = PowerOfTwo<FFTLengthPowerOfTwo>::Result;
+const int SpectrumHopSamples = SpectrumLengthSamples / 2;
+
+// A full scale sine puts a quarter of the squared length into its bin. Levels
+// are about half a dB apart, which is below what can be told by eye.
+const float SpectrumPowerScale = 4.0f / (float(SpectrumLengthSamples) * SpectrumLengthSamples);
+const float SpectrumFloorDb = -120.0f;
+const float SpectrumLevelsPerDb = (Analysis::SpectrumLevels - 1) / -SpectrumFloorDb;
+
+// Time half bandwidth product of the tapers and the number of them which
+// keep most of their energy within it
+const double TaperHalfBandwidth = 2.5;
+const int TaperCount = 4;
+
+// Frames deinterleaved at once, a multiple of both the peak bin and the hop
+const qint64 BlockFrames = 32 * PeakPyramid::BinFrames;
+
+// Pitch and formant values tracked between checks of the job control
+const qint64 PitchChunkValues = 256;
+const qint64 FormantChunkValues = 256;
+
+const quint32 CacheMagic   = 0x48434141; // "AACH"
+const quint32 CacheVersion = 9;
+
+// Formant tables start at multiples of this in the cache, so they can be
+// mapped in place
+const qint64 CacheTableAlignment = 8;
+
+// Its tables are built once and shared by all analysis threads, each of
+// them passes its own scratch
+static const FFTRealWrapper &sharedFft()
+{
+    static const FFTRealWrapper fft;
+    return fft;
+}
+
+static const QVector<QVector<float>> &sharedTapers()
+{
+    static const QVector<QVector<float>> tapers = dpssTapers(SpectrumLengthSamples, TaperHalfBandwidth, TaperCount);
+    return tapers;
+}
+
+// A few ranges per thread of the pool, so an uneven one does not hold it up
+static QVector<QPair<qint64, qint64>> splitRanges(qint64 count)
+{
+    const qint64 tasks = qMin(count, qint64(QThread::idealThreadCount()) * 4);
+    QVector<QPair<qint64, qint64>> ranges;
+    for (qint64 i = 0; i < tasks; ++i)
+        ranges.append(qMakePair(count * i / tasks, count * (i + 1) / tasks));
+    return ranges;
+}
+
+static qint64 alignUp(qint64 value, qint64 alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Reads the fixed part of the cache, which holds the levels as well, and
+// checks that it belongs to the file
+static bool readCacheHeader(QDataStream &stream, const WavFile *file, QVector<ChannelLevels> *levels)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 magic, version;
+    qint64 sourceSize, sourceModified, numFrames;
+    qint32 channels;
+    stream >> magic >> version >> sourceSize >> sourceModified >> channels >> numFrames;
+    if (stream.status() != QDataStream::Ok
+            || magic != CacheMagic || version != CacheVersion
+            || sourceSize != file->size()
+            || sourceModified != QFileInfo(file->fileName()).lastModified().toMSecsSinceEpoch()
+            || channels != file->channelCount()
+            || numFrames != file->numSamples())
+        return false;
+
+    levels->resize(channels);
+    for (ChannelLevels &level : *levels)
+        stream >> level.peak >> level.rms >> level.loudness;
+    return stream.status() == QDataStream::Ok;
+}
+
+Analysis::Analysis()
+    : _numFrames(0)
+    , _products(0)
+    , _frequencyScale(MelScale)
+    , _multitaper(false)
+{
+}
+
+void Analysis::compute(const WavFile *file, int products, JobControl *control)
+{
+    ANALYSIS_TRACE("Analysis::compute");
+    const int channels = file->channelCount();
+
+    // Products computed before are kept if they belong to the same samples
+    if (_numFrames != file->numSamples() || channelCount() != channels)
+        clear();
+
+    const int sampleRate = file->format().sampleRate();
+    const FrequencyAxis axis(_frequencyScale, SpectrumLengthSamples, sampleRate);
+    const Filterbank filterbank(axis, SpectrumLengthSamples, sampleRate);
+    _numFrames = file->numSamples();
+    const int spectrumFrames = _numFrames >= SpectrumLengthSamples
+            ? (_numFrames - SpectrumLengthSamples) / SpectrumHopSamples + 1
+            : 0;
+    const qint64 pitchValues = PitchTracker::valueCount(_numFrames, sampleRate);
+    const qint64 formantValues = FormantTracker::valueCount(_numFrames, sampleRate);
+
+    _peaks.resize(channels);
+    _spectrums.resize(channels);
+    _pitch.resize(channels);
+    _formants.resize(channels);
+    QVector<float*> pitchTargets(channels);
+    QVector<FormantFrame*> formantTargets(channels);
+    for (int c = 0; c < channels; ++c) {
+        if (products & Peaks)
+            _peaks[c].reset(_numFrames);
+        if (products & Spectrums)
+            _spectrums[c] = Spectrogram(spectrumFrames, axis.rows());
+        if (products & Pitch) {
+            _pitch[c].resize(pitchValues);
+            pitchTargets[c] = _pitch[c].data();
+        }
+        if (products & Formants) {
+            _formants[c].resize(formantValues);
+            formantTargets[c] = _formants[c].data();
+        }
+    }
+
+    QVector<ChannelTarget> targets(channels);
+    for (int c = 0; c < channels; ++c) {
+        Spectrogram &spectrum = _spectrums[c];
+        QVector<uchar*> tiles;
+        for (int t = 0; (products & Spectrums) && t < spectrum.tileCount(); ++t)
+            tiles.append(spectrum.tileData(t));
+        targets[c] = ChannelTarget {
+            (products & Peaks) ? _peaks[c].baseBins() : nullptr,
+            tiles,
+            spectrum.width()
+        };
+    }
+
+    // Blocks are independent, so they are spread over the thread pool, each
+    // range with its own buffers. Pitch and formant chunks of all channels
+    // are numbered one after another and spread the same way.
+    const qint64 blocks = (products & (Peaks | Spectrums))
+            ? (_numFrames + BlockFrames - 1) / BlockFrames
+            : 0;
+    const qint64 pitchChunks = (products & Pitch)
+            ? (pitchValues + PitchChunkValues - 1) / PitchChunkValues
+            : 0;
+    const qint64 formantChunks = (products & Formants)
+            ? (formantValues + FormantChunkValues - 1) / FormantChunkValues
+            : 0;
+
+    if (control)
+        control->setTotal(blocks + (pitchChunks + formantChunks) * channels);
+
+    QVector<QPair<qint64, qint64>> ranges = splitRanges(blocks);
+    QtConcurrent::blockingMap(ranges, [&] (const QPair<qint64, qint64> &range) {
+        computeBlocks(file, targets, filterbank, range.first, range.second, control);
+    });
+
+    if (pitchChunks > 0 && !(control && control->isCancelled())) {
+        const PitchTracker tracker(sampleRate);
+        ranges = splitRanges(pitchChunks * channels);
+        QtConcurrent::blockingMap(ranges, [&] (const QPair<qint64, qint64> &range) {
+            computePitch(file, tracker, pitchTargets, range.first, range.second, control);
+        });
+    }
+
+    if (formantChunks > 0 && !(control && control->isCancelled())) {
+        const FormantTracker tracker(sampleRate);
+        ranges = splitRanges(formantChunks * channels);
+        QtConcurrent::blockingMap(ranges, [&] (const QPair<qint64, qint64> &range) {
+            computeFormants(file, tracker, formantTargets, range.first, range.second, control);
+        });
+    }
+
+    if (control && control->isCancelled()) {
+        clear();
+        return;
+    }
+
+    if (products & Peaks) {
+        for (int c = 0; c < channels; ++c)
+            _peaks[c].buildLevels();
+    }
+    if (products & Spectrums) {
+        for (int c = 0; c < channels; ++c)
+            _spectrums[c].compress();
+    }
+    _products |= products;
+
+    qCDebug(logAnalysis) << "Analysis::compute"
+             << "products" << products
+             << "channels" << channels
+             << "numFrames" << _numFrames
+             << "spectrumFrames" << spectrumFrames
+             << "pitchValues" << pitchValues
+             << "formantValues" << formantValues;
+}
+
+void Analysis::clear()
+{
+    _numFrames = 0;
+    _products = 0;
+    _peaks.clear();
+    _spectrums.clear();
+    _pitch.clear();
+    _formants.clear();
+}
+
+void Analysis::setFrequencyScale(FrequencyScale scale)
+{
+    if (scale == _frequencyScale)
+        return;
+
+    _frequencyScale = scale;
+    dropSpectrums();
+}
+
+void Analysis::setMultitaper(bool enabled)
+{
+    if (enabled == _multitaper)
+        return;
+
+    _multitaper = enabled;
+    dropSpectrums();
+}
+
+bool Analysis::load(const WavFile *file)
+{
+    ANALYSIS_TRACE("Analysis::load");
+    clear();
+
+    // Stays open while any formant table is mapped from it
+    QSharedPointer<QFile> cache(new QFile(cachePath(file->fileName())));
+    if (!cache->open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(cache.data());
+    QVector<ChannelLevels> levels;
+    if (!readCacheHeader(stream, file, &levels))
+        return false;
+
+    qint32 scale;
+    bool multitaper;
+    stream >> scale >> multitaper;
+    if (stream.status() != QDataStream::Ok || scale < LinearScale || scale > MelScale)
+        return false;
+
+    const int channels = file->channelCount();
+    _frequencyScale = FrequencyScale(scale);
+    _multitaper = multitaper;
+    _numFrames = file->numSamples();
+    _products = AllProducts;
+    _peaks.resize(channels);
+    _spectrums.resize(channels);
+    _pitch.resize(channels);
+    _formants.resize(channels);
+    const qint64 pitchValues = PitchTracker::valueCount(_numFrames, file->format().sampleRate());
+    const qint64 formantValues = FormantTracker::valueCount(_numFrames, file->format().sampleRate());
+
+    bool ok = true;
+    for (int c = 0; ok && c < channels; ++c) {
+        ok = _peaks[c].read(stream, _numFrames) && _spectrums[c].read(stream);
+
+        qint32 count;
+        if (ok) {
+            stream >> count;
+            ok = stream.status() == QDataStream::Ok && count == pitchValues;
+        }
+        if (ok) {
+            const int length = count * sizeof(float);
+            _pitch[c].resize(count);
+            ok = stream.readRawData(reinterpret_cast<char*>(_pitch[c].data()), length) == length;
+        }
+
+        if (ok) {
+            stream >> count;
+            ok = stream.status() == QDataStream::Ok && count == formantValues;
+        }
+        if (ok) {
+            const qint64 offset = alignUp(cache->pos(), CacheTableAlignment);
+            const qint64 length = count * qint64(sizeof(FormantFrame));
+            FormantTable &formants = _formants[c];
+            if (formants.map(cache, offset, count)) {
+                ok = cache->seek(offset + length);
+            } else {
+                formants.resize(count);
+                ok = cache->seek(offset)
+                        && stream.readRawData(reinterpret_cast<char*>(formants.data()), length) == length;
+            }
+        }
+    }
+
+    if (!ok) {
+        qCWarning(logAnalysis) << "Analysis::load" << "broken cache" << cache->fileName();
+        clear();
+        return false;
+    }
+
+    qCDebug(logAnalysis) << "Analysis::load" << cache->fileName();
+    return true;
+}
+
+void Analysis::detachFromCache()
+{
+    for (FormantTable &formants : _formants)
+        formants.detach();
+}
+
+bool Analysis::save(const WavFile *file) const
+{
+    ANALYSIS_TRACE("Analysis::save");
+    QSaveFile cache(cachePath(file->fileName()));
+    if (!cache.open(QIODevice::WriteOnly)) {
+        qCWarning(logAnalysis) << "Analysis::save" << "could not write" << cache.fileName();
+        return false;
+    }
+
+    QDataStream stream(&cache);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    // Spectrums have the peak gains baked in, so the levels are the exact
+    // ones of the file the analysis was computed from
+    stream << CacheMagic << CacheVersion
+           << file->size()
+           << QFileInfo(file->fileName()).lastModified().toMSecsSinceEpoch()
+           << qint32(channelCount()) << _numFrames;
+    const ChannelLevels unknown { 0.0f, 0.0f, -std::numeric_limits<float>::infinity() };
+    for (int c = 0; c < channelCount(); ++c) {
+        const ChannelLevels level = file->levels().value(c, unknown);
+        stream << level.peak << level.rms << level.loudness;
+    }
+    stream << qint32(_frequencyScale) << _multitaper;
+
+    for (int c = 0; c < channelCount(); ++c) {
+        _peaks[c].write(stream);
+
+        _spectrums[c].write(stream);
+
+        const QVector<float> &pitch = _pitch[c];
+        stream << qint32(pitch.size());
+        stream.writeRawData(reinterpret_cast<const char*>(pitch.constData()), pitch.size() * sizeof(float));
+
+        const FormantTable &formants = _formants[c];
+        stream << qint32(formants.size());
+        const QByteArray padding(int(alignUp(cache.pos(), CacheTableAlignment) - cache.pos()), 0);
+        stream.writeRawData(padding.constData(), padding.size());
+        stream.writeRawData(reinterpret_cast<const char*>(formants.constData()),
+                            int(formants.size() * sizeof(FormantFrame)));
+    }
+
+    if (stream.status() != QDataStream::Ok || !cache.commit()) {
+        qCWarning(logAnalysis) << "Analysis::save" << "could not write" << cache.fileName();
+        return false;
+    }
+
+    qCDebug(logAnalysis) << "Analysis::save" << cache.fileName();
+    return true;
+}
+
+bool Analysis::loadLevels(const WavFile *file, QVector<ChannelLevels> *levels)
+{
+    QFile cache(cachePath(file->fileName()));
+    if (!cache.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&cache);
+    return readCacheHeader(stream, file, levels);
+}
+
+QString Analysis::cachePath(const QString &fileName)
+{
+    return fileName + ".analysis";
+}
+
+int Analysis::spectrumLength()
+{
+    return SpectrumLengthSamples;
+}
+
+int Analysis::spectrumHop()
+{
+    return SpectrumHopSamples;
+}
+
+float Analysis::spectrumDb(int level)
+{
+    return SpectrumFloorDb + level / SpectrumLevelsPerDb;
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+void Analysis::dropSpectrums()
+{
+    _products &= ~Spectrums;
+    for (Spectrogram &spectrum : _spectrums)
+        spectrum = Spectrogram();
+}
+
+void Analysis::computeBlocks(const WavFile *file, const QVector<ChannelTarget> &targets, const Filterbank &filterbank,
+                             qint64 firstBlock, qint64 lastBlock, JobControl *control) const
+{
+    ANALYSIS_TRACE("Analysis::computeBlocks");
+    ANALYSIS_COUNTER("blocks", lastBlock - firstBlock);
+    const int channels = file->channelCount();
+    const int spectrumHalf = SpectrumLengthSamples / 2;
+
+    const FFTRealWrapper &fft = sharedFft();
+    QVector<float> samples(BlockFrames + SpectrumLengthSamples);
+    float *buffer = samples.data();
+    float output[SpectrumLengthSamples];
+    float scratch[SpectrumLengthSamples];
+    float power[SpectrumLengthSamples / 2];
+    QVector<float> rows(filterbank.rows());
+
+    // Every taper has unit energy, the plain window has the full length
+    const QVector<QVector<float>> &tapers = sharedTapers();
+    QVector<float> tapered(_multitaper ? TaperCount * SpectrumLengthSamples : 0);
+    QVector<float> spectra(tapered.size());
+    const float taperScale = float(SpectrumLengthSamples) / TaperCount;
+
+    for (qint64 block = firstBlock; block < lastBlock; ++block) {
+        if (control) {
+            if (control->isCancelled())
+                return;
+            control->advance(1);
+        }
+
+        const qint64 begin = block * BlockFrames;
+        const qint64 end = qMin(begin + BlockFrames, _numFrames);
+        const qint64 tailEnd = qMin(end + SpectrumLengthSamples - SpectrumHopSamples, _numFrames);
+
+        for (int c = 0; c < channels; ++c) {
+            const ChannelTarget &target = targets[c];
+            const qint16 *ptr = file->data() + begin * channels + c;
+            const float gain = file->peakGain(c);
+
+            // Deinterleave the channel, summarizing peak bins on the way
+            for (qint64 bin = begin; bin < end; bin += PeakPyramid::BinFrames) {
+                const qint64 count = qMin(qint64(PeakPyramid::BinFrames), end - bin);
+                float *out = buffer + (bin - begin);
+                qint16 min = *ptr;
+                qint16 max = *ptr;
+                float power = 0.0f;
+                for (qint64 i = 0; i < count; ++i, ptr += channels) {
+                    const qint16 value = *ptr;
+                    min = qMin(min, value);
+                    max = qMax(max, value);
+                    const float real = pcmToReal(value);
+                    power += real * real;
+                    out[i] = real * gain;
+                }
+                if (target.bins)
+                    target.bins[bin / PeakPyramid::BinFrames] = PeakPyramid::Bin { min, max, power / count };
+            }
+
+            if (target.spectrumTiles.isEmpty())
+                continue;
+
+            // Spectrum windows starting near the end of the block overlap the next one
+            for (qint64 i = end; i < tailEnd; ++i, ptr += channels)
+                buffer[i - begin] = pcmToReal(*ptr) * gain;
+
+            for (qint64 i = begin / SpectrumHopSamples; i < target.spectrumWidth && i * SpectrumHopSamples < end; ++i) {
+                const float *window = buffer + (i * SpectrumHopSamples - begin);
+                if (_multitaper) {
+                    for (int t = 0; t < TaperCount; ++t) {
+                        const float *taper = tapers[t].constData();
+                        float *out = tapered.data() + t * SpectrumLengthSamples;
+                        for (int j = 0; j < SpectrumLengthSamples; ++j)
+                            out[j] = window[j] * taper[j];
+                    }
+                    fft.calculateFFT(spectra.data(), tapered.constData(), TaperCount, scratch);
+
+                    std::fill(power, power + spectrumHalf, 0.0f);
+                    for (int t = 0; t < TaperCount; ++t) {
+                        const float *spectrum = spectra.constData() + t * SpectrumLengthSamples;
+                        power[0] += spectrum[0] * spectrum[0];
+                        for (int j = 1; j < spectrumHalf; ++j)
+                            power[j] += spectrum[j] * spectrum[j] + spectrum[spectrumHalf + j] * spectrum[spectrumHalf + j];
+                    }
+                    for (int j = 0; j < spectrumHalf; ++j)
+                        power[j] *= taperScale;
+                } else {
+                    fft.calculateFFT(output, window, scratch);
+                    power[0] = output[0] * output[0];
+                    for (int j = 1; j < spectrumHalf; ++j)
+                        power[j] = output[j] * output[j] + output[spectrumHalf + j] * output[spectrumHalf + j];
+                }
+                filterbank.apply(power, rows.data());
+
+                uchar *column = target.spectrumTiles[int(i / Spectrogram::TileColumns)] + i % Spectrogram::TileColumns;
+                for (int j = 0; j < rows.size(); ++j) {
+                    const float db = 10.0f * log10f(qMax(rows[j] * SpectrumPowerScale, 1e-30f));
+                    const float level = (db - SpectrumFloorDb) * SpectrumLevelsPerDb + 0.5f;
+                    column[j * Spectrogram::TileColumns] = uchar(qBound(0.0f, level, SpectrumLevels - 1.0f));
+                }
+            }
+        }
+    }
+}
+
+void Analysis::computePitch(const WavFile *file, const PitchTracker &tracker, const QVector<float*> &targets,
+                            qint64 firstChunk, qint64 lastChunk, JobControl *control) const
+{
+    ANALYSIS_TRACE("Analysis::computePitch");
+    const int channels = file->channelCount();
+    const qint64 values = PitchTracker::valueCount(_numFrames, file->format().sampleRate());
+    const qint64 chunks = (values + PitchChunkValues - 1) / PitchChunkValues;
+
+    for (qint64 i = firstChunk; i < lastChunk; ++i) {
+        if (control) {
+            if (control->isCancelled())
+                return;
+            control->advance(1);
+        }
+
+        const int c = int(i / chunks);
+        const qint64 first = (i % chunks) * PitchChunkValues;
+        const qint64 last = qMin(first + PitchChunkValues, values);
+        tracker.track(file->data(), channels, c, file->peakGain(c), first, last, targets[c] + first);
+    }
+}
+
+void Analysis::computeFormants(const WavFile *file, const FormantTracker &tracker, const QVector<FormantFrame*> &targets,
+                               qint64 firstChunk, qint64 lastChunk, JobControl *control) const
+{
+    ANALYSIS_TRACE("Analysis::computeFormants");
+    const int channels = file->channelCount();
+    const qint64 values = FormantTracker::valueCount(_numFrames, file->format().sampleRate());
+    const qint64 chunks = (values + FormantChunkValues - 1) / FormantChunkValues;
+
+    for (qint64 i = firstChunk; i < lastChunk; ++i) {
+        if (control) {
+            if (control->isCancelled())
+                return;
+            control->advance(1);
+        }
+
+        const int c = int(i / chunks);
+        const qint64 first = (i % chunks) * FormantChunkValues;
+        const qint64 last = qMin(first + FormantChunkValues, values);
+        tracker.track(file->data(), channels, c, file->peakGain(c), first, last, targets[c] + first);
+    }
+}
@@ -0,0 +1,118 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <QVector>
+
+#include "filterbank.h"
+#include "formants.h"
+#include "levelmeter.h"
+#include "peakpyramid.h"
+#include "spectrogram.h"
+
+class Filterbank;
+class JobControl;
+class PitchTracker;
+class WavFile;
+
+// Per-channel analysis products of a file: peak pyramids, spectrograms, pitch
+// and formant tracks. Peaks and spectrograms are filled by a single
+// deinterleaving pass over the samples, so cheap peaks can be shown before
+// the rest is ready. Pitch and formant windows are longer, so each of them
+// has a pass of its own.
+class Analysis
+{
+public:
+    enum Product
+    {
+        Peaks = 1,
+        Spectrums = 2,
+        Pitch = 4,
+        Formants = 8,
+        AllProducts = Peaks | Spectrums | Pitch | Formants
+    };
+
+    // Spectrum levels are one byte each, the power of the row in dB relative
+    // to a full scale sine, quantized from spectrumDb(0) up to 0 dB. Contrast
+    // and colours are applied when drawing, see SpectrumDisplay.
+    static const int SpectrumLevels = 256;
+
+    Analysis();
+
+    void compute(const WavFile *file, int products = AllProducts, JobControl *control = nullptr);
+    void clear();
+
+    bool load(const WavFile *file);
+    bool save(const WavFile *file) const;
+
+    // Loaded formant tables stay mapped from the cache, which cannot be
+    // replaced on Windows then. Every copy has to let it go before a save.
+    void detachFromCache();
+    static QString cachePath(const QString &fileName);
+
+    // Exact levels of the file stored with the cache, readable as soon as
+    // the header of the file is
+    static bool loadLevels(const WavFile *file, QVector<ChannelLevels> *levels);
+
+    // Spectrum column i covers frames [i * hop, i * hop + length)
+    static int spectrumLength();
+    static int spectrumHop();
+    static float spectrumDb(int level);
+
+    // Spectrum rows follow FrequencyAxis, the highest one on top. Changing
+    // the scale drops the spectrums, they are computed again on demand.
+    FrequencyScale frequencyScale() const { return _frequencyScale; }
+    void setFrequencyScale(FrequencyScale scale);
+
+    // Multitaper spectrums average the power of a few DPSS windowed FFTs
+    // instead of taking a single unwindowed one, which removes most of the
+    // noise speckle and the leakage around strong partials
+    bool multitaper() const { return _multitaper; }
+    void setMultitaper(bool enabled);
+
+    bool isEmpty() const { return _peaks.isEmpty(); }
+    int products() const { return _products; }
+    int channelCount() const { return _peaks.size(); }
+    qint64 numFrames() const { return _numFrames; }
+    const PeakPyramid &peaks(int channel) const { return _peaks[channel]; }
+    const Spectrogram &spectrum(int channel) const { return _spectrums[channel]; }
+
+    // F0 in Hz or 0 where unvoiced, laid out as described by PitchTracker
+    const QVector<float> &pitch(int channel) const { return _pitch[channel]; }
+
+    // Laid out as described by FormantTracker, mapped from the cache when
+    // loaded from it
+    const FormantTable &formants(int channel) const { return _formants[channel]; }
+
+private:
+    struct ChannelTarget
+    {
+        PeakPyramid::Bin *bins;
+        QVector<uchar*> spectrumTiles;
+        int spectrumWidth;
+    };
+
+    void dropSpectrums();
+    void computeBlocks(const WavFile *file, const QVector<ChannelTarget> &targets, const Filterbank &filterbank,
+                       qint64 firstBlock, qint64 lastBlock, JobControl *control) const;
+    void computePitch(const WavFile *file, const PitchTracker &tracker, const QVector<float*> &targets,
+                      qint64 firstChunk, qint64 lastChunk, JobControl *control) const;
+    void computeFormants(const WavFile *file, const FormantTracker &tracker, const QVector<FormantFrame*> &targets,
+                         qint64 firstChunk, qint64 lastChunk, JobControl *control) const;
+
+private:
+    qint64 _numFrames;
+    int _products;
+    FrequencyScale _frequencyScale;
+    bool _multitaper;
+    QVector<PeakPyramid> _peaks;
+    QVector<Spectrogram> _spectrums;
+    QVector<QVector<float>> _pitch;
+    QVector<FormantTable> _formants;
+};
+
+#endif // ANALYSIS_H
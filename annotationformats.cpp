@@ -0,0 +1,964 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "annotationformats.h"
+#include "annotations.h"
+#include "trace.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextCodec>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const int OutputBufferSize = 1 << 20;
+const int MaxNumberedId = 1 << 26;
+const char *DefaultLinguisticType = "default-lt";
+
+struct ImportedTier
+{
+    QString name;
+    AnnotationTier::Type type;
+    QVector<Annotation> annotations;
+};
+
+typedef QVector<ImportedTier> ImportedTiers;
+
+static bool fail(QString *errorString, const QString &message)
+{
+    if (errorString)
+        *errorString = message;
+    return false;
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Locale independent, exact for up to 15 significant digits and decimal
+// exponents which keep the scale factor exact (all times in practice),
+// anything else is passed to QByteArray
+static bool parseNumber(const char *begin, const char *end, double *value)
+{
+    static const double Powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    for (; p < end && isDigit(*p); ++p, ++digits)
+        mantissa = mantissa * 10 + (*p - '0');
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p, ++digits, --exponent)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+
+    if (digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        int power = 0;
+        const char *powerBegin = p;
+        for (; p < end && isDigit(*p) && power < 10000; ++p)
+            power = power * 10 + (*p - '0');
+        if (p == powerBegin)
+            digits = 0;
+        exponent += negativeExponent ? -power : power;
+    }
+
+    if (digits > 0 && p == end && digits <= 15 && exponent >= -22 && exponent <= 22) {
+        const double result = exponent < 0
+                ? static_cast<double>(mantissa) / Powers[-exponent]
+                : static_cast<double>(mantissa) * Powers[exponent];
+        *value = negative ? -result : result;
+        return true;
+    }
+
+    bool ok = false;
+    *value = QByteArray::fromRawData(begin, end - begin).toDouble(&ok);
+    return ok;
+}
+
+// Doubled quotes are the escape sequence of both TextGrid and CSV strings
+static QString decodeQuoted(const char *begin, const char *end, bool escaped)
+{
+    if (!escaped)
+        return QString::fromUtf8(begin, end - begin);
+
+    QByteArray unescaped;
+    unescaped.reserve(end - begin);
+    for (const char *p = begin; p < end; ++p) {
+        unescaped.append(*p);
+        if (*p == '"')
+            ++p;
+    }
+    return QString::fromUtf8(unescaped);
+}
+
+// Finds the closing quote of a string opened right before begin
+static const char *findClosingQuote(const char *begin, const char *end, bool *escaped)
+{
+    *escaped = false;
+    for (const char *p = begin; p < end; p += 2) {
+        p = static_cast<const char*>(memchr(p, '"', end - p));
+        if (p == nullptr)
+            return nullptr;
+        if (p + 1 == end || p[1] != '"')
+            return p;
+        *escaped = true;
+    }
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Praat TextGrid
+//-----------------------------------------------------------------------------
+
+// Both text flavours of TextGrid are the same sequence of numbers, strings
+// and flags, the long one just adds "key =" words and "[n]" indices which
+// are skipped, as Praat itself does
+class TextGridTokenizer
+{
+public:
+    TextGridTokenizer(const char *begin, const char *end)
+        : _p(begin)
+        , _end(end)
+        , _tokenBegin(nullptr)
+        , _tokenEnd(nullptr)
+        , _escaped(false)
+    {
+    }
+
+    bool number(double *value)
+    {
+        return next() == NumberToken && parseNumber(_tokenBegin, _tokenEnd, value);
+    }
+
+    bool string(QString *value)
+    {
+        if (next() != StringToken)
+            return false;
+        *value = decodeQuoted(_tokenBegin, _tokenEnd, _escaped);
+        return true;
+    }
+
+    bool flag(bool *exists)
+    {
+        if (next() != FlagToken)
+            return false;
+        *exists = QLatin1String(_tokenBegin, _tokenEnd - _tokenBegin) == QLatin1String("exists");
+        return true;
+    }
+
+private:
+    enum Token
+    {
+        EndToken,
+        NumberToken,
+        StringToken,
+        FlagToken,
+        ErrorToken
+    };
+
+    Token next()
+    {
+        while (_p < _end) {
+            const char c = *_p;
+            if (isSpace(c)) {
+                ++_p;
+            } else if (c == '"') {
+                const char *close = findClosingQuote(_p + 1, _end, &_escaped);
+                if (close == nullptr)
+                    return ErrorToken;
+                _tokenBegin = _p + 1;
+                _tokenEnd = close;
+                _p = close + 1;
+                return StringToken;
+            } else if (c == '<') {
+                const char *close = static_cast<const char*>(memchr(_p, '>', _end - _p));
+                if (close == nullptr)
+                    return ErrorToken;
+                _tokenBegin = _p + 1;
+                _tokenEnd = close;
+                _p = close + 1;
+                return FlagToken;
+            } else if (c == '[' || c == '!') {
+                // Indices and comments
+                const char *close = static_cast<const char*>(memchr(_p, c == '[' ? ']' : '\n', _end - _p));
+                _p = close ? close + 1 : _end;
+            } else {
+                const char *begin = _p;
+                while (_p < _end && !isSpace(*_p) && *_p != '"' && *_p != '[')
+                    ++_p;
+                if (isDigit(c) || c == '-' || c == '+' || c == '.') {
+                    _tokenBegin = begin;
+                    _tokenEnd = _p;
+                    return NumberToken;
+                }
+            }
+        }
+        return EndToken;
+    }
+
+private:
+    const char *_p;
+    const char *_end;
+    const char *_tokenBegin;
+    const char *_tokenEnd;
+    bool _escaped;
+};
+
+static bool readTextGrid(const char *begin, const char *end, ImportedTiers *tiers, QString *errorString)
+{
+    TextGridTokenizer tokens(begin, end);
+
+    QString text;
+    double xmin, xmax, count;
+    bool exists;
+    if (!tokens.string(&text) || text != "ooTextFile" || !tokens.string(&text) || text != "TextGrid")
+        return fail(errorString, "Not a text TextGrid file");
+    if (!tokens.number(&xmin) || !tokens.number(&xmax) || !tokens.flag(&exists))
+        return fail(errorString, "Broken TextGrid header");
+    if (!exists)
+        return true;
+    if (!tokens.number(&count) || count < 0 || count > end - begin)
+        return fail(errorString, "Broken TextGrid header");
+
+    tiers->resize(count);
+    for (ImportedTier &tier : *tiers) {
+        tier.type = AnnotationTier::IntervalTier;
+        QString type;
+        if (!tokens.string(&type) || !tokens.string(&tier.name)
+                || !tokens.number(&xmin) || !tokens.number(&xmax) || !tokens.number(&count)
+                || count < 0 || count > end - begin)
+            return fail(errorString, QString("Broken header of tier %1").arg(tier.name));
+
+        // Empty intervals only fill the gaps of Praat partitions, they are dropped
+        Annotation annotation { 0, 0.0, 0.0, QString() };
+        if (type == "IntervalTier") {
+            tier.type = AnnotationTier::IntervalTier;
+            tier.annotations.reserve(count);
+            for (int i = 0; i < count; ++i) {
+                if (!tokens.number(&annotation.begin) || !tokens.number(&annotation.end) || !tokens.string(&annotation.label))
+                    return fail(errorString, QString("Broken interval %1 of tier %2").arg(i + 1).arg(tier.name));
+                if (!annotation.label.isEmpty())
+                    tier.annotations.append(annotation);
+            }
+        } else if (type == "TextTier") {
+            tier.type = AnnotationTier::PointTier;
+            tier.annotations.reserve(count);
+            for (int i = 0; i < count; ++i) {
+                if (!tokens.number(&annotation.begin) || !tokens.string(&annotation.label))
+                    return fail(errorString, QString("Broken point %1 of tier %2").arg(i + 1).arg(tier.name));
+                annotation.end = annotation.begin;
+                tier.annotations.append(annotation);
+            }
+        } else {
+            return fail(errorString, QString("Unknown tier class %1").arg(type));
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// CSV/TSV
+//-----------------------------------------------------------------------------
+
+struct CsvField
+{
+    const char *begin;
+    const char *end;
+    bool escaped;
+
+    QString toString() const { return decodeQuoted(begin, end, escaped); }
+};
+
+// RFC 4180 records, quoted fields may contain separators and line breaks
+class CsvReader
+{
+public:
+    CsvReader(const char *begin, const char *end, char separator)
+        : _p(begin)
+        , _end(end)
+        , _separator(separator)
+        , _line(0)
+    {
+    }
+
+    bool atEnd() const { return _p >= _end; }
+    int line() const { return _line; }
+
+    bool read(QVector<CsvField> *fields)
+    {
+        fields->clear();
+        ++_line;
+
+        for (;;) {
+            CsvField field { _p, _p, false };
+            if (_p < _end && *_p == '"') {
+                const char *close = findClosingQuote(_p + 1, _end, &field.escaped);
+                if (close == nullptr)
+                    return false;
+                field.begin = _p + 1;
+                field.end = close;
+                _p = close + 1;
+                while (_p < _end && *_p != _separator && *_p != '\n' && *_p != '\r')
+                    ++_p;
+            } else {
+                while (_p < _end && *_p != _separator && *_p != '\n' && *_p != '\r')
+                    ++_p;
+                field.end = _p;
+            }
+            fields->append(field);
+
+            if (_p < _end && *_p == _separator) {
+                ++_p;
+                continue;
+            }
+
+            if (_p < _end && *_p == '\r')
+                ++_p;
+            if (_p < _end && *_p == '\n')
+                ++_p;
+            return true;
+        }
+    }
+
+private:
+    const char *_p;
+    const char *_end;
+    char _separator;
+    int _line;
+};
+
+static bool readCsv(const char *begin, const char *end, char separator, const QString &defaultTier,
+                    ImportedTiers *tiers, QString *errorString)
+{
+    CsvReader reader(begin, end, separator);
+    QVector<CsvField> fields;
+
+    // Columns are tier, begin, end, label by default, or begin, end, label
+    // with a single tier. A header row may name them in any order.
+    int tierColumn = -1;
+    int beginColumn = -1;
+    int endColumn = -1;
+    int labelColumn = -1;
+
+    QHash<QString, int> tierIndex;
+    QVector<bool> onlyPoints;
+    QByteArray lastName;
+    int lastTier = -1;
+
+    while (!reader.atEnd()) {
+        if (!reader.read(&fields))
+            return fail(errorString, QString("Unterminated quote at line %1").arg(reader.line()));
+        if (fields.size() == 1 && fields[0].begin == fields[0].end)
+            continue;
+
+        if (beginColumn < 0) {
+            for (int i = 0; i < fields.size(); ++i) {
+                const QString name = fields[i].toString().trimmed().toLower();
+                if (name == "tier")
+                    tierColumn = i;
+                else if (name == "begin" || name == "start" || name == "tmin")
+                    beginColumn = i;
+                else if (name == "end" || name == "stop" || name == "tmax")
+                    endColumn = i;
+                else if (name == "label" || name == "text" || name == "annotation")
+                    labelColumn = i;
+            }
+
+            if (beginColumn >= 0 && endColumn >= 0)
+                continue;
+
+            tierColumn = fields.size() > 3 ? 0 : -1;
+            beginColumn = tierColumn + 1;
+            endColumn = tierColumn + 2;
+            labelColumn = tierColumn + 3;
+        }
+
+        Annotation annotation { 0, 0.0, 0.0, QString() };
+        if (fields.size() <= qMax(beginColumn, endColumn)
+                || !parseNumber(fields[beginColumn].begin, fields[beginColumn].end, &annotation.begin)
+                || !parseNumber(fields[endColumn].begin, fields[endColumn].end, &annotation.end))
+            return fail(errorString, QString("Broken times at line %1").arg(reader.line()));
+        if (labelColumn >= 0 && labelColumn < fields.size())
+            annotation.label = fields[labelColumn].toString();
+
+        // Rows usually come grouped by tier, so names are compared in place
+        const bool hasTier = tierColumn >= 0 && tierColumn < fields.size();
+        const CsvField name = hasTier ? fields[tierColumn] : CsvField { begin, begin, false };
+        const QByteArray rawName = QByteArray::fromRawData(name.begin, name.end - name.begin);
+        if (lastTier < 0 || name.escaped || rawName != lastName) {
+            const QString tierName = hasTier ? name.toString() : defaultTier;
+            lastTier = tierIndex.value(tierName, -1);
+            if (lastTier < 0) {
+                lastTier = tiers->size();
+                tierIndex.insert(tierName, lastTier);
+                tiers->append(ImportedTier { tierName, AnnotationTier::IntervalTier, QVector<Annotation>() });
+                onlyPoints.append(true);
+            }
+            lastName = rawName;
+        }
+
+        (*tiers)[lastTier].annotations.append(annotation);
+        onlyPoints[lastTier] = onlyPoints[lastTier] && annotation.begin == annotation.end;
+    }
+
+    // There is no tier type column, tiers of zero length rows are point tiers
+    for (int i = 0; i < tiers->size(); ++i) {
+        if (onlyPoints[i])
+            (*tiers)[i].type = AnnotationTier::PointTier;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// ELAN EAF
+//-----------------------------------------------------------------------------
+
+// Maps ids like "ts42" to dense indices without hashing strings, anything
+// else falls back to a hash
+class IdIndex
+{
+public:
+    explicit IdIndex(const char *prefix)
+        : _prefix(prefix)
+        , _count(0)
+    {
+    }
+
+    int count() const { return _count; }
+
+    int insert(const QStringRef &id)
+    {
+        const int number = parse(id);
+        if (number >= 0) {
+            if (number >= _numbered.size())
+                _numbered.resize(qMax(number + 1, _numbered.size() * 2));
+            _numbered[number] = _count + 1;
+        } else {
+            _others.insert(id.toString(), _count);
+        }
+        return _count++;
+    }
+
+    int find(const QStringRef &id) const
+    {
+        const int number = parse(id);
+        if (number >= 0)
+            return number < _numbered.size() ? _numbered[number] - 1 : -1;
+        return _others.value(id.toString(), -1);
+    }
+
+private:
+    int parse(const QStringRef &id) const
+    {
+        if (!id.startsWith(_prefix) || id.size() == _prefix.size() || id.size() > _prefix.size() + 8)
+            return -1;
+
+        int result = 0;
+        for (int i = _prefix.size(); i < id.size(); ++i) {
+            const ushort c = id.at(i).unicode();
+            if (c < '0' || c > '9')
+                return -1;
+            result = result * 10 + (c - '0');
+        }
+        return result < MaxNumberedId ? result : -1;
+    }
+
+private:
+    QLatin1String _prefix;
+    QVector<int> _numbered;     // number -> index + 1
+    QHash<QString, int> _others;
+    int _count;
+};
+
+// Unaligned slots get times interpolated between their aligned neighbours
+static void interpolateSlots(QVector<double> *times)
+{
+    const int count = times->size();
+    int previous = -1;
+    for (int i = 0; i <= count; ++i) {
+        if (i < count && std::isnan((*times)[i]))
+            continue;
+
+        const double from = previous >= 0 ? (*times)[previous] : (i < count ? (*times)[i] : 0.0);
+        const double to = i < count ? (*times)[i] : from;
+        for (int j = previous + 1; j < i; ++j)
+            (*times)[j] = from + (to - from) * (j - previous) / (i - previous);
+        previous = i;
+    }
+}
+
+static QString readAnnotationValue(QXmlStreamReader &xml)
+{
+    while (xml.readNextStartElement()) {
+        if (xml.name() == QLatin1String("ANNOTATION_VALUE"))
+            return xml.readElementText();
+        xml.skipCurrentElement();
+    }
+    return QString();
+}
+
+static bool readEaf(QIODevice *device, ImportedTiers *tiers, QString *errorString)
+{
+    QXmlStreamReader xml(device);
+
+    IdIndex slotIds("ts");
+    IdIndex annotationIds("a");
+    QVector<double> slotTimes;
+    QVector<QPair<double, double>> annotationTimes;
+    bool slotsReady = false;
+    double unit = 0.001;
+
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement)
+            continue;
+
+        const QStringRef name = xml.name();
+        const QXmlStreamAttributes attributes = xml.attributes();
+
+        if (name == QLatin1String("HEADER")) {
+            const QStringRef units = attributes.value("TIME_UNITS");
+            if (!units.isEmpty() && units != QLatin1String("milliseconds"))
+                return fail(errorString, QString("Unsupported time units %1").arg(units.toString()));
+        } else if (name == QLatin1String("TIME_SLOT")) {
+            slotIds.insert(attributes.value("TIME_SLOT_ID"));
+            const QStringRef value = attributes.value("TIME_VALUE");
+            slotTimes.append(value.isEmpty() ? std::numeric_limits<double>::quiet_NaN() : value.toDouble() * unit);
+        } else if (name == QLatin1String("TIER")) {
+            if (!slotsReady) {
+                interpolateSlots(&slotTimes);
+                slotsReady = true;
+            }
+            tiers->append(ImportedTier { attributes.value("TIER_ID").toString(),
+                                         AnnotationTier::IntervalTier, QVector<Annotation>() });
+        } else if (name == QLatin1String("ALIGNABLE_ANNOTATION") || name == QLatin1String("REF_ANNOTATION")) {
+            if (tiers->isEmpty())
+                return fail(errorString, QString("Annotation outside of a tier at line %1").arg(xml.lineNumber()));
+
+            QPair<double, double> times;
+            if (name == QLatin1String("ALIGNABLE_ANNOTATION")) {
+                const int begin = slotIds.find(attributes.value("TIME_SLOT_REF1"));
+                const int end = slotIds.find(attributes.value("TIME_SLOT_REF2"));
+                if (begin < 0 || end < 0)
+                    return fail(errorString, QString("Unknown time slot at line %1").arg(xml.lineNumber()));
+                times = qMakePair(slotTimes[begin], slotTimes[end]);
+            } else {
+                // Referring annotations take the times of their parents
+                const int parent = annotationIds.find(attributes.value("ANNOTATION_REF"));
+                if (parent < 0)
+                    return fail(errorString, QString("Unknown annotation reference at line %1").arg(xml.lineNumber()));
+                times = annotationTimes[parent];
+            }
+
+            annotationIds.insert(attributes.value("ANNOTATION_ID"));
+            annotationTimes.append(times);
+            tiers->last().annotations.append(Annotation { 0, times.first, times.second, readAnnotationValue(xml) });
+        }
+    }
+
+    if (xml.hasError())
+        return fail(errorString, QString("%1 at line %2").arg(xml.errorString()).arg(xml.lineNumber()));
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Writers
+//-----------------------------------------------------------------------------
+
+// Collects small pieces into large writes
+class OutputBuffer
+{
+public:
+    explicit OutputBuffer(QIODevice *device)
+        : _device(device)
+        , _ok(true)
+    {
+        _buffer.reserve(OutputBufferSize + 4096);
+    }
+
+    OutputBuffer &operator<<(const char *text)
+    {
+        _buffer.append(text);
+        return check();
+    }
+
+    OutputBuffer &operator<<(const QByteArray &text)
+    {
+        _buffer.append(text);
+        return check();
+    }
+
+    OutputBuffer &operator<<(int value)
+    {
+        _buffer.append(QByteArray::number(value));
+        return check();
+    }
+
+    // Times are written with microsecond precision
+    OutputBuffer &operator<<(double value)
+    {
+        QByteArray text = QByteArray::number(value, 'f', 6);
+        int length = text.size();
+        while (text[length - 1] == '0')
+            --length;
+        if (text[length - 1] == '.')
+            --length;
+        text.truncate(length);
+        return *this << text;
+    }
+
+    bool flush()
+    {
+        _ok = _ok && _device->write(_buffer) == _buffer.size();
+        _buffer.clear();
+        return _ok;
+    }
+
+private:
+    OutputBuffer &check()
+    {
+        if (_buffer.size() >= OutputBufferSize)
+            flush();
+        return *this;
+    }
+
+private:
+    QIODevice *_device;
+    QByteArray _buffer;
+    bool _ok;
+};
+
+static QByteArray quoted(const QString &text)
+{
+    QByteArray result = text.toUtf8();
+    result.replace("\"", "\"\"");
+    return result.prepend('"').append('"');
+}
+
+static QByteArray csvField(const QString &text, char separator)
+{
+    const QByteArray result = text.toUtf8();
+    if (result.contains(separator) || result.contains('"') || result.contains('\n') || result.contains('\r'))
+        return quoted(text);
+    return result;
+}
+
+// TextGrid interval tiers are partitions: gaps become empty intervals and
+// overlapping annotations are clipped by the previous ones
+template<typename Function>
+static int forEachTextGridInterval(const AnnotationTier &tier, double xmax, Function function)
+{
+    int count = 0;
+    double position = 0.0;
+    for (const Annotation &annotation : tier.annotations()) {
+        const double begin = qMax(annotation.begin, position);
+        if (annotation.end <= begin)
+            continue;
+        if (begin > position) {
+            function(position, begin, nullptr);
+            ++count;
+        }
+        function(begin, annotation.end, &annotation.label);
+        ++count;
+        position = annotation.end;
+    }
+
+    if (position < xmax) {
+        function(position, xmax, nullptr);
+        ++count;
+    }
+    return count;
+}
+
+static bool writeTextGrid(QIODevice *device, const Annotations &annotations, double xmax)
+{
+    OutputBuffer out(device);
+    out << "File type = \"ooTextFile\"\nObject class = \"TextGrid\"\n\n"
+        << "xmin = 0 \nxmax = " << xmax << " \ntiers? <exists> \nsize = " << annotations.tierCount() << " \nitem []: \n";
+
+    for (int t = 0; t < annotations.tierCount(); ++t) {
+        const AnnotationTier &tier = annotations.tier(t);
+        const bool isPointTier = tier.type() == AnnotationTier::PointTier;
+
+        out << "    item [" << t + 1 << "]:\n"
+            << "        class = \"" << (isPointTier ? "TextTier" : "IntervalTier") << "\" \n"
+            << "        name = " << quoted(tier.name()) << " \n"
+            << "        xmin = 0 \n        xmax = " << xmax << " \n";
+
+        if (isPointTier) {
+            out << "        points: size = " << tier.size() << " \n";
+            for (int i = 0; i < tier.size(); ++i) {
+                const Annotation &annotation = tier.at(i);
+                out << "        points [" << i + 1 << "]:\n"
+                    << "            number = " << annotation.begin << " \n"
+                    << "            mark = " << quoted(annotation.label) << " \n";
+            }
+        } else {
+            const int count = forEachTextGridInterval(tier, xmax, [] (double, double, const QString*) {});
+            out << "        intervals: size = " << count << " \n";
+
+            int index = 0;
+            forEachTextGridInterval(tier, xmax, [&] (double begin, double end, const QString *label) {
+                out << "        intervals [" << ++index << "]:\n"
+                    << "            xmin = " << begin << " \n"
+                    << "            xmax = " << end << " \n"
+                    << "            text = " << (label ? quoted(*label) : QByteArray("\"\"")) << " \n";
+            });
+        }
+    }
+
+    return out.flush();
+}
+
+static bool writeCsv(QIODevice *device, const Annotations &annotations, char separator)
+{
+    OutputBuffer out(device);
+    const char separatorText[] = { separator, 0 };
+
+    out << "tier" << separatorText << "begin" << separatorText << "end" << separatorText << "label\n";
+    for (const AnnotationTier &tier : annotations.tiers()) {
+        const QByteArray name = csvField(tier.name(), separator);
+        for (const Annotation &annotation : tier.annotations()) {
+            out << name << separatorText << annotation.begin << separatorText << annotation.end
+                << separatorText << csvField(annotation.label, separator) << "\n";
+        }
+    }
+
+    return out.flush();
+}
+
+static bool writeEaf(QIODevice *device, const Annotations &annotations, const QString &mediaFileName)
+{
+    // Time slots are shared by the whole document and ordered by time
+    QVector<QPair<double, int>> times;
+    for (const AnnotationTier &tier : annotations.tiers()) {
+        for (const Annotation &annotation : tier.annotations()) {
+            times.append(qMakePair(annotation.begin, times.size()));
+            times.append(qMakePair(annotation.end, times.size()));
+        }
+    }
+    std::stable_sort(times.begin(), times.end());
+
+    QVector<int> slotOf(times.size());
+    for (int i = 0; i < times.size(); ++i)
+        slotOf[times[i].second] = i + 1;
+
+    QXmlStreamWriter xml(device);
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeStartElement("ANNOTATION_DOCUMENT");
+    xml.writeAttribute("AUTHOR", "");
+    xml.writeAttribute("DATE", QDateTime::currentDateTime().toString(Qt::ISODate));
+    xml.writeAttribute("FORMAT", "3.0");
+    xml.writeAttribute("VERSION", "3.0");
+    xml.writeAttribute("xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance");
+    xml.writeAttribute("xsi:noNamespaceSchemaLocation", "http://www.mpi.nl/tools/elan/EAFv3.0.xsd");
+
+    xml.writeStartElement("HEADER");
+    xml.writeAttribute("MEDIA_FILE", "");
+    xml.writeAttribute("TIME_UNITS", "milliseconds");
+    if (!mediaFileName.isEmpty()) {
+        xml.writeEmptyElement("MEDIA_DESCRIPTOR");
+        xml.writeAttribute("MEDIA_URL", QUrl::fromLocalFile(QFileInfo(mediaFileName).absoluteFilePath()).toString());
+        xml.writeAttribute("MIME_TYPE", "audio/x-wav");
+        xml.writeAttribute("RELATIVE_MEDIA_URL", "./" + QFileInfo(mediaFileName).fileName());
+    }
+    xml.writeEndElement();
+
+    xml.writeStartElement("TIME_ORDER");
+    for (int i = 0; i < times.size(); ++i) {
+        xml.writeEmptyElement("TIME_SLOT");
+        xml.writeAttribute("TIME_SLOT_ID", QString("ts%1").arg(i + 1));
+        xml.writeAttribute("TIME_VALUE", QString::number(qRound64(times[i].first * 1000.0)));
+    }
+    xml.writeEndElement();
+
+    // Points have no counterpart in ELAN, they become zero length annotations
+    int ordinal = 0;
+    for (const AnnotationTier &tier : annotations.tiers()) {
+        xml.writeStartElement("TIER");
+        xml.writeAttribute("LINGUISTIC_TYPE_REF", DefaultLinguisticType);
+        xml.writeAttribute("TIER_ID", tier.name());
+        for (const Annotation &annotation : tier.annotations()) {
+            xml.writeStartElement("ANNOTATION");
+            xml.writeStartElement("ALIGNABLE_ANNOTATION");
+            xml.writeAttribute("ANNOTATION_ID", QString("a%1").arg(ordinal / 2 + 1));
+            xml.writeAttribute("TIME_SLOT_REF1", QString("ts%1").arg(slotOf[ordinal++]));
+            xml.writeAttribute("TIME_SLOT_REF2", QString("ts%1").arg(slotOf[ordinal++]));
+            xml.writeTextElement("ANNOTATION_VALUE", annotation.label);
+            xml.writeEndElement();
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+    }
+
+    xml.writeEmptyElement("LINGUISTIC_TYPE");
+    xml.writeAttribute("GRAPHIC_REFERENCES", "false");
+    xml.writeAttribute("LINGUISTIC_TYPE_ID", DefaultLinguisticType);
+    xml.writeAttribute("TIME_ALIGNABLE", "true");
+
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    return !xml.hasError();
+}
+
+//-----------------------------------------------------------------------------
+// Public functions
+//-----------------------------------------------------------------------------
+
+AnnotationFormat annotationFormat(const QString &name)
+{
+    const QString suffix = name.contains('.') ? QFileInfo(name).suffix().toLower() : name.toLower();
+    if (suffix == "textgrid")
+        return TextGridFormat;
+    if (suffix == "eaf")
+        return EafFormat;
+    if (suffix == "csv")
+        return CsvFormat;
+    if (suffix == "tsv")
+        return TsvFormat;
+    return UnknownFormat;
+}
+
+QString annotationFormatExtension(AnnotationFormat format)
+{
+    switch (format) {
+    case TextGridFormat:
+        return "TextGrid";
+    case EafFormat:
+        return "eaf";
+    case CsvFormat:
+        return "csv";
+    case TsvFormat:
+        return "tsv";
+    case UnknownFormat:
+        break;
+    }
+    return QString();
+}
+
+bool importAnnotations(const QString &fileName, Annotations *annotations, QString *errorString)
+{
+    const AnnotationFormat format = annotationFormat(fileName);
+    if (format == UnknownFormat)
+        return fail(errorString, QString("Unknown annotation format of %1").arg(fileName));
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(errorString, file.errorString());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ImportedTiers tiers;
+    bool result;
+    if (format == EafFormat) {
+        result = readEaf(&file, &tiers, errorString);
+    } else {
+        QByteArray buffer;
+        const qint64 size = file.size();
+        const char *begin = size > 0 ? reinterpret_cast<const char*>(file.map(0, size)) : nullptr;
+        if (begin == nullptr) {
+            buffer = file.readAll();
+            begin = buffer.constData();
+        }
+        const char *end = begin + (buffer.isNull() ? size : buffer.size());
+
+        // Praat saves non-ASCII TextGrids as UTF-16, those are converted once
+        const QByteArray head = QByteArray::fromRawData(begin, qMin<qint64>(end - begin, 3));
+        if (head.startsWith("\xFE\xFF") || head.startsWith("\xFF\xFE")) {
+            const char *codec = head.startsWith("\xFE\xFF") ? "UTF-16BE" : "UTF-16LE";
+            buffer = QTextCodec::codecForName(codec)->toUnicode(begin + 2, end - begin - 2).toUtf8();
+            begin = buffer.constData();
+            end = begin + buffer.size();
+        } else if (head.startsWith("\xEF\xBB\xBF")) {
+            begin += 3;
+        }
+
+        result = format == TextGridFormat
+                ? readTextGrid(begin, end, &tiers, errorString)
+                : readCsv(begin, end, format == TsvFormat ? '\t' : ',',
+                          QFileInfo(fileName).completeBaseName(), &tiers, errorString);
+    }
+
+    if (!result)
+        return false;
+
+    int count = 0;
+    for (const ImportedTier &tier : tiers) {
+        annotations->addTier(tier.name, tier.type, tier.annotations);
+        count += tier.annotations.size();
+    }
+
+    qCDebug(logAnnotations) << "importAnnotations" << fileName << "tiers" << tiers.size()
+                            << "annotations" << count << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool exportAnnotations(const QString &fileName, const Annotations &annotations, double duration,
+                       const QString &mediaFileName, QString *errorString)
+{
+    const AnnotationFormat format = annotationFormat(fileName);
+    if (format == UnknownFormat)
+        return fail(errorString, QString("Unknown annotation format of %1").arg(fileName));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return fail(errorString, file.errorString());
+
+    double xmax = duration;
+    for (const AnnotationTier &tier : annotations.tiers()) {
+        for (const Annotation &annotation : tier.annotations())
+            xmax = qMax(xmax, annotation.end);
+    }
+
+    bool result = false;
+    switch (format) {
+    case TextGridFormat:
+        result = writeTextGrid(&file, annotations, xmax);
+        break;
+    case EafFormat:
+        result = writeEaf(&file, annotations, mediaFileName);
+        break;
+    case CsvFormat:
+    case TsvFormat:
+        result = writeCsv(&file, annotations, format == TsvFormat ? '\t' : ',');
+        break;
+    case UnknownFormat:
+        break;
+    }
+
+    if (!result || !file.commit())
+        return fail(errorString, file.errorString());
+    return true;
+}
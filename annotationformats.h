@@ -0,0 +1,37 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef ANNOTATIONFORMATS_H
+#define ANNOTATIONFORMATS_H
+
+#include <QString>
+
+class Annotations;
+
+enum AnnotationFormat
+{
+    UnknownFormat,
+    TextGridFormat,
+    EafFormat,
+    CsvFormat,
+    TsvFormat
+};
+
+// Accepts format names ("textgrid", "eaf", "csv", "tsv") and file names
+AnnotationFormat annotationFormat(const QString &name);
+QString annotationFormatExtension(AnnotationFormat format);
+
+// Appends the tiers of a Praat TextGrid (text formats), ELAN EAF or CSV/TSV
+// file, nothing is appended if the file is broken. TextGrid and CSV files are
+// parsed in place from a memory map, EAF files are read as a stream.
+bool importAnnotations(const QString &fileName, Annotations *annotations,
+                       QString *errorString = nullptr);
+
+// Tiers are written as they are streamed, duration is the length of the
+// audio file (tiers are extended to the last annotation if it is longer)
+bool exportAnnotations(const QString &fileName, const Annotations &annotations, double duration,
+                       const QString &mediaFileName = QString(), QString *errorString = nullptr);
+
+#endif // ANNOTATIONFORMATS_H
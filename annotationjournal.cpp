@@ -0,0 +1,530 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "annotationjournal.h"
+#include "trace.h"
+
+#include <QDataStream>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+const int FlushIntervalMs = 500;
+const int CompactionRecords = 20000;
+
+// Record header: payload length and its checksum
+const int RecordHeaderSize = sizeof(quint32) + sizeof(quint16);
+
+const quint32 SnapshotMagic = 0x53414141; // "AAAS"
+const quint32 SnapshotVersion = 1;
+
+static bool syncFile(QFile &file)
+{
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+static void setupStream(QDataStream &stream)
+{
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setVersion(QDataStream::Qt_5_0);
+}
+
+AnnotationJournal::AnnotationJournal(Annotations *annotations, QObject *parent)
+    :   QObject(parent)
+    ,   _annotations(annotations)
+    ,   _sequence(0)
+    ,   _records(0)
+    ,   _replaying(false)
+    ,   _compacting(false)
+    ,   _compactionRecords(0)
+{
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(FlushIntervalMs);
+
+    connect(&_flushTimer, &QTimer::timeout, this, &AnnotationJournal::flushTimeout);
+    connect(&_compaction, &QFutureWatcher<bool>::finished, this, &AnnotationJournal::compactionFinished);
+
+    connect(_annotations, &Annotations::tierAdded, this, &AnnotationJournal::tierAdded);
+    connect(_annotations, &Annotations::tierImported, this, &AnnotationJournal::tierImported);
+    connect(_annotations, &Annotations::added, this, &AnnotationJournal::added);
+    connect(_annotations, &Annotations::removed, this, &AnnotationJournal::removed);
+    connect(_annotations, &Annotations::moved, this, &AnnotationJournal::moved);
+    connect(_annotations, &Annotations::labelChanged, this, &AnnotationJournal::labelChanged);
+    connect(_annotations, &Annotations::cleared, this, &AnnotationJournal::cleared);
+}
+
+AnnotationJournal::~AnnotationJournal()
+{
+    close();
+}
+
+// Reads the annotations of fileName into the (empty) model, files are left
+// untouched
+bool AnnotationJournal::load(const QString &fileName)
+{
+    Q_ASSERT(!isOpen());
+    return recover(fileName, false);
+}
+
+// Loads the annotations of fileName into the (empty) model and starts
+// recording its edits
+bool AnnotationJournal::open(const QString &fileName)
+{
+    close();
+
+    if (!recover(fileName, true))
+        return false;
+
+    _journal.setFileName(journalPath(fileName));
+    if (!_journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(logAnnotations) << "AnnotationJournal::open" << _journal.fileName() << _journal.errorString();
+        return false;
+    }
+
+    _fileName = fileName;
+    qCDebug(logAnnotations) << "AnnotationJournal::open" << fileName
+                            << "sequence" << _sequence << "replayed" << _records;
+
+    if (_records >= CompactionRecords)
+        compact();
+    return true;
+}
+
+void AnnotationJournal::close()
+{
+    if (!isOpen())
+        return;
+
+    _compaction.waitForFinished();
+    compactionFinished();
+    flush();
+
+    // Leave a fresh snapshot behind, so the next open has nothing to replay
+    if (_records > 0 && writeSnapshot(snapshotPath(_fileName), _annotations->tiers(), _sequence))
+        _journal.resize(0);
+
+    _journal.close();
+    _pending.clear();
+    _fileName.clear();
+    _sequence = 0;
+    _records = 0;
+}
+
+QString AnnotationJournal::snapshotPath(const QString &fileName)
+{
+    return fileName + ".annotations";
+}
+
+QString AnnotationJournal::journalPath(const QString &fileName)
+{
+    return fileName + ".annotations.journal";
+}
+
+bool AnnotationJournal::readSnapshot(const QString &path, Annotations *annotations, quint64 *sequence)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    setupStream(stream);
+
+    quint32 magic, version;
+    qint32 tierCount;
+    stream >> magic >> version >> *sequence >> tierCount;
+    if (stream.status() != QDataStream::Ok || magic != SnapshotMagic || version != SnapshotVersion || tierCount < 0)
+        return false;
+
+    for (int t = 0; t < tierCount; ++t) {
+        QString name;
+        quint8 type;
+        qint32 count;
+        stream >> name >> type >> count;
+        if (stream.status() != QDataStream::Ok || type > AnnotationTier::PointTier || count < 0)
+            return false;
+
+        // Id, begin, end and the label length at least
+        if (count > (file.size() - file.pos()) / 28)
+            return false;
+
+        QVector<Annotation> tier(count);
+        for (Annotation &annotation : tier)
+            stream >> annotation.id >> annotation.begin >> annotation.end >> annotation.label;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+
+        annotations->addTier(name, static_cast<AnnotationTier::Type>(type), tier);
+    }
+
+    return true;
+}
+
+bool AnnotationJournal::writeSnapshot(const QString &path, const QVector<AnnotationTier> &tiers, quint64 sequence)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    setupStream(stream);
+
+    stream << SnapshotMagic << SnapshotVersion << sequence << qint32(tiers.size());
+    for (const AnnotationTier &tier : tiers) {
+        stream << tier.name() << quint8(tier.type()) << qint32(tier.size());
+        for (const Annotation &annotation : tier.annotations())
+            stream << annotation.id << annotation.begin << annotation.end << annotation.label;
+    }
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+//-----------------------------------------------------------------------------
+// Public slots
+//-----------------------------------------------------------------------------
+
+// While the journal is compacted, or could not be reopened after that,
+// records stay pending
+void AnnotationJournal::flush()
+{
+    _flushTimer.stop();
+    if (_pending.isEmpty() || !isOpen() || _compacting)
+        return;
+
+    if (!_journal.isOpen() && !_journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(logAnnotations) << "AnnotationJournal::flush" << _journal.fileName()
+                                  << _journal.errorString();
+        return;
+    }
+
+    if (_journal.write(_pending) != _pending.size() || !_journal.flush() || !syncFile(_journal)) {
+        qCWarning(logAnnotations) << "AnnotationJournal::flush" << _journal.fileName()
+                                  << _journal.errorString();
+    }
+    _pending.clear();
+}
+
+// Writes the current state into a new snapshot on a worker thread, which
+// then cuts the journal. The journal is closed meanwhile, so the job is the
+// only one touching it and all syncing happens there.
+void AnnotationJournal::compact()
+{
+    if (!_journal.isOpen() || _compacting)
+        return;
+
+    flush();
+    _journal.close();
+    _compacting = true;
+    _compactionRecords = _records;
+
+    const QString snapshot = snapshotPath(_fileName);
+    const QString journal = _journal.fileName();
+    const QVector<AnnotationTier> tiers = _annotations->tiers();
+    const quint64 sequence = _sequence;
+    _compaction.setFuture(QtConcurrent::run([snapshot, journal, tiers, sequence] () {
+        if (!writeSnapshot(snapshot, tiers, sequence))
+            return false;
+
+        // Every record in the journal is in the snapshot now. Should cutting
+        // fail, the replay skips them.
+        QFile file(journal);
+        return file.open(QIODevice::WriteOnly | QIODevice::Append) && file.resize(0) && syncFile(file);
+    }));
+}
+
+// Bulk changes are not journaled record by record, a snapshot is written
+// right away instead
+void AnnotationJournal::checkpoint()
+{
+    if (!isRecording())
+        return;
+
+    _compaction.waitForFinished();
+    compactionFinished();
+    flush();
+
+    if (!writeSnapshot(snapshotPath(_fileName), _annotations->tiers(), _sequence)) {
+        qCWarning(logAnnotations) << "AnnotationJournal::checkpoint" << "failed to write" << snapshotPath(_fileName);
+        return;
+    }
+
+    _journal.resize(0);
+    _pending.clear();
+    _records = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Private slots
+//-----------------------------------------------------------------------------
+
+void AnnotationJournal::flushTimeout()
+{
+    flush();
+    if (_records >= CompactionRecords)
+        compact();
+}
+
+void AnnotationJournal::compactionFinished()
+{
+    if (!_compacting)
+        return;
+
+    _compacting = false;
+    if (_compaction.result())
+        _records -= _compactionRecords;
+    else
+        qCWarning(logAnnotations) << "AnnotationJournal::compact" << "failed to compact" << _journal.fileName();
+
+    // Without the journal, edits stay pending and the next flush tries again
+    if (!_journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(logAnnotations) << "AnnotationJournal::compact" << _journal.fileName() << _journal.errorString();
+        emit errorMessage(tr("Could not reopen the annotation journal"),
+                          _journal.fileName() + ": " + _journal.errorString());
+        return;
+    }
+
+    if (!_pending.isEmpty() && !_flushTimer.isActive())
+        _flushTimer.start();
+
+    qCDebug(logAnnotations) << "AnnotationJournal::compact" << _fileName
+                            << "sequence" << _sequence << "records left" << _records;
+}
+
+void AnnotationJournal::tierAdded(int tier)
+{
+    if (!isRecording())
+        return;
+
+    const AnnotationTier &target = _annotations->tier(tier);
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    beginRecord(stream, AddTier, tier);
+    stream << target.name() << quint8(target.type());
+    append(payload);
+}
+
+void AnnotationJournal::tierImported(int /*tier*/)
+{
+    checkpoint();
+}
+
+void AnnotationJournal::added(int tier, const Annotation &annotation)
+{
+    if (!isRecording())
+        return;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    beginRecord(stream, AddAnnotation, tier);
+    stream << annotation.id << annotation.begin << annotation.end << annotation.label;
+    append(payload);
+}
+
+void AnnotationJournal::removed(int tier, quint64 id)
+{
+    if (!isRecording())
+        return;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    beginRecord(stream, RemoveAnnotation, tier);
+    stream << id;
+    append(payload);
+}
+
+void AnnotationJournal::moved(int tier, quint64 id, double begin, double end)
+{
+    if (!isRecording())
+        return;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    beginRecord(stream, MoveAnnotation, tier);
+    stream << id << begin << end;
+    append(payload);
+}
+
+void AnnotationJournal::labelChanged(int tier, quint64 id, const QString &label)
+{
+    if (!isRecording())
+        return;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    beginRecord(stream, SetLabel, tier);
+    stream << id << label;
+    append(payload);
+}
+
+void AnnotationJournal::cleared()
+{
+    if (!isRecording())
+        return;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    beginRecord(stream, Clear, -1);
+    append(payload);
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+bool AnnotationJournal::recover(const QString &fileName, bool repair)
+{
+    const QString snapshot = snapshotPath(fileName);
+    const QString journal = journalPath(fileName);
+
+    _sequence = 0;
+    _records = 0;
+    _replaying = true;
+
+    quint64 snapshotSequence = 0;
+    if (QFile::exists(snapshot) && !readSnapshot(snapshot, _annotations, &snapshotSequence)) {
+        // Keep the broken files for a manual recovery instead of overwriting them
+        qCWarning(logAnnotations) << "AnnotationJournal::recover" << "broken snapshot" << snapshot;
+        _replaying = false;
+        _annotations->clear();
+        return false;
+    }
+    _sequence = snapshotSequence;
+
+    QFile reader(journal);
+    if (reader.open(QIODevice::ReadOnly)) {
+        const QByteArray data = reader.readAll();
+        reader.close();
+
+        const qint64 valid = replay(data, snapshotSequence);
+        if (valid < data.size()) {
+            qCWarning(logAnnotations) << "AnnotationJournal::recover" << "torn journal tail"
+                                      << journal << data.size() - valid << "bytes";
+            if (repair)
+                QFile::resize(journal, valid);
+        }
+    }
+
+    _replaying = false;
+    return true;
+}
+
+void AnnotationJournal::beginRecord(QDataStream &stream, Operation operation, int tier)
+{
+    setupStream(stream);
+    stream << ++_sequence << quint8(operation) << qint32(tier);
+}
+
+void AnnotationJournal::append(const QByteArray &payload)
+{
+    const int offset = _pending.size();
+    _pending.resize(offset + RecordHeaderSize);
+
+    uchar *header = reinterpret_cast<uchar*>(_pending.data() + offset);
+    qToLittleEndian<quint32>(payload.size(), header);
+    qToLittleEndian<quint16>(qChecksum(payload.constData(), payload.size()), header + sizeof(quint32));
+    _pending.append(payload);
+
+    ++_records;
+    if (!_flushTimer.isActive())
+        _flushTimer.start();
+}
+
+// Applies the records newer than the snapshot, returns the length of the
+// valid part of the journal
+qint64 AnnotationJournal::replay(const QByteArray &journal, quint64 snapshotSequence)
+{
+    const uchar *data = reinterpret_cast<const uchar*>(journal.constData());
+
+    qint64 offset = 0;
+    while (journal.size() - offset >= RecordHeaderSize) {
+        const quint32 length = qFromLittleEndian<quint32>(data + offset);
+        const quint16 checksum = qFromLittleEndian<quint16>(data + offset + sizeof(quint32));
+        if (journal.size() - offset - RecordHeaderSize < length)
+            break;
+
+        const char *payload = journal.constData() + offset + RecordHeaderSize;
+        if (qChecksum(payload, length) != checksum)
+            break;
+
+        QDataStream stream(QByteArray::fromRawData(payload, length));
+        setupStream(stream);
+
+        quint64 sequence;
+        quint8 operation;
+        qint32 tier;
+        stream >> sequence >> operation >> tier;
+        if (stream.status() != QDataStream::Ok)
+            break;
+
+        if (sequence > snapshotSequence) {
+            if (!apply(stream, static_cast<Operation>(operation), tier))
+                break;
+            _sequence = qMax(_sequence, sequence);
+            ++_records;
+        }
+
+        offset += RecordHeaderSize + length;
+    }
+
+    return offset;
+}
+
+bool AnnotationJournal::apply(QDataStream &stream, Operation operation, int tier)
+{
+    if (operation != AddTier && operation != Clear && (tier < 0 || tier >= _annotations->tierCount()))
+        return false;
+
+    switch (operation) {
+    case AddTier: {
+        QString name;
+        quint8 type;
+        stream >> name >> type;
+        if (stream.status() != QDataStream::Ok || tier != _annotations->tierCount() || type > AnnotationTier::PointTier)
+            return false;
+        _annotations->addTier(name, static_cast<AnnotationTier::Type>(type));
+        return true;
+    }
+    case AddAnnotation: {
+        Annotation annotation;
+        stream >> annotation.id >> annotation.begin >> annotation.end >> annotation.label;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+        _annotations->insert(tier, annotation);
+        return true;
+    }
+    case RemoveAnnotation: {
+        quint64 id;
+        stream >> id;
+        return stream.status() == QDataStream::Ok && _annotations->remove(tier, id);
+    }
+    case MoveAnnotation: {
+        quint64 id;
+        double begin, end;
+        stream >> id >> begin >> end;
+        return stream.status() == QDataStream::Ok && _annotations->move(tier, id, begin, end);
+    }
+    case SetLabel: {
+        quint64 id;
+        QString label;
+        stream >> id >> label;
+        return stream.status() == QDataStream::Ok && _annotations->setLabel(tier, id, label);
+    }
+    case Clear:
+        _annotations->clear();
+        return true;
+    }
+
+    return false;
+}
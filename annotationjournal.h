@@ -0,0 +1,97 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef ANNOTATIONJOURNAL_H
+#define ANNOTATIONJOURNAL_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QTimer>
+
+#include "annotations.h"
+
+class QDataStream;
+
+// Persists the annotations of a file as a snapshot plus an append-only
+// journal of edits next to it. Every edit appends one small record, records
+// are written and synced in batches, and the journal is periodically folded
+// into a new snapshot on a worker thread, records of edits made meanwhile
+// wait in memory. Opening replays the journal on top of the snapshot, a torn
+// record left by a crash ends the replay.
+class AnnotationJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AnnotationJournal(Annotations *annotations, QObject *parent = 0);
+    ~AnnotationJournal();
+
+    bool load(const QString &fileName);
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return !_fileName.isEmpty(); }
+
+    static QString snapshotPath(const QString &fileName);
+    static QString journalPath(const QString &fileName);
+
+    static bool readSnapshot(const QString &path, Annotations *annotations, quint64 *sequence);
+    static bool writeSnapshot(const QString &path, const QVector<AnnotationTier> &tiers, quint64 sequence);
+
+signals:
+    void errorMessage(const QString &heading, const QString &detail);
+
+public slots:
+    void flush();
+    void compact();
+    void checkpoint();
+
+private slots:
+    void flushTimeout();
+    void compactionFinished();
+
+    void tierAdded(int tier);
+    void tierImported(int tier);
+    void added(int tier, const Annotation &annotation);
+    void removed(int tier, quint64 id);
+    void moved(int tier, quint64 id, double begin, double end);
+    void labelChanged(int tier, quint64 id, const QString &label);
+    void cleared();
+
+private:
+    enum Operation
+    {
+        AddTier = 1,
+        AddAnnotation,
+        RemoveAnnotation,
+        MoveAnnotation,
+        SetLabel,
+        Clear
+    };
+
+    bool isRecording() const { return isOpen() && !_replaying; }
+    bool recover(const QString &fileName, bool repair);
+    void beginRecord(QDataStream &stream, Operation operation, int tier);
+    void append(const QByteArray &payload);
+    qint64 replay(const QByteArray &journal, quint64 snapshotSequence);
+    bool apply(QDataStream &stream, Operation operation, int tier);
+
+private:
+    Annotations *_annotations;
+    QString _fileName;
+    QFile _journal;
+    QByteArray _pending;
+    QTimer _flushTimer;
+    quint64 _sequence;
+    int _records;
+    bool _replaying;
+
+    QFutureWatcher<bool> _compaction;
+    bool _compacting;
+    int _compactionRecords;
+};
+
+#endif // ANNOTATIONJOURNAL_H
@@ -0,0 +1,325 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "annotations.h"
+
+#include <algorithm>
+
+namespace
+{
+
+bool beginLess(double begin, const Annotation &annotation)
+{
+    return begin < annotation.begin;
+}
+
+bool lessBegin(const Annotation &annotation, double begin)
+{
+    return annotation.begin < begin;
+}
+
+bool lessAnnotation(const Annotation &a, const Annotation &b)
+{
+    return a.begin < b.begin;
+}
+
+}
+
+//-----------------------------------------------------------------------------
+// AnnotationTier
+//-----------------------------------------------------------------------------
+
+AnnotationTier::AnnotationTier()
+    : _type(IntervalTier)
+    , _rootLevel(-1)
+    , _indexDirty(false)
+{
+}
+
+AnnotationTier::AnnotationTier(const QString &name, Type type)
+    : _name(name)
+    , _type(type)
+    , _rootLevel(-1)
+    , _indexDirty(false)
+{
+}
+
+int AnnotationTier::indexOf(quint64 id) const
+{
+    if (!_begins.contains(id))
+        return -1;
+
+    // Only annotations with the same begin have to be checked
+    const double begin = _begins.value(id);
+    auto it = std::lower_bound(_annotations.constBegin(), _annotations.constEnd(), begin, lessBegin);
+    for (; it != _annotations.constEnd() && it->begin == begin; ++it) {
+        if (it->id == id)
+            return it - _annotations.constBegin();
+    }
+
+    return -1;
+}
+
+int AnnotationTier::insert(const Annotation &annotation)
+{
+    const auto it = std::upper_bound(_annotations.constBegin(), _annotations.constEnd(), annotation.begin, beginLess);
+    const int index = it - _annotations.constBegin();
+
+    _annotations.insert(index, annotation);
+    _begins.insert(annotation.id, annotation.begin);
+    _indexDirty = true;
+    return index;
+}
+
+// Replaces the content at once, much cheaper than inserting one by one
+void AnnotationTier::assign(const QVector<Annotation> &annotations)
+{
+    _annotations = annotations;
+    if (!std::is_sorted(_annotations.constBegin(), _annotations.constEnd(), lessAnnotation))
+        std::stable_sort(_annotations.begin(), _annotations.end(), lessAnnotation);
+
+    _begins.clear();
+    _begins.reserve(_annotations.size());
+    for (const Annotation &annotation : _annotations)
+        _begins.insert(annotation.id, annotation.begin);
+
+    _indexDirty = true;
+}
+
+void AnnotationTier::removeAt(int index)
+{
+    _begins.remove(_annotations[index].id);
+    _annotations.remove(index);
+    _indexDirty = true;
+}
+
+int AnnotationTier::move(int index, double begin, double end)
+{
+    Annotation annotation = _annotations[index];
+    annotation.begin = begin;
+    annotation.end = _type == PointTier ? begin : end;
+
+    removeAt(index);
+    return insert(annotation);
+}
+
+void AnnotationTier::setLabel(int index, const QString &label)
+{
+    _annotations[index].label = label;
+}
+
+void AnnotationTier::clear()
+{
+    _annotations.clear();
+    _begins.clear();
+    _indexDirty = true;
+}
+
+QVector<int> AnnotationTier::overlapping(double begin, double end) const
+{
+    QVector<int> result;
+    forEachOverlapping(begin, end, [&result] (int index) {
+        result.append(index);
+    });
+    return result;
+}
+
+int AnnotationTier::hitTest(double time, double tolerance) const
+{
+    int result = -1;
+    bool inside = false;
+    double best = 0.0;
+
+    forEachOverlapping(time - tolerance, time + tolerance, [&] (int index) {
+        const Annotation &annotation = _annotations[index];
+        if (annotation.begin <= time && time <= annotation.end && annotation.begin < annotation.end) {
+            const double length = annotation.end - annotation.begin;
+            if (!inside || length < best) {
+                result = index;
+                inside = true;
+                best = length;
+            }
+        } else if (!inside) {
+            const double distance = qMin(qAbs(annotation.begin - time), qAbs(annotation.end - time));
+            if (result < 0 || distance < best) {
+                result = index;
+                best = distance;
+            }
+        }
+    });
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+void AnnotationTier::updateIndex() const
+{
+    if (!_indexDirty)
+        return;
+
+    _indexDirty = false;
+    _rootLevel = -1;
+
+    const int count = _annotations.size();
+    _maxEnds.resize(count);
+    if (count == 0)
+        return;
+
+    // Nodes of level k are the indices with exactly k trailing ones, leaves
+    // are the even ones. The tree is not complete, so the maximum of the
+    // rightmost existing subtree stands in for missing right children.
+    int lastIndex = 0;
+    double last = 0.0;
+    for (int i = 0; i < count; i += 2) {
+        lastIndex = i;
+        last = _maxEnds[i] = _annotations[i].end;
+    }
+
+    int level = 1;
+    for (; (1 << level) <= count; ++level) {
+        const int half = 1 << (level - 1);
+        const int step = half << 2;
+        for (int i = (half << 1) - 1; i < count; i += step) {
+            const double left = _maxEnds[i - half];
+            const double right = i + half < count ? _maxEnds[i + half] : last;
+            _maxEnds[i] = qMax(_annotations[i].end, qMax(left, right));
+        }
+
+        lastIndex = (lastIndex >> level & 1) ? lastIndex - half : lastIndex + half;
+        if (lastIndex < count && _maxEnds[lastIndex] > last)
+            last = _maxEnds[lastIndex];
+    }
+
+    _rootLevel = level - 1;
+}
+
+//-----------------------------------------------------------------------------
+// Annotations
+//-----------------------------------------------------------------------------
+
+Annotations::Annotations(QObject *parent)
+    :   QObject(parent)
+    ,   _nextId(1)
+{
+}
+
+Annotations::~Annotations()
+{
+}
+
+int Annotations::addTier(const QString &name, AnnotationTier::Type type)
+{
+    _tiers.append(AnnotationTier(name, type));
+    const int tier = _tiers.size() - 1;
+
+    emit tierAdded(tier);
+    emit changed();
+    return tier;
+}
+
+// Adds a whole tier at once, annotations with zero id get fresh ones
+int Annotations::addTier(const QString &name, AnnotationTier::Type type, QVector<Annotation> annotations)
+{
+    for (Annotation &annotation : annotations) {
+        if (annotation.id == 0)
+            annotation.id = _nextId++;
+        else
+            _nextId = qMax(_nextId, annotation.id + 1);
+
+        if (type == AnnotationTier::PointTier)
+            annotation.end = annotation.begin;
+        else if (annotation.begin > annotation.end)
+            qSwap(annotation.begin, annotation.end);
+    }
+
+    _tiers.append(AnnotationTier(name, type));
+    _tiers.last().assign(annotations);
+    const int tier = _tiers.size() - 1;
+
+    emit tierImported(tier);
+    emit changed();
+    return tier;
+}
+
+quint64 Annotations::add(int tier, double begin, double end, const QString &label)
+{
+    Q_ASSERT(tier >= 0 && tier < _tiers.size());
+
+    AnnotationTier &target = _tiers[tier];
+    if (target.type() == AnnotationTier::PointTier)
+        end = begin;
+
+    const Annotation annotation { _nextId++, qMin(begin, end), qMax(begin, end), label };
+    target.insert(annotation);
+
+    emit added(tier, annotation);
+    emit changed();
+    return annotation.id;
+}
+
+// Inserts an annotation with a known id, e.g. read back from a file
+void Annotations::insert(int tier, const Annotation &annotation)
+{
+    Q_ASSERT(tier >= 0 && tier < _tiers.size());
+
+    _tiers[tier].insert(annotation);
+    _nextId = qMax(_nextId, annotation.id + 1);
+
+    emit added(tier, annotation);
+    emit changed();
+}
+
+bool Annotations::remove(int tier, quint64 id)
+{
+    const int index = _tiers[tier].indexOf(id);
+    if (index < 0)
+        return false;
+
+    _tiers[tier].removeAt(index);
+
+    emit removed(tier, id);
+    emit changed();
+    return true;
+}
+
+bool Annotations::move(int tier, quint64 id, double begin, double end)
+{
+    const int index = _tiers[tier].indexOf(id);
+    if (index < 0)
+        return false;
+
+    if (begin > end)
+        qSwap(begin, end);
+    _tiers[tier].move(index, begin, end);
+
+    emit moved(tier, id, begin, end);
+    emit changed();
+    return true;
+}
+
+bool Annotations::setLabel(int tier, quint64 id, const QString &label)
+{
+    const int index = _tiers[tier].indexOf(id);
+    if (index < 0)
+        return false;
+
+    _tiers[tier].setLabel(index, label);
+
+    emit labelChanged(tier, id, label);
+    emit changed();
+    return true;
+}
+
+void Annotations::clear()
+{
+    _tiers.clear();
+    _nextId = 1;
+
+    emit cleared();
+    emit changed();
+}
@@ -0,0 +1,166 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef ANNOTATIONS_H
+#define ANNOTATIONS_H
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+// Times are in seconds from the beginning of the file, points have end equal
+// to begin.
+struct Annotation
+{
+    quint64 id;
+    double begin;
+    double end;
+    QString label;
+};
+Q_DECLARE_TYPEINFO(Annotation, Q_MOVABLE_TYPE);
+
+// Annotations of a single tier kept sorted by begin. Overlap queries walk an
+// implicit interval tree laid over the sorted array (every node stores the
+// maximum end of its subtree), so they cost O(log n + k). Edits only mark the
+// tree dirty, it is rebuilt in O(n) by the next query.
+class AnnotationTier
+{
+public:
+    enum Type
+    {
+        IntervalTier,
+        PointTier
+    };
+
+    AnnotationTier();
+    AnnotationTier(const QString &name, Type type);
+
+    const QString &name() const { return _name; }
+    void setName(const QString &name) { _name = name; }
+    Type type() const { return _type; }
+
+    int size() const { return _annotations.size(); }
+    bool isEmpty() const { return _annotations.isEmpty(); }
+    const Annotation &at(int index) const { return _annotations[index]; }
+    const QVector<Annotation> &annotations() const { return _annotations; }
+
+    int indexOf(quint64 id) const;
+    int insert(const Annotation &annotation);
+    void assign(const QVector<Annotation> &annotations);
+    void removeAt(int index);
+    int move(int index, double begin, double end);
+    void setLabel(int index, const QString &label);
+    void clear();
+
+    // Calls function(index) in ascending order for every annotation which
+    // intersects (begin, end), points exactly on a border are not included
+    template<typename Function>
+    void forEachOverlapping(double begin, double end, Function function) const;
+    QVector<int> overlapping(double begin, double end) const;
+
+    // The shortest annotation containing time, otherwise the nearest one
+    // within tolerance, or -1
+    int hitTest(double time, double tolerance) const;
+
+private:
+    void updateIndex() const;
+
+private:
+    QString _name;
+    Type _type;
+    QVector<Annotation> _annotations;
+    QHash<quint64, double> _begins;
+
+    mutable QVector<double> _maxEnds;
+    mutable int _rootLevel;
+    mutable bool _indexDirty;
+};
+
+// All tiers of a file. Every edit goes through this class and is announced
+// with a signal, so views and persistence can follow the changes.
+class Annotations : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Annotations(QObject *parent = 0);
+    ~Annotations();
+
+    int tierCount() const { return _tiers.size(); }
+    const AnnotationTier &tier(int index) const { return _tiers[index]; }
+    const QVector<AnnotationTier> &tiers() const { return _tiers; }
+
+    int addTier(const QString &name, AnnotationTier::Type type);
+    int addTier(const QString &name, AnnotationTier::Type type, QVector<Annotation> annotations);
+    quint64 add(int tier, double begin, double end, const QString &label);
+    void insert(int tier, const Annotation &annotation);
+    bool remove(int tier, quint64 id);
+    bool move(int tier, quint64 id, double begin, double end);
+    bool setLabel(int tier, quint64 id, const QString &label);
+    void clear();
+
+signals:
+    void tierAdded(int tier);
+    void tierImported(int tier);
+    void added(int tier, const Annotation &annotation);
+    void removed(int tier, quint64 id);
+    void moved(int tier, quint64 id, double begin, double end);
+    void labelChanged(int tier, quint64 id, const QString &label);
+    void cleared();
+    void changed();
+
+private:
+    QVector<AnnotationTier> _tiers;
+    quint64 _nextId;
+};
+
+template<typename Function>
+void AnnotationTier::forEachOverlapping(double begin, double end, Function function) const
+{
+    updateIndex();
+    if (_rootLevel < 0)
+        return;
+
+    struct Node
+    {
+        int level;
+        int index;
+        bool leftDone;
+    };
+
+    const int count = _annotations.size();
+    const Annotation *annotations = _annotations.constData();
+    const double *maxEnds = _maxEnds.constData();
+
+    Node stack[64];
+    int top = 0;
+    stack[top++] = Node { _rootLevel, (1 << _rootLevel) - 1, false };
+
+    while (top) {
+        const Node node = stack[--top];
+        if (node.level <= 3) {
+            // Small subtree, a linear scan is cheaper than descending
+            const int first = node.index >> node.level << node.level;
+            const int last = qMin(count, first + (1 << (node.level + 1)) - 1);
+            for (int i = first; i < last && annotations[i].begin < end; ++i) {
+                if (begin < annotations[i].end)
+                    function(i);
+            }
+        } else if (!node.leftDone) {
+            // Left child may lie past the array end, it is clipped above
+            const int left = node.index - (1 << (node.level - 1));
+            stack[top++] = Node { node.level, node.index, true };
+            if (left >= count || maxEnds[left] > begin)
+                stack[top++] = Node { node.level - 1, left, false };
+        } else if (node.index < count && annotations[node.index].begin < end) {
+            if (begin < annotations[node.index].end)
+                function(node.index);
+            stack[top++] = Node { node.level - 1, node.index + (1 << (node.level - 1)), false };
+        }
+    }
+}
+
+#endif // ANNOTATIONS_H
@@ -5,23 +5,46 @@
 
 #include "engine.h"
 #include "antiannotate.h"
+#include "annotationformats.h"
+#include "annotationjournal.h"
 #include "waveform.h"
+#include "prefetcher.h"
 #include "progressbar.h"
+#include "spectrumanalyser.h"
+#include "vad.h"
 #include "utils.h"
+#include "trace.h"
 
 #include <QApplication>
+#include <QFileDialog>
 #include <QFileInfo>
+#include <QInputDialog>
 #include <QScreen>
-#include <QDebug>
 #include <QLayout>
 #include <QMessageBox>
 #include <QKeyEvent>
 
+const int HitTolerancePixels = 4;
+
+// Files of the playlist opened and analyzed ahead of time
+const int PrefetchCount = 3;
+
+// Floor and ceiling of the spectrogram move by this, and are kept this far apart
+const float ContrastStepDb = 6.0f;
+
 MainWidget::MainWidget(QWidget *parent)
     :   QWidget(parent)
     ,   _engine(new Engine(this))
+    ,   _prefetcher(new Prefetcher(this))
+    ,   _current(-1)
+    ,   _annotations(new Annotations(this))
+    ,   _journal(new AnnotationJournal(_annotations, this))
+    ,   _activeTier(0)
+    ,   _intervalBegin(-1.0)
+    ,   _snapMode(NoSnap)
     ,   _waveform(new Waveform(this))
     ,   _progressBar(new ProgressBar(this))
+    ,   _spectrumAnalyser(new SpectrumAnalyser(this))
 {
     setAttribute(Qt::WA_ShowWithoutActivating);
     auto geometry = QApplication::screens().at(0)->availableGeometry();
@@ -31,29 +54,135 @@ MainWidget::MainWidget(QWidget *parent)
     createUi();
     connectUi();
 
-    if (QApplication::arguments().length() < 2) {
-        qFatal("Filename is not provided");
+    // Files, directories and lists of files make up the playlist
+    QStringList paths;
+    for (const QString &argument : QApplication::arguments().mid(1)) {
+        if (!argument.startsWith('-'))
+            paths << argument;
     }
 
-    auto filename = QApplication::arguments().at(1);
-    qDebug() << "Try to load file" << filename;
+    // With --exact-gain playback starts at unity gain instead of an estimate
+    _engine->setEstimateGains(!QApplication::arguments().contains("--exact-gain"));
 
-    setWindowTitle(QFileInfo(filename).absoluteFilePath());
-    _engine->loadFile(filename);
-    _engine->startPlayback();
+    _playlist = collectWavFiles(paths);
+    if (_playlist.isEmpty()) {
+        qFatal("Filename is not provided");
+    }
+
+    openFile(0);
 }
 
 MainWidget::~MainWidget()
 {
+    // Background jobs of the engine and the waveform end with the file
+    _engine->reset();
+    _engine->setMonitor(nullptr);
+    _journal->close();
 }
 
 void MainWidget::keyPressEvent(QKeyEvent *event)
 {
-    if (event->key() == Qt::Key_Space) {
+    if (event->matches(QKeySequence::Open)) {
+        importTiers();
+    } else if (event->matches(QKeySequence::Save)) {
+        exportTiers();
+    } else if (event->key() == Qt::Key_PageDown) {
+        if (_current + 1 < _playlist.size())
+            openFile(_current + 1);
+    } else if (event->key() == Qt::Key_PageUp) {
+        if (_current > 0)
+            openFile(_current - 1);
+    } else if (event->key() == Qt::Key_Space) {
         if (_engine->state() == QAudio::ActiveState)
             _engine->suspend();
         else
             _engine->startPlayback();
+    } else if (event->key() == Qt::Key_A) {
+        _engine->setPlaybackChannel(PlaybackSource::AllChannels);
+    } else if (event->key() == Qt::Key_M) {
+        _engine->setPlaybackChannel(PlaybackSource::Downmix);
+    } else if (event->key() >= Qt::Key_1 && event->key() <= Qt::Key_9) {
+        _engine->setPlaybackChannel(event->key() - Qt::Key_1);
+    } else if (event->key() == Qt::Key_S) {
+        _engine->setSkipSilence(!_engine->skipsSilence());
+    } else if (event->key() == Qt::Key_N) {
+        const Normalization mode = _engine->normalization();
+        _engine->setNormalization(mode == PeakNormalization ? RmsNormalization
+                                  : mode == RmsNormalization ? LoudnessNormalization
+                                  : PeakNormalization);
+    } else if (event->key() == Qt::Key_L) {
+        _engine->setLimiter(!_engine->limits());
+    } else if (event->key() == Qt::Key_F) {
+        const FrequencyScale scale = _waveform->frequencyScale();
+        _waveform->setFrequencyScale(scale == MelScale ? LinearScale
+                                     : scale == LinearScale ? LogScale
+                                     : MelScale);
+    } else if (event->key() == Qt::Key_H) {
+        _waveform->setMultitaper(!_waveform->multitaper());
+    } else if (event->key() == Qt::Key_C) {
+        SpectrumDisplay display = _waveform->spectrumDisplay();
+        display.colormap = display.colormap == GrayColormap ? HeatColormap
+                           : display.colormap == HeatColormap ? ViridisColormap
+                           : GrayColormap;
+        _waveform->setSpectrumDisplay(display);
+    } else if (event->key() == Qt::Key_Minus || event->key() == Qt::Key_Equal
+               || event->key() == Qt::Key_Comma || event->key() == Qt::Key_Period) {
+        SpectrumDisplay display = _waveform->spectrumDisplay();
+        const bool lower = event->key() == Qt::Key_Minus || event->key() == Qt::Key_Comma;
+        const float step = lower ? -ContrastStepDb : ContrastStepDb;
+        if (event->key() == Qt::Key_Minus || event->key() == Qt::Key_Equal)
+            display.floorDb = qBound(Analysis::spectrumDb(0), display.floorDb + step, display.ceilingDb - ContrastStepDb);
+        else
+            display.ceilingDb = qBound(display.floorDb + ContrastStepDb, display.ceilingDb + step, 0.0f);
+        _waveform->setSpectrumDisplay(display);
+    } else if (event->key() == Qt::Key_I) {
+        // The first press marks the beginning, the second one adds the interval
+        const double time = boundaryTime();
+        if (_intervalBegin < 0.0) {
+            _intervalBegin = time;
+        } else {
+            const int tier = tierForEdit(AnnotationTier::IntervalTier);
+            if (time != _intervalBegin)
+                _annotations->add(tier, _intervalBegin, time, QString());
+            _intervalBegin = -1.0;
+        }
+    } else if (event->key() == Qt::Key_P) {
+        const double time = boundaryTime();
+        _annotations->add(tierForEdit(AnnotationTier::PointTier), time, time, QString());
+    } else if (event->key() == Qt::Key_Z) {
+        _snapMode = _snapMode == NoSnap ? ZeroCrossingSnap
+                  : _snapMode == ZeroCrossingSnap ? EnergyMinimumSnap
+                  : NoSnap;
+        qCDebug(logEngine) << "MainWidget::keyPressEvent" << "snapMode" << _snapMode;
+    } else if (event->key() == Qt::Key_V) {
+        const WavFile *file = _engine->file();
+        const int tier = file && file->isLoaded() ? addSpeechTiers(_annotations, file, &_waveform->analysis()) : -1;
+        if (tier >= 0) {
+            _activeTier = tier;
+            _waveform->setActiveTier(_activeTier);
+        }
+    } else if (event->key() == Qt::Key_T) {
+        if (_annotations->tierCount() > 0) {
+            _activeTier = (_activeTier + 1) % _annotations->tierCount();
+            _waveform->setActiveTier(_activeTier);
+        }
+    } else if (event->key() == Qt::Key_BracketLeft || event->key() == Qt::Key_BracketRight) {
+        const int index = annotationUnderCursor();
+        if (index >= 0) {
+            const Annotation &annotation = _annotations->tier(_activeTier).at(index);
+            if (event->key() == Qt::Key_BracketLeft)
+                _annotations->move(_activeTier, annotation.id, boundaryTime(), annotation.end);
+            else
+                _annotations->move(_activeTier, annotation.id, annotation.begin, boundaryTime());
+        }
+    } else if (event->key() == Qt::Key_Delete || event->key() == Qt::Key_Backspace) {
+        const int index = annotationUnderCursor();
+        if (index >= 0)
+            _annotations->remove(_activeTier, _annotations->tier(_activeTier).at(index).id);
+    } else if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
+        const int index = annotationUnderCursor();
+        if (index >= 0)
+            editLabel(index);
     }
 }
 
@@ -74,9 +203,12 @@ void MainWidget::createUi()
     _waveform->setLayout(waveformLayout.data());
     _waveform->setMinimumHeight(600);
     waveformLayout.take();
+    _waveform->setAnnotations(_annotations);
     windowLayout->addWidget(_waveform);
 
     QScopedPointer<QHBoxLayout> analysisLayout(new QHBoxLayout);
+    analysisLayout->addWidget(_spectrumAnalyser);
+    _spectrumAnalyser->setMinimumHeight(120);
     windowLayout->addLayout(analysisLayout.data());
     analysisLayout.take();
 
@@ -90,20 +222,178 @@ void MainWidget::connectUi()
         QMessageBox::warning(this, heading, detail, QMessageBox::Close);
     });
 
+    connect(_journal, &AnnotationJournal::errorMessage,
+            [this] (const QString &heading, const QString &detail) {
+        QMessageBox::warning(this, heading, detail, QMessageBox::Close);
+    });
+
     connect(_engine, &Engine::fileChanged,
             _progressBar, &ProgressBar::fileChanged);
 
     connect(_engine, &Engine::playPositionChanged,
             _progressBar, &ProgressBar::playPositionChanged);
 
+    connect(_engine, &Engine::loadProgress,
+            _progressBar, &ProgressBar::loadProgressChanged);
+
     connect(_engine, &Engine::fileChanged,
             _waveform, &Waveform::fileChanged);
 
-    connect(_progressBar, &ProgressBar::selectionPositionChanged,
-            _engine, &Engine::selectionPositionChanged);
+    connect(_engine, &Engine::fileChanged,
+            _spectrumAnalyser, &SpectrumAnalyser::fileChanged);
+    connect(_engine, &Engine::outputLatencyChanged,
+            _spectrumAnalyser, &SpectrumAnalyser::setOutputLatency);
+    _engine->setMonitor(_spectrumAnalyser->ring());
+
+    connect(_engine, &Engine::fileLoaded,
+            _waveform, &Waveform::fileLoaded);
+
+    connect(_engine, &Engine::fileChanged, [this] (WavFile *file) {
+        _journal->close();
+        _annotations->clear();
+        if (file)
+            _journal->open(file->fileName());
+        _activeTier = 0;
+        _intervalBegin = -1.0;
+        _waveform->setActiveTier(_activeTier);
+    });
+
+    connect(_waveform, &Waveform::analysisFinished, [this] () {
+        // Files without annotations start pre-segmented
+        const WavFile *file = _engine->file();
+        if (file && _annotations->tierCount() == 0)
+            addSpeechTiers(_annotations, file, &_waveform->analysis());
+    });
+
+    connect(_progressBar, &ProgressBar::selectionPositionChanged, [this] (qint64 position) {
+        const WavFile *file = _engine->file();
+        if (file && _snapMode != NoSnap) {
+            const qint64 frameBytes = file->channelCount() * sizeof(qint16);
+            const qint64 sampleRate = file->format().sampleRate();
+            const qint64 timeUs = snapBoundary(file, _waveform->analysis(),
+                                               position / frameBytes * 1000000 / sampleRate,
+                                               _snapMode, _engine->playbackChannel());
+            position = timeUs * sampleRate / 1000000 * frameBytes;
+        }
+        _engine->selectionPositionChanged(position);
+    });
 }
 
 void MainWidget::reset()
 {
     _engine->reset();
 }
+
+// Takes the file from the prefetcher if it is there, the following ones are
+// queued for prefetching
+void MainWidget::openFile(int index)
+{
+    const QString fileName = _playlist[index];
+    qCDebug(logEngine) << "Try to load file" << fileName;
+    _current = index;
+    setWindowTitle(QString("%1 (%2/%3)")
+                   .arg(QFileInfo(fileName).absoluteFilePath())
+                   .arg(index + 1).arg(_playlist.size()));
+
+    WavFile *file = nullptr;
+    Analysis analysis;
+    if (_prefetcher->take(fileName, &file, &analysis)) {
+        _waveform->setPrefetchedAnalysis(fileName, analysis);
+        _engine->setFile(file);
+    } else {
+        _engine->loadFile(fileName);
+    }
+
+    _prefetcher->setQueue(_playlist.mid(index + 1, PrefetchCount));
+    _engine->startPlayback();
+}
+
+double MainWidget::playTime() const
+{
+    const WavFile *file = _engine->file();
+    if (file == nullptr)
+        return 0.0;
+
+    const qint64 frameBytes = file->channelCount() * sizeof(qint16);
+    return static_cast<double>(_engine->playPosition() / frameBytes) / file->format().sampleRate();
+}
+
+// The play time moved to the nearest zero crossing or quiet spot, if enabled
+double MainWidget::boundaryTime() const
+{
+    const WavFile *file = _engine->file();
+    if (file == nullptr || _snapMode == NoSnap)
+        return playTime();
+
+    const qint64 timeUs = snapBoundary(file, _waveform->analysis(), qRound64(playTime() * 1000000),
+                                       _snapMode, _engine->playbackChannel());
+    return timeUs / 1000000.0;
+}
+
+int MainWidget::tierForEdit(AnnotationTier::Type type)
+{
+    if (_activeTier < _annotations->tierCount() && _annotations->tier(_activeTier).type() == type)
+        return _activeTier;
+
+    for (int i = 0; i < _annotations->tierCount(); ++i) {
+        if (_annotations->tier(i).type() == type) {
+            _activeTier = i;
+            _waveform->setActiveTier(_activeTier);
+            return _activeTier;
+        }
+    }
+
+    _activeTier = _annotations->addTier(type == AnnotationTier::PointTier ? "points" : "intervals", type);
+    _waveform->setActiveTier(_activeTier);
+    return _activeTier;
+}
+
+int MainWidget::annotationUnderCursor() const
+{
+    if (_activeTier >= _annotations->tierCount())
+        return -1;
+
+    const double tolerance = _waveform->timeAt(HitTolerancePixels) - _waveform->timeAt(0);
+    return _annotations->tier(_activeTier).hitTest(playTime(), tolerance);
+}
+
+void MainWidget::editLabel(int index)
+{
+    const Annotation annotation = _annotations->tier(_activeTier).at(index);
+
+    bool ok = false;
+    const QString label = QInputDialog::getText(this, "Label", "Label:", QLineEdit::Normal,
+                                                annotation.label, &ok);
+    if (ok)
+        _annotations->setLabel(_activeTier, annotation.id, label);
+}
+
+void MainWidget::importTiers()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, "Import annotations", QString(),
+            "Annotations (*.TextGrid *.eaf *.csv *.tsv)");
+    if (fileName.isEmpty())
+        return;
+
+    QString errorString;
+    if (!importAnnotations(fileName, _annotations, &errorString))
+        QMessageBox::warning(this, "Import failed", errorString, QMessageBox::Close);
+}
+
+void MainWidget::exportTiers()
+{
+    const WavFile *file = _engine->file();
+    if (file == nullptr)
+        return;
+
+    const QFileInfo info(file->fileName());
+    const QString fileName = QFileDialog::getSaveFileName(this, "Export annotations",
+            info.dir().filePath(info.completeBaseName() + ".TextGrid"),
+            "Praat TextGrid (*.TextGrid);;ELAN (*.eaf);;CSV (*.csv);;TSV (*.tsv)");
+    if (fileName.isEmpty())
+        return;
+
+    QString errorString;
+    if (!exportAnnotations(fileName, *_annotations, file->duration(), file->fileName(), &errorString))
+        QMessageBox::warning(this, "Export failed", errorString, QMessageBox::Close);
+}
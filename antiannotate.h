@@ -6,10 +6,17 @@
 #ifndef ANTIANNOTATE_H
 #define ANTIANNOTATE_H
 
+#include <QStringList>
 #include <QWidget>
 
+#include "annotations.h"
+#include "snapping.h"
+
+class AnnotationJournal;
 class Engine;
+class Prefetcher;
 class ProgressBar;
+class SpectrumAnalyser;
 class Waveform;
 
 class MainWidget : public QWidget
@@ -25,12 +32,30 @@ private:
     void createUi();
     void connectUi();
     void reset();
+    void openFile(int index);
+
+    double playTime() const;
+    double boundaryTime() const;
+    int tierForEdit(AnnotationTier::Type type);
+    int annotationUnderCursor() const;
+    void editLabel(int index);
+    void importTiers();
+    void exportTiers();
 
 private:
     Engine* _engine;
+    Prefetcher *_prefetcher;
+    QStringList _playlist;
+    int _current;
+    Annotations *_annotations;
+    AnnotationJournal *_journal;
+    int _activeTier;
+    double _intervalBegin;
+    SnapMode _snapMode;
 
     Waveform *_waveform;
     ProgressBar *_progressBar;
+    SpectrumAnalyser *_spectrumAnalyser;
 };
 
 #endif // ANTIANNOTATE_H
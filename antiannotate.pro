@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui multimedia
+QT       += core gui multimedia concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -26,18 +26,64 @@ DEFINES += LOG_ENGINE LOG_SPECTRUMANALYSER LOG_WAVEFORM PAINT_EVENT_TRACE
 
 SOURCES += \
         main.cpp \
+        analysis.cpp \
+        annotationformats.cpp \
+        annotationjournal.cpp \
+        annotations.cpp \
         antiannotate.cpp \
+        batch.cpp \
+        benchmark.cpp \
         engine.cpp \
+        filterbank.cpp \
+        formants.cpp \
+        levelmeter.cpp \
+        lzcodec.cpp \
+        peakpyramid.cpp \
+        pitch.cpp \
+        playbacksource.cpp \
+        prefetcher.cpp \
         progressbar.cpp \
+        render.cpp \
+        snapping.cpp \
+        spectrogram.cpp \
+        spectrumanalyser.cpp \
+        spectrumdisplay.cpp \
+        tapers.cpp \
+        trace.cpp \
         utils.cpp \
+        vad.cpp \
         waveform.cpp \
         wavfile.cpp
 
 HEADERS += \
+        analysis.h \
+        annotationformats.h \
+        annotationjournal.h \
+        annotations.h \
         antiannotate.h \
+        batch.h \
+        benchmark.h \
         engine.h \
+        filterbank.h \
+        formants.h \
+        jobcontrol.h \
+        levelmeter.h \
+        lzcodec.h \
+        peakpyramid.h \
+        pitch.h \
+        playbacksource.h \
+        prefetcher.h \
         progressbar.h \
+        render.h \
+        samplering.h \
+        snapping.h \
+        spectrogram.h \
+        spectrumanalyser.h \
+        spectrumdisplay.h \
+        tapers.h \
+        trace.h \
         utils.h \
+        vad.h \
         waveform.h \
         wavfile.h
 
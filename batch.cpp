@@ -0,0 +1,309 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "batch.h"
+#include "analysis.h"
+#include "annotationformats.h"
+#include "annotationjournal.h"
+#include "benchmark.h"
+#include "render.h"
+#include "vad.h"
+#include "wavfile.h"
+#include "utils.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <functional>
+
+static const char *BatchCommands[] = { "--precompute", "--render", "--benchmark", "--export", "--vad" };
+
+enum BatchResult
+{
+    BatchDone,
+    BatchSkipped,
+    BatchFailed
+};
+
+static BatchResult precompute(const QString &fileName, bool force)
+{
+    WavFile file;
+    if (!file.open(fileName) || !isFormatSupported(file.format()))
+        return BatchFailed;
+
+    Analysis analysis;
+    if (!force && analysis.load(&file))
+        return BatchSkipped;
+
+    analysis.compute(&file);
+    return analysis.save(&file) ? BatchDone : BatchFailed;
+}
+
+static BatchResult render(const QString &fileName, const QSize &size, const QString &imageName)
+{
+    WavFile file;
+    if (!file.open(fileName) || !isFormatSupported(file.format()))
+        return BatchFailed;
+
+    Analysis analysis;
+    if (!analysis.load(&file))
+        analysis.compute(&file);
+
+    return renderWaveform(&file, analysis, size).save(imageName, "PNG") ? BatchDone : BatchFailed;
+}
+
+static BatchResult exportTiers(const QString &fileName, const QString &exportName)
+{
+    WavFile file;
+    if (!file.openHeader(fileName))
+        return BatchFailed;
+
+    Annotations annotations;
+    AnnotationJournal journal(&annotations);
+    if (!journal.load(fileName))
+        return BatchFailed;
+    if (annotations.tierCount() == 0)
+        return BatchSkipped;
+
+    QString errorString;
+    if (!exportAnnotations(exportName, annotations, file.duration(), fileName, &errorString)) {
+        qWarning() << "Failed to export" << exportName << errorString;
+        return BatchFailed;
+    }
+    return BatchDone;
+}
+
+static BatchResult segmentSpeech(const QString &fileName)
+{
+    WavFile file;
+    if (!file.open(fileName) || !isFormatSupported(file.format()))
+        return BatchFailed;
+
+    Annotations annotations;
+    AnnotationJournal journal(&annotations);
+    if (!journal.open(fileName))
+        return BatchFailed;
+    if (hasSpeechTiers(annotations))
+        return BatchSkipped;
+
+    // A cached spectrogram refines the result, but is not worth computing
+    Analysis analysis;
+    addSpeechTiers(&annotations, &file, analysis.load(&file) ? &analysis : nullptr);
+    journal.close();
+    return BatchDone;
+}
+
+// Deepest directory containing all of the files
+static QString commonDirectory(const QStringList &files)
+{
+    QString root = QFileInfo(files.first()).absolutePath();
+    for (const QString &fileName : files) {
+        const QString path = QFileInfo(fileName).absolutePath();
+        while (path != root && !path.startsWith(root.endsWith('/') ? root : root + '/')) {
+            QDir parent(root);
+            if (!parent.cdUp())
+                break;
+            root = parent.absolutePath();
+        }
+    }
+    return root;
+}
+
+// Output files keep the directories of the inputs below their common root, so
+// equally named files of different directories do not overwrite each other.
+// Names which still collide (the same file given twice, or names differing
+// only in the extension) are reported and nothing is processed.
+static bool mapOutputNames(const QStringList &files, const QString &outputDir,
+                           const std::function<QString(const QFileInfo&)> &defaultName,
+                           const QString &suffix, QHash<QString, QString> *names)
+{
+    const QDir root(commonDirectory(files));
+    QHash<QString, QString> sources;
+    for (const QString &fileName : files) {
+        const QFileInfo info(fileName);
+        const QString name = outputDir.isEmpty()
+                ? defaultName(info)
+                : QDir(outputDir).filePath(root.relativeFilePath(
+                      info.absoluteDir().filePath(info.completeBaseName() + suffix)));
+
+        const QString key = QFileInfo(name).absoluteFilePath();
+        if (sources.contains(key)) {
+            fprintf(stderr, "Both %s and %s would be written to %s\n",
+                    qPrintable(sources[key]), qPrintable(fileName), qPrintable(name));
+            return false;
+        }
+        sources.insert(key, fileName);
+        names->insert(fileName, name);
+    }
+
+    // Directories are created up front, not by the parallel jobs
+    for (const QString &name : *names)
+        QDir().mkpath(QFileInfo(name).path());
+    return true;
+}
+
+bool isBatchMode(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        for (const char *command : BatchCommands) {
+            // Options with values may be given as --option=value
+            const size_t length = strlen(command);
+            if (strncmp(argv[i], command, length) == 0 && (argv[i][length] == 0 || argv[i][length] == '='))
+                return true;
+        }
+    }
+    return false;
+}
+
+int runBatch(const QCoreApplication &app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("antiannotate batch mode");
+    parser.addHelpOption();
+
+    QCommandLineOption precomputeOption("precompute",
+            "Compute analysis caches of the given files and directories.");
+    QCommandLineOption renderOption("render",
+            "Render waveform and spectrum images of the given files and directories.");
+    QCommandLineOption benchmarkOption("benchmark",
+            "Time the load, analysis and render stages on synthetic files.");
+    QCommandLineOption exportOption("export",
+            "Export annotations of the given files and directories"
+            " (textgrid, eaf, csv or tsv).", "format");
+    QCommandLineOption vadOption("vad",
+            "Add speech tiers found by voice activity detection to files without them.");
+    QCommandLineOption durationsOption("durations",
+            "Comma separated durations of benchmark files, in seconds.", "list",
+            "60,600,3600,36000");
+    QCommandLineOption channelsOption("channels",
+            "Channel count of benchmark files.", "count", "1");
+    QCommandLineOption repeatOption("repeat",
+            "Runs of every benchmark stage.", "count", "3");
+    QCommandLineOption sizeOption("size",
+            "Size of rendered images.", "WxH", "1920x600");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+            "Directory for rendered images and exported annotations (next to the audio files by default)"
+            " or file for benchmark results (standard output by default).", "path");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+            "Number of files processed in parallel.", "count",
+            QString::number(QThread::idealThreadCount()));
+    QCommandLineOption forceOption("force",
+            "Recompute caches which are already up to date.");
+    QCommandLineOption verboseOption("v", "Print debug output.");
+
+    parser.addOption(precomputeOption);
+    parser.addOption(renderOption);
+    parser.addOption(benchmarkOption);
+    parser.addOption(exportOption);
+    parser.addOption(vadOption);
+    parser.addOption(durationsOption);
+    parser.addOption(channelsOption);
+    parser.addOption(repeatOption);
+    parser.addOption(sizeOption);
+    parser.addOption(outputOption);
+    parser.addOption(jobsOption);
+    parser.addOption(forceOption);
+    parser.addOption(verboseOption);
+    parser.addPositionalArgument("paths", "WAV files, directories or lists of files to process.", "paths...");
+    parser.process(app);
+
+    if (parser.isSet(benchmarkOption)) {
+        QList<int> durations;
+        for (const QString &duration : parser.value(durationsOption).split(',')) {
+            if (duration.toInt() > 0)
+                durations.append(duration.toInt());
+        }
+
+        return runBenchmark(durations,
+                            qMax(1, parser.value(channelsOption).toInt()),
+                            qMax(1, parser.value(repeatOption).toInt()),
+                            parser.value(outputOption));
+    }
+
+    const QStringList files = collectWavFiles(parser.positionalArguments());
+    if (files.isEmpty()) {
+        fprintf(stderr, "No files to process\n");
+        return 1;
+    }
+
+    std::function<BatchResult(const QString&)> job;
+    if (parser.isSet(renderOption)) {
+        const QStringList dimensions = parser.value(sizeOption).split('x');
+        const QSize size = dimensions.size() == 2
+                ? QSize(dimensions[0].toInt(), dimensions[1].toInt())
+                : QSize();
+        if (size.isEmpty()) {
+            fprintf(stderr, "Invalid image size %s\n", qPrintable(parser.value(sizeOption)));
+            return 1;
+        }
+
+        QHash<QString, QString> imageNames;
+        const auto defaultName = [] (const QFileInfo &info) { return info.filePath() + ".png"; };
+        if (!mapOutputNames(files, parser.value(outputOption), defaultName, ".png", &imageNames))
+            return 1;
+
+        job = [size, imageNames] (const QString &fileName) {
+            return render(fileName, size, imageNames.value(fileName));
+        };
+    } else if (parser.isSet(exportOption)) {
+        const AnnotationFormat format = annotationFormat(parser.value(exportOption));
+        if (format == UnknownFormat) {
+            fprintf(stderr, "Unknown annotation format %s\n", qPrintable(parser.value(exportOption)));
+            return 1;
+        }
+
+        QHash<QString, QString> exportNames;
+        const QString suffix = "." + annotationFormatExtension(format);
+        const auto defaultName = [suffix] (const QFileInfo &info) {
+            return info.dir().filePath(info.completeBaseName() + suffix);
+        };
+        if (!mapOutputNames(files, parser.value(outputOption), defaultName, suffix, &exportNames))
+            return 1;
+
+        job = [exportNames] (const QString &fileName) {
+            return exportTiers(fileName, exportNames.value(fileName));
+        };
+    } else if (parser.isSet(vadOption)) {
+        job = segmentSpeech;
+    } else {
+        const bool force = parser.isSet(forceOption);
+        job = [force] (const QString &fileName) {
+            return precompute(fileName, force);
+        };
+    }
+
+    const int jobs = qMax(1, parser.value(jobsOption).toInt());
+    QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+
+    QAtomicInt processed(0);
+    QAtomicInt failed(0);
+    QElapsedTimer timer;
+    timer.start();
+
+    QtConcurrent::blockingMap(files, [&] (const QString &fileName) {
+        const BatchResult result = job(fileName);
+        const char *status = result == BatchDone ? "done"
+                           : result == BatchSkipped ? "skipped"
+                           : "failed";
+        if (result == BatchFailed)
+            failed.fetchAndAddRelaxed(1);
+
+        fprintf(stdout, "[%d/%d] %s: %s\n",
+                processed.fetchAndAddRelaxed(1) + 1, files.size(),
+                qPrintable(fileName), status);
+        fflush(stdout);
+    });
+
+    fprintf(stdout, "Processed %d files in %lld ms, %d failed\n",
+            files.size(), timer.elapsed(), failed.load());
+
+    return failed.load() ? 1 : 0;
+}
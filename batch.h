@@ -0,0 +1,15 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef BATCH_H
+#define BATCH_H
+
+class QCoreApplication;
+
+// Headless entry points, they run without a display and a sound device
+bool isBatchMode(int argc, char *argv[]);
+int runBatch(const QCoreApplication &app);
+
+#endif // BATCH_H
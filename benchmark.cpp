@@ -0,0 +1,212 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "benchmark.h"
+#include "analysis.h"
+#include "jobcontrol.h"
+#include "playbacksource.h"
+#include "render.h"
+#include "wavfile.h"
+#include "utils.h"
+
+#include <math.h>
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+const int BenchmarkSampleRate = 16000;
+const int FirstAudioBytes     = 4096;
+const QSize RenderSizes[]     = { QSize(800, 200), QSize(1920, 600), QSize(3840, 1200) };
+
+// Sizes in the RIFF header are 32 bit and the one of the RIFF chunk
+// includes 36 bytes of headers
+const qint64 MaxDataBytes = qint64(0xFFFFFFFF) - 36;
+
+static qint64 syntheticDataBytes(int seconds, int channels)
+{
+    return qint64(seconds) * BenchmarkSampleRate * channels * qint64(sizeof(qint16));
+}
+
+// Speech-like test signal: 1.3 s bursts of a gliding tone with some noise,
+// separated by 0.7 s of near silence, every channel with its own level
+static bool writeSyntheticFile(const QString &fileName, int seconds, int channels)
+{
+    const qint64 numFrames = qint64(seconds) * BenchmarkSampleRate;
+    const qint64 dataSize = syntheticDataBytes(seconds, channels);
+    if (dataSize > MaxDataBytes)
+        return false;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData("RIFF", 4);
+    stream << quint32(36 + dataSize);
+    stream.writeRawData("WAVEfmt ", 8);
+    stream << quint32(16) << quint16(1) << quint16(channels)
+           << quint32(BenchmarkSampleRate)
+           << quint32(BenchmarkSampleRate * channels * sizeof(qint16))
+           << quint16(channels * sizeof(qint16)) << quint16(16);
+    stream.writeRawData("data", 4);
+    stream << quint32(dataSize);
+
+    const int chunkFrames = 65536;
+    QVector<qint16> chunk(chunkFrames * channels);
+    quint32 noise = 1;
+    double phase = 0.0;
+    for (qint64 begin = 0; begin < numFrames; begin += chunkFrames) {
+        const int count = qMin(qint64(chunkFrames), numFrames - begin);
+        qint16 *out = chunk.data();
+        for (int i = 0; i < count; ++i) {
+            const double t = double(begin + i) / BenchmarkSampleRate;
+            const bool burst = fmod(t, 2.0) < 1.3;
+            phase += 2 * M_PI * (150 + 100 * sin(M_PI * t)) / BenchmarkSampleRate;
+            noise = noise * 1664525u + 1013904223u;
+            const float white = float(noise >> 8) / (1 << 24) * 2 - 1;
+            const float value = burst ? 0.5f * sin(phase) + 0.05f * white : 0.002f * white;
+            for (int c = 0; c < channels; ++c)
+                *out++ = realToPcm(value * (c + 1) / channels);
+        }
+        stream.writeRawData(reinterpret_cast<const char*>(chunk.constData()),
+                            count * channels * sizeof(qint16));
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+template<typename Function>
+static QJsonObject measure(const QString &stage, int seconds, int channels, int repeat, Function function)
+{
+    QVector<double> times;
+    for (int i = 0; i < repeat; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        times.append(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(times.begin(), times.end());
+
+    double total = 0.0;
+    for (double time : times)
+        total += time;
+    const double median = times[times.size() / 2];
+
+    QJsonObject result;
+    result["stage"] = stage;
+    result["seconds"] = seconds;
+    result["channels"] = channels;
+    result["sample_rate"] = BenchmarkSampleRate;
+    result["runs"] = repeat;
+    result["min_ms"] = times.first();
+    result["median_ms"] = median;
+    result["mean_ms"] = total / times.size();
+    result["realtime_factor"] = median > 0 ? seconds * 1000.0 / median : 0.0;
+
+    fprintf(stderr, "%-24s %6d s %10.2f ms\n", qPrintable(stage), seconds, median);
+    return result;
+}
+
+int runBenchmark(const QList<int> &durations, int channels, int repeat, const QString &output)
+{
+    for (int seconds : durations) {
+        if (syntheticDataBytes(seconds, channels) > MaxDataBytes) {
+            fprintf(stderr, "%d s of %d channels do not fit in a WAV file, at most %lld s do\n",
+                    seconds, channels, MaxDataBytes / syntheticDataBytes(1, channels));
+            return 1;
+        }
+    }
+
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return 1;
+    }
+
+    QJsonArray results;
+    for (int seconds : durations) {
+        const QString fileName = directory.filePath(QString("synthetic-%1s.wav").arg(seconds));
+        if (!writeSyntheticFile(fileName, seconds, channels)) {
+            fprintf(stderr, "Could not write %s\n", qPrintable(fileName));
+            return 1;
+        }
+
+        WavFile file;
+        results.append(measure("open", seconds, channels, repeat, [&] {
+            file.open(fileName);
+        }));
+
+        results.append(measure("normalize", seconds, channels, repeat, [&] {
+            file.normalize();
+        }));
+
+        Analysis analysis;
+        results.append(measure("analysis", seconds, channels, repeat, [&] {
+            analysis.compute(&file);
+        }));
+
+        results.append(measure("cache_save", seconds, channels, repeat, [&] {
+            analysis.save(&file);
+        }));
+
+        results.append(measure("cache_load", seconds, channels, repeat, [&] {
+            analysis.load(&file);
+        }));
+
+        for (const QSize &size : RenderSizes) {
+            QJsonObject result = measure(QString("render_%1x%2").arg(size.width()).arg(size.height()),
+                                         seconds, channels, repeat, [&] {
+                renderWaveform(&file, analysis, size);
+            });
+            results.append(result);
+        }
+
+        // What Engine::loadFile() does before the first buffer reaches the device,
+        // the rest of the file is still being read when playback starts
+        results.append(measure("first_audio", seconds, channels, repeat, [&] {
+            WavFile audio;
+            audio.openHeader(fileName);
+            audio.reservePayload();
+            JobControl control;
+            QVector<ChannelLevels> levels;
+            QFuture<bool> reading = QtConcurrent::run([&] { return audio.readPayload(&control, &levels); });
+            while (audio.loadedLength() < qMin<qint64>(FirstAudioBytes, audio.buffer().size()))
+                QThread::yieldCurrentThread();
+            PlaybackSource source;
+            source.setFile(&audio);
+            source.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+            source.read(FirstAudioBytes);
+            control.cancel();
+            reading.waitForFinished();
+        }));
+
+        analysis.detachFromCache();
+        QFile::remove(Analysis::cachePath(fileName));
+        QFile::remove(fileName);
+    }
+
+    const QByteArray json = QJsonDocument(results).toJson();
+    if (output.isEmpty()) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return 0;
+    }
+
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        fprintf(stderr, "Could not write %s\n", qPrintable(output));
+        return 1;
+    }
+    return 0;
+}
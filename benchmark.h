@@ -0,0 +1,16 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QList>
+#include <QString>
+
+// Times the load, analysis and render stages on synthetic files of the given
+// durations (in seconds) and writes the results as a JSON array
+int runBenchmark(const QList<int> &durations, int channels, int repeat, const QString &output);
+
+#endif // BENCHMARK_H
@@ -4,16 +4,24 @@
 // Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
 
 #include "engine.h"
+#include "analysis.h"
 #include "utils.h"
+#include "vad.h"
+#include "trace.h"
 
 #include <math.h>
 
 #include <QAudioOutput>
 #include <QCoreApplication>
 #include <QDebug>
+#include <QtConcurrent>
 
 const qint64 BufferDurationUs       = 10 * 1000000;
 const int    NotifyIntervalMs       = 100;
+const int    LoadProgressIntervalMs = 100;
+
+// Shorter pauses are kept as they are when silence is skipped
+const double MinSkippedSilenceSeconds = 1.0;
 
 Engine::Engine(QObject *parent)
     :   QObject(parent)
@@ -22,12 +30,21 @@ Engine::Engine(QObject *parent)
     ,   _audioOutputDevice(QAudioDeviceInfo::defaultOutputDevice())
     ,   _audioOutput(0)
     ,   _playPosition(0)
+    ,   _estimateGains(true)
+    ,   _normalization(PeakNormalization)
 {
+    _loadTimer.setInterval(LoadProgressIntervalMs);
+    connect(&_loadTimer, &QTimer::timeout,
+            this, &Engine::loadTimeout);
+    connect(&_reading, &QFutureWatcher<QVector<ChannelLevels>>::finished,
+            this, &Engine::readingFinished);
+    connect(&_silenceDetection, &QFutureWatcher<QVector<QPair<qint64, qint64>>>::finished,
+            this, &Engine::silenceDetectionFinished);
 }
 
 Engine::~Engine()
 {
-
+    cancelLoading();
 }
 
 //-----------------------------------------------------------------------------
@@ -36,31 +53,57 @@ Engine::~Engine()
 
 bool Engine::loadFile(const QString &fileName)
 {
+    ENGINE_TRACE("Engine::loadFile");
     reset();
 
     Q_ASSERT(!_file);
     Q_ASSERT(!fileName.isEmpty());
     _file = new WavFile(this);
-    if (!_file->open(fileName)) {
+    if (!_file->openHeader(fileName)) {
         emit errorMessage(tr("Could not open file"), fileName);
         return false;
     }
 
-    if (_file->format().codec() != "audio/pcm" ||
-        _file->format().sampleType() != QAudioFormat::SignedInt ||
-        _file->format().sampleSize() != 16 ||
-        _file->format().byteOrder() != QAudioFormat::LittleEndian ||
-        _file->format().sampleRate() != 8000 && _file->format().sampleRate() != 16000) {
-        emit errorMessage(tr("Audio format not supported"),
-                          formatToString(_file->format()));
+    QVector<ChannelLevels> levels;
+    if (Analysis::loadLevels(_file, &levels))
+        _file->setLevels(levels);
+    else if (_estimateGains && _file->estimateLevels(&levels))
+        _file->setEstimatedLevels(levels);
+
+    if (!openFile())
         return false;
-    }
 
-    if (!initialize())
-        return false;  // Error message is generated inside
+    // The buffer is allocated here, so it stays put while the worker fills it
+    // and playback reads the beginning
+    _file->reservePayload();
+    _loadControl.reset(new JobControl);
+    _loadControl->setTotal(_file->payloadLength());
+
+    WavFile *file = _file;
+    const JobControlPointer control = _loadControl;
+    _reading.setFuture(QtConcurrent::run([file, control] {
+        QVector<ChannelLevels> levels;
+        file->readPayload(control.data(), &levels);
+        return levels;
+    }));
+    _loadTimer.start();
 
-    emit fileChanged(_file);
+    return true;
+}
+
+bool Engine::setFile(WavFile *file)
+{
+    ENGINE_TRACE("Engine::setFile");
+    reset();
 
+    Q_ASSERT(!_file);
+    _file = file;
+    _file->setParent(this);
+    if (!openFile())
+        return false;
+
+    _loadControl.reset(new JobControl);
+    finishLoading();
     return true;
 }
 
@@ -91,8 +134,8 @@ void Engine::startPlayback()
         setPlayPosition(_playPosition, true);
 
         _audioOutputIODevice.close();
-        _audioOutputIODevice.setData(_file->buffer());
-        _audioOutputIODevice.open(QIODevice::ReadOnly);
+        _audioOutputIODevice.setFile(_file);
+        _audioOutputIODevice.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
         _audioOutputIODevice.seek(_playPosition);
 
         _audioOutput->start(&_audioOutputIODevice);
@@ -107,22 +150,89 @@ void Engine::suspend()
     }
 }
 
+void Engine::setSkipSilence(bool enabled)
+{
+    qCDebug(logEngine) << "Engine::setSkipSilence" << enabled;
+    _audioOutputIODevice.setSkipSilence(enabled);
+}
+
+// Playback follows the new gains smoothly, the display stays peak normalized
+void Engine::setNormalization(Normalization mode)
+{
+    qCDebug(logEngine) << "Engine::setNormalization" << mode;
+    _normalization = mode;
+    if (_file)
+        _file->setNormalization(mode);
+}
+
+void Engine::setLimiter(bool enabled)
+{
+    qCDebug(logEngine) << "Engine::setLimiter" << enabled;
+    _audioOutputIODevice.setLimiter(enabled);
+}
+
+void Engine::setPlaybackChannel(int channel)
+{
+    if (_file && channel >= _file->channelCount())
+        return;
+
+    qCDebug(logEngine) << "Engine::setPlaybackChannel" << channel;
+    _audioOutputIODevice.setChannel(channel);
+}
+
 //-----------------------------------------------------------------------------
 // Private slots
 //-----------------------------------------------------------------------------
 
 void Engine::audioNotify()
 {
-    setPlayPosition(qMin(_file->payloadLength(), _audioOutputIODevice.pos()));
+    ENGINE_TRACE("Engine::audioNotify");
+    ENGINE_COUNTER("playPosition", _audioOutputIODevice.sourcePosition());
+    setPlayPosition(qMin(_file->payloadLength(), _audioOutputIODevice.sourcePosition()));
+
+    // Frames pulled into the device buffer but not heard yet
+    emit outputLatencyChanged((_audioOutput->bufferSize() - _audioOutput->bytesFree())
+                              / _file->format().bytesPerFrame());
+}
+
+void Engine::loadTimeout()
+{
+    if (_loadControl)
+        emit loadProgress(_loadControl->done(), _loadControl->total());
+}
+
+void Engine::readingFinished()
+{
+    _loadTimer.stop();
+    if (!_file || !_loadControl || _loadControl->isCancelled())
+        return;
+
+    const QVector<ChannelLevels> levels = _reading.result();
+    if (levels.isEmpty()) {
+        emit errorMessage(tr("Could not read file"), _file->fileName());
+        return;
+    }
+
+    _file->setLevels(levels);
+    emit loadProgress(_file->payloadLength(), _file->payloadLength());
+    finishLoading();
+}
+
+void Engine::silenceDetectionFinished()
+{
+    if (!_file || !_loadControl || _loadControl->isCancelled())
+        return;
+
+    _audioOutputIODevice.setSilences(_silenceDetection.result());
 }
 
 void Engine::audioStateChanged(QAudio::State state)
 {
-    qDebug() << "Engine::audioStateChanged from" << _state
+    qCDebug(logEngine) << "Engine::audioStateChanged from" << _state
              << "to" << state;
 
     if (QAudio::IdleState == state &&
-            _audioOutputIODevice.pos() == _audioOutputIODevice.size()) {
+            _audioOutputIODevice.sourcePosition() == _audioOutputIODevice.size()) {
         stopPlayback();
     } else {
         if (QAudio::StoppedState == state) {
@@ -140,6 +250,48 @@ void Engine::audioStateChanged(QAudio::State state)
 // Private functions
 //-----------------------------------------------------------------------------
 
+// Checks the format of the opened _file and announces it
+bool Engine::openFile()
+{
+    if (!isFormatSupported(_file->format())) {
+        emit errorMessage(tr("Audio format not supported"),
+                          formatToString(_file->format()));
+        return false;
+    }
+
+    if (!initialize())
+        return false;  // Error message is generated inside
+
+    _file->setNormalization(_normalization);
+    _audioOutputIODevice.setFile(_file);
+    emit fileChanged(_file);
+
+    return true;
+}
+
+// All samples are in, the skip map is computed in the background
+void Engine::finishLoading()
+{
+    ENGINE_TRACE("Engine::finishLoading");
+    emit fileLoaded(_file);
+
+    WavFile *file = _file;
+    _silenceDetection.setFuture(QtConcurrent::run([file] {
+        return detectSilence(file, MinSkippedSilenceSeconds);
+    }));
+}
+
+// Jobs hold the file, so they are waited for before it is deleted
+void Engine::cancelLoading()
+{
+    _loadTimer.stop();
+    if (_loadControl)
+        _loadControl->cancel();
+    _reading.waitForFinished();
+    _silenceDetection.waitForFinished();
+    _loadControl.reset();
+}
+
 void Engine::resetAudioDevices()
 {
     delete _audioOutput;
@@ -149,11 +301,17 @@ void Engine::resetAudioDevices()
 
 void Engine::reset()
 {
+    cancelLoading();
     stopPlayback();
     setState(QAudio::StoppedState);
-    delete _file;
+    _audioOutputIODevice.close();
+    _audioOutputIODevice.setFile(nullptr);
+
+    // Receivers stop their jobs reading the samples before they are freed
+    WavFile *file = _file;
     _file = nullptr;
     emit fileChanged(_file);
+    delete file;
     resetAudioDevices();
 }
 
@@ -162,15 +320,15 @@ bool Engine::initialize()
     if (_audioOutput && _audioOutput->format() == _file->format())
         return true;
 
-    qDebug() << "supportedCodecs:" << _audioOutputDevice.supportedCodecs();
-    qDebug() << "supportedSampleRates:" << _audioOutputDevice.supportedSampleRates();
-    qDebug() << "supportedSampleSizes:" << _audioOutputDevice.supportedSampleSizes();
-    qDebug() << "supportedSampleTypes:" << _audioOutputDevice.supportedSampleTypes();
-    qDebug() << "supportedByteOrders:" << _audioOutputDevice.supportedByteOrders();
-    qDebug() << "supportedChannelCounts:" << _audioOutputDevice.supportedChannelCounts();
+    qCDebug(logEngine) << "supportedCodecs:" << _audioOutputDevice.supportedCodecs();
+    qCDebug(logEngine) << "supportedSampleRates:" << _audioOutputDevice.supportedSampleRates();
+    qCDebug(logEngine) << "supportedSampleSizes:" << _audioOutputDevice.supportedSampleSizes();
+    qCDebug(logEngine) << "supportedSampleTypes:" << _audioOutputDevice.supportedSampleTypes();
+    qCDebug(logEngine) << "supportedByteOrders:" << _audioOutputDevice.supportedByteOrders();
+    qCDebug(logEngine) << "supportedChannelCounts:" << _audioOutputDevice.supportedChannelCounts();
 
     if (!_audioOutputDevice.isFormatSupported(_file->format())) {
-        qCritical() << "notSupportedFormat:" << formatToString(_file->format());
+        qCCritical(logEngine) << "notSupportedFormat:" << formatToString(_file->format());
         emit errorMessage(tr("Audio format not supported"),
                           formatToString(_file->format()));
         return false;
@@ -184,8 +342,8 @@ bool Engine::initialize()
     connect(_audioOutput, &QAudioOutput::notify,
             this, &Engine::audioNotify);
 
-    qDebug() << "Engine::initialize" << "dataLength" << _file->payloadLength();
-    qDebug() << "Engine::initialize" << "format" << _file->format();
+    qCDebug(logEngine) << "Engine::initialize" << "dataLength" << _file->payloadLength();
+    qCDebug(logEngine) << "Engine::initialize" << "format" << _file->format();
 
     return true;
 }
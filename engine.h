@@ -7,13 +7,24 @@
 #define ENGINE_H
 
 #include "wavfile.h"
+#include "jobcontrol.h"
+#include "playbacksource.h"
 
 #include <QAudio>
 #include <QAudioDeviceInfo>
-#include <QBuffer>
+#include <QFutureWatcher>
+#include <QTimer>
 
 class QAudioOutput;
 
+// Plays a file while it is still being loaded: loadFile() reads only the
+// header, the samples are read on a worker thread and the part read so far
+// is playable at once. fileChanged() announces the file, fileLoaded() its
+// complete samples, silence detection follows on its own. Until the exact
+// normalization gains are known from the complete samples, the cached ones
+// are used, or ones estimated from a sparse sample of the file. A null
+// fileChanged() comes before the previous file is deleted, so receivers must
+// stop using it there.
 class Engine : public QObject
 {
     Q_OBJECT
@@ -25,24 +36,49 @@ public:
     QAudio::State state() const { return _state; }
     void reset();
     bool loadFile(const QString &fileName);
+    bool setFile(WavFile *file);
+    const WavFile *file() const { return _file; }
     qint64 playPosition() const { return _playPosition; }
+    int playbackChannel() const { return _audioOutputIODevice.channel(); }
+    bool skipsSilence() const { return _audioOutputIODevice.skipsSilence(); }
+    bool estimatesGains() const { return _estimateGains; }
+    void setEstimateGains(bool enabled) { _estimateGains = enabled; }
+    Normalization normalization() const { return _normalization; }
+    bool limits() const { return _audioOutputIODevice.limits(); }
+
+    // Receives what is played, from the thread of the audio output, as the
+    // device pulls it: outputLatencyChanged() tells how far that is ahead
+    void setMonitor(SampleRing *ring) { _audioOutputIODevice.setMonitor(ring); }
 
 public slots:
     void selectionPositionChanged(qint64 position);
     void startPlayback();
     void suspend();
+    void setPlaybackChannel(int channel);
+    void setSkipSilence(bool enabled);
+    void setNormalization(Normalization mode);
+    void setLimiter(bool enabled);
 
 signals:
     void fileChanged(WavFile* file);
+    void fileLoaded(WavFile* file);
+    void loadProgress(qint64 loaded, qint64 total);
     void stateChanged(QAudio::State state);
     void playPositionChanged(qint64 position);
+    void outputLatencyChanged(int frames);
     void errorMessage(const QString &heading, const QString &detail);
 
 private slots:
     void audioNotify();
     void audioStateChanged(QAudio::State state);
+    void loadTimeout();
+    void readingFinished();
+    void silenceDetectionFinished();
 
 private:
+    bool openFile();
+    void finishLoading();
+    void cancelLoading();
     void resetAudioDevices();
     bool initialize();
     void stopPlayback();
@@ -53,10 +89,16 @@ private:
     QAudio::State _state;
     WavFile *_file;
     QAudioDeviceInfo _audioOutputDevice;
-    QBuffer _audioOutputIODevice;
+    PlaybackSource _audioOutputIODevice;
     QAudioOutput* _audioOutput;
     qint64 _playPosition;
+    bool _estimateGains;
+    Normalization _normalization;
 
+    JobControlPointer _loadControl;
+    QFutureWatcher<QVector<ChannelLevels>> _reading;
+    QFutureWatcher<QVector<QPair<qint64, qint64>>> _silenceDetection;
+    QTimer _loadTimer;
 };
 
 #endif // ENGINE_H
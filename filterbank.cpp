@@ -0,0 +1,126 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "filterbank.h"
+
+#include <math.h>
+
+// Log and mel spectrograms get half the rows of the linear one
+const int BandRows = 64;
+const double LogMinHz = 50.0;
+
+static double hzToMel(double hz)
+{
+    return 2595.0 * log10(1.0 + hz / 700.0);
+}
+
+static double melToHz(double mel)
+{
+    return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+// Centres run from DC (or LogMinHz) up to the highest bin below Nyquist
+FrequencyAxis::FrequencyAxis(FrequencyScale scale, int fftLength, int sampleRate)
+    : _scale(scale)
+    , _rows(scale == LinearScale ? fftLength / 2 : BandRows)
+    , _low(0.0)
+    , _high(0.0)
+{
+    const double highest = (fftLength / 2 - 1) * double(sampleRate) / fftLength;
+    _low = warp(scale == LogScale ? LogMinHz : 0.0);
+    _high = warp(highest);
+}
+
+double FrequencyAxis::rowOf(double frequency) const
+{
+    return (warp(frequency) - _low) / (_high - _low) * (_rows - 1);
+}
+
+double FrequencyAxis::frequencyOf(double row) const
+{
+    return unwarp(_low + row / (_rows - 1) * (_high - _low));
+}
+
+double FrequencyAxis::warp(double frequency) const
+{
+    switch (_scale) {
+    case LogScale:
+        return log(qMax(frequency, LogMinHz));
+    case MelScale:
+        return hzToMel(frequency);
+    default:
+        return frequency;
+    }
+}
+
+double FrequencyAxis::unwarp(double value) const
+{
+    switch (_scale) {
+    case LogScale:
+        return exp(value);
+    case MelScale:
+        return melToHz(value);
+    default:
+        return value;
+    }
+}
+
+Filterbank::Filterbank(const FrequencyAxis &axis, int fftLength, int sampleRate)
+    : _first(axis.rows())
+    , _offsets(axis.rows() + 1)
+{
+    const int bins = fftLength / 2;
+    const double binHz = double(sampleRate) / fftLength;
+    QVector<double> binRows(bins);
+    for (int k = 0; k < bins; ++k)
+        binRows[k] = axis.rowOf(k * binHz);
+
+    QVector<float> weights;
+    for (int line = 0; line < axis.rows(); ++line) {
+        const int row = axis.rows() - 1 - line;
+
+        int first = bins;
+        int last = -1;
+        double sum = 0.0;
+        for (int k = 0; k < bins; ++k) {
+            const double weight = 1.0 - qAbs(binRows[k] - row);
+            if (weight > 0.0) {
+                first = qMin(first, k);
+                last = k;
+                sum += weight;
+            }
+        }
+
+        weights.clear();
+        if (sum > 0.0) {
+            for (int k = first; k <= last; ++k)
+                weights.append(float(qMax(0.0, 1.0 - qAbs(binRows[k] - row)) / sum));
+        } else {
+            const double position = axis.frequencyOf(row) / binHz;
+            first = qBound(0, int(floor(position)), bins - 2);
+            const float fraction = float(qBound(0.0, position - first, 1.0));
+            weights << 1.0f - fraction << fraction;
+        }
+
+        _first[line] = first;
+        _offsets[line] = _weights.size();
+        _weights += weights;
+    }
+    _offsets[axis.rows()] = _weights.size();
+}
+
+void Filterbank::apply(const float *power, float *rows) const
+{
+    const float *weights = _weights.constData();
+    for (int line = 0; line < _first.size(); ++line) {
+        const float *bins = power + _first[line];
+        const int count = _offsets[line + 1] - _offsets[line];
+        const float *row = weights + _offsets[line];
+        float sum = 0.0f;
+        for (int k = 0; k < count; ++k)
+            sum += row[k] * bins[k];
+        rows[line] = sum;
+    }
+}
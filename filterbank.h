@@ -0,0 +1,65 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef FILTERBANK_H
+#define FILTERBANK_H
+
+#include <QVector>
+
+enum FrequencyScale
+{
+    LinearScale,
+    LogScale,
+    MelScale
+};
+
+// Rows of a spectrogram spaced evenly on the scale. Linear rows are the FFT
+// bins themselves, log and mel ones are fewer and fixed in number, log rows
+// start at a few tens of Hz. Row 0 is the lowest one.
+class FrequencyAxis
+{
+public:
+    FrequencyAxis(FrequencyScale scale, int fftLength, int sampleRate);
+
+    FrequencyScale scale() const { return _scale; }
+    int rows() const { return _rows; }
+
+    // Fractional row with its centre at the frequency, and back
+    double rowOf(double frequency) const;
+    double frequencyOf(double row) const;
+
+private:
+    double warp(double frequency) const;
+    double unwarp(double value) const;
+
+private:
+    FrequencyScale _scale;
+    int _rows;
+    double _low;
+    double _high;
+};
+
+// Sparse matrix from the power spectrum of a window to the rows of the axis,
+// top down, so the output is in the order of image lines. Every row is a
+// triangle between the centres of its neighbours, normalized to unit sum, so
+// it holds the mean power of its band. A band narrower than a bin gets the
+// interpolation between the two bins around its centre instead.
+class Filterbank
+{
+public:
+    Filterbank(const FrequencyAxis &axis, int fftLength, int sampleRate);
+
+    int rows() const { return _first.size(); }
+
+    // power holds fftLength / 2 bins, from DC up
+    void apply(const float *power, float *rows) const;
+
+private:
+    QVector<int> _first;
+    QVector<int> _offsets;
+    QVector<float> _weights;
+};
+
+#endif // FILTERBANK_H
@@ -0,0 +1,226 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "formants.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <math.h>
+
+#include <QFile>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+const double WindowSeconds = 0.025;
+
+// Formants above 5 kHz are of no use for vowels, so the samples are brought
+// down to about twice that before the prediction
+const int TargetRate = 11025;
+const int LowpassTapsPerDecimation = 8;
+
+// Two poles per kHz up to Nyquist and two for the spectral tilt
+const int ExtraOrder = 2;
+
+const float PreEmphasis = 0.97f;
+const int EnvelopeLengthPowerOfTwo = 9;
+const float MinFormantHz = 90.0f;
+const float NyquistMarginHz = 50.0f;
+
+static int decimation(int sampleRate)
+{
+    return qMax(1, sampleRate / TargetRate);
+}
+
+static int lowpassTaps(int sampleRate)
+{
+    const int factor = decimation(sampleRate);
+    return factor > 1 ? LowpassTapsPerDecimation * factor + 1 : 1;
+}
+
+static int windowLength(int sampleRate)
+{
+    return qMax(2, qRound(WindowSeconds * sampleRate / decimation(sampleRate)));
+}
+
+FormantTable::FormantTable()
+    : _mapped(nullptr)
+    , _size(0)
+{
+}
+
+void FormantTable::resize(qint64 count)
+{
+    _file.clear();
+    _mapped = nullptr;
+    _owned.resize(int(count));
+    _size = count;
+}
+
+bool FormantTable::map(const QSharedPointer<QFile> &file, qint64 offset, qint64 count)
+{
+    uchar *data = count > 0 ? file->map(offset, count * sizeof(FormantFrame)) : nullptr;
+    if (data == nullptr || quintptr(data) % alignof(FormantFrame) != 0)
+        return false;
+
+    _owned.clear();
+    _file = file;
+    _mapped = reinterpret_cast<const FormantFrame*>(data);
+    _size = count;
+    return true;
+}
+
+void FormantTable::detach()
+{
+    if (!_mapped)
+        return;
+
+    _owned = QVector<FormantFrame>(int(_size));
+    std::copy(_mapped, _mapped + _size, _owned.begin());
+    _file.clear();
+    _mapped = nullptr;
+}
+
+FormantTracker::FormantTracker(int sampleRate)
+    : _hop(hopFrames(sampleRate))
+    , _decimation(decimation(sampleRate))
+    , _rate(sampleRate / decimation(sampleRate))
+    , _order(ExtraOrder + _rate / 1000)
+    , _lowpass(lowpassTaps(sampleRate))
+    , _window(windowLength(sampleRate))
+    , _fft(EnvelopeLengthPowerOfTwo)
+{
+    // Blackman windowed sinc with the cutoff a bit below the new Nyquist
+    const int taps = _lowpass.size();
+    const double cutoff = 0.45 / _decimation;
+    double sum = 0.0;
+    for (int i = 0; i < taps; ++i) {
+        const double t = i - (taps - 1) / 2.0;
+        const double sinc = t == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        const double phase = taps > 1 ? 2.0 * M_PI * i / (taps - 1) : 0.0;
+        const double blackman = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase);
+        _lowpass[i] = float(sinc * blackman);
+        sum += _lowpass[i];
+    }
+    for (float &tap : _lowpass)
+        tap = float(tap / sum);
+
+    for (int i = 0; i < _window.size(); ++i)
+        _window[i] = float(0.54 - 0.46 * cos(2.0 * M_PI * i / (_window.size() - 1)));
+}
+
+int FormantTracker::hopFrames(int sampleRate)
+{
+    return qMax(1, qRound(sampleRate * TrackHopSeconds));
+}
+
+int FormantTracker::spanFrames(int sampleRate)
+{
+    return (windowLength(sampleRate) - 1) * decimation(sampleRate) + lowpassTaps(sampleRate);
+}
+
+qint64 FormantTracker::valueCount(qint64 numFrames, int sampleRate)
+{
+    const int span = spanFrames(sampleRate);
+    return numFrames >= span ? (numFrames - span) / hopFrames(sampleRate) + 1 : 0;
+}
+
+void FormantTracker::track(const qint16 *data, int channels, int channel, float gain,
+                           qint64 first, qint64 last, FormantFrame *out) const
+{
+    ANALYSIS_TRACE("FormantTracker::track");
+    ANALYSIS_COUNTER("formantValues", last - first);
+    const int taps = _lowpass.size();
+    const int length = _window.size();
+    const int span = (length - 1) * _decimation + taps;
+    const int envelopeLength = _fft.length();
+    const int envelopeHalf = envelopeLength / 2;
+    const float binHz = float(_rate) / envelopeLength;
+    const int firstBin = qMax(1, int(ceilf(MinFormantHz / binHz)));
+    const int lastBin = qMin(envelopeHalf - 1, int((_rate / 2 - NyquistMarginHz) / binHz));
+
+    QVarLengthArray<float, 4096> samples(span);
+    QVarLengthArray<float, 1024> windowed(length);
+    QVarLengthArray<double, 64> correlation(_order + 1);
+    QVarLengthArray<double, 64> predictor(_order + 1);
+    QVarLengthArray<double, 64> lastPredictor(_order + 1);
+    QVarLengthArray<float, 1024> coefficients(envelopeLength);
+    QVarLengthArray<float, 1024> spectrum(envelopeLength);
+    QVarLengthArray<float, 1024> scratch(envelopeLength);
+    QVarLengthArray<float, 1024> envelope(envelopeHalf);
+
+    for (qint64 value = first; value < last; ++value) {
+        FormantFrame &row = out[value - first];
+        for (quint16 &frequency : row.frequency)
+            frequency = 0;
+
+        const qint16 *ptr = data + value * _hop * channels + channel;
+        for (int i = 0; i < span; ++i, ptr += channels)
+            samples[i] = pcmToReal(*ptr) * gain;
+
+        // Low-pass and decimate, then pre-emphasize and window
+        double power = 0.0;
+        float previous = 0.0f;
+        for (int n = 0; n < length; ++n) {
+            const float *input = samples.constData() + n * _decimation;
+            float sum = 0.0f;
+            for (int t = 0; t < taps; ++t)
+                sum += _lowpass[t] * input[t];
+            power += double(sum) * sum;
+            windowed[n] = (sum - PreEmphasis * previous) * _window[n];
+            previous = sum;
+        }
+        if (power < TrackSilencePower * length)
+            continue;
+
+        for (int k = 0; k <= _order; ++k) {
+            double sum = 0.0;
+            for (int n = k; n < length; ++n)
+                sum += double(windowed[n]) * windowed[n - k];
+            correlation[k] = sum;
+        }
+
+        // Levinson-Durbin, A(z) = 1 + a1 z^-1 + ... + ap z^-p
+        std::fill(predictor.begin(), predictor.end(), 0.0);
+        predictor[0] = 1.0;
+        double error = correlation[0] * (1.0 + 1e-9);
+        for (int i = 1; i <= _order && error > 0.0; ++i) {
+            double acc = correlation[i];
+            for (int j = 1; j < i; ++j)
+                acc += predictor[j] * correlation[i - j];
+            const double reflection = -acc / error;
+            std::copy(predictor.begin(), predictor.end(), lastPredictor.begin());
+            for (int j = 1; j < i; ++j)
+                predictor[j] = lastPredictor[j] + reflection * lastPredictor[i - j];
+            predictor[i] = reflection;
+            error *= 1.0 - reflection * reflection;
+        }
+
+        // Envelope in dB from the spectrum of the predictor
+        std::fill(coefficients.begin(), coefficients.end(), 0.0f);
+        for (int j = 0; j <= _order; ++j)
+            coefficients[j] = float(predictor[j]);
+        _fft.calculateFFT(spectrum.data(), coefficients.constData(), scratch.data());
+        envelope[0] = -10.0f * log10f(qMax(spectrum[0] * spectrum[0], 1e-20f));
+        for (int k = 1; k < envelopeHalf; ++k) {
+            const float re = spectrum[k];
+            const float im = spectrum[envelopeHalf + k];
+            envelope[k] = -10.0f * log10f(qMax(re * re + im * im, 1e-20f));
+        }
+
+        int found = 0;
+        for (int k = firstBin; k <= lastBin && found < FormantFrame::Count; ++k) {
+            if (envelope[k] <= envelope[k - 1] || envelope[k] < envelope[k + 1])
+                continue;
+
+            const float left = envelope[k - 1];
+            const float middle = envelope[k];
+            const float right = envelope[k + 1];
+            const float curvature = left - 2.0f * middle + right;
+            const float shift = curvature < 0.0f ? qBound(-0.5f, 0.5f * (left - right) / curvature, 0.5f) : 0.0f;
+            row.frequency[found++] = quint16(qRound((k + shift) * binHz));
+        }
+    }
+}
@@ -0,0 +1,83 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef FORMANTS_H
+#define FORMANTS_H
+
+#include <QSharedPointer>
+#include <QVector>
+
+#include "fftreal_wrapper.h"
+
+class QFile;
+
+// One row of the table: F1-F3 in Hz, 0 where not found
+struct FormantFrame
+{
+    static const int Count = 3;
+
+    quint16 frequency[Count];
+};
+
+// Rows are either owned or point into a mapped cache file, which is then
+// kept open for as long as any copy of the table lives
+class FormantTable
+{
+public:
+    FormantTable();
+
+    void resize(qint64 count);
+    bool map(const QSharedPointer<QFile> &file, qint64 offset, qint64 count);
+
+    // Copies mapped rows into owned ones, the file is closed with the last
+    // table mapping it
+    void detach();
+
+    bool isEmpty() const { return _size == 0; }
+    qint64 size() const { return _size; }
+    bool isMapped() const { return _mapped != nullptr; }
+
+    // Only for owned rows
+    FormantFrame *data() { return _owned.data(); }
+    const FormantFrame *constData() const { return _mapped ? _mapped : _owned.constData(); }
+    const FormantFrame &operator[](qint64 i) const { return constData()[i]; }
+
+private:
+    QVector<FormantFrame> _owned;
+    QSharedPointer<QFile> _file;
+    const FormantFrame *_mapped;
+    qint64 _size;
+};
+
+// Formants of a channel by linear prediction. Every hop a window is low-passed
+// and decimated to about 11 kHz, pre-emphasized and Hamming windowed, the
+// predictor comes from its autocorrelation by Levinson-Durbin, and the lowest
+// peaks of the envelope 1 / |A| are the formants. Tracking is const, so one
+// tracker serves all threads.
+class FormantTracker
+{
+public:
+    explicit FormantTracker(int sampleRate);
+
+    // Row i is estimated from frames [i * hop, i * hop + span), so any range
+    // of rows can be computed on its own
+    static int hopFrames(int sampleRate);
+    static int spanFrames(int sampleRate);
+    static qint64 valueCount(qint64 numFrames, int sampleRate);
+
+    void track(const qint16 *data, int channels, int channel, float gain,
+               qint64 first, qint64 last, FormantFrame *out) const;
+
+private:
+    int _hop;
+    int _decimation;
+    int _rate;
+    int _order;
+    QVector<float> _lowpass;
+    QVector<float> _window;
+    FFTRealWrapper _fft;
+};
+
+#endif // FORMANTS_H
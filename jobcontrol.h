@@ -0,0 +1,36 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef JOBCONTROL_H
+#define JOBCONTROL_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QSharedPointer>
+
+// Shared by a background job and its owner: the owner may cancel the job at
+// any time, the job checks it between steps and reports how far it got.
+class JobControl
+{
+public:
+    JobControl() : _cancelled(0), _done(0), _total(0) {}
+
+    void cancel() { _cancelled.store(1); }
+    bool isCancelled() const { return _cancelled.load() != 0; }
+
+    void setTotal(qint64 total) { _total.store(total); }
+    void advance(qint64 amount) { _done.fetchAndAddRelaxed(amount); }
+    qint64 done() const { return _done.load(); }
+    qint64 total() const { return _total.load(); }
+
+private:
+    QAtomicInt _cancelled;
+    QAtomicInteger<qint64> _done;
+    QAtomicInteger<qint64> _total;
+};
+
+typedef QSharedPointer<JobControl> JobControlPointer;
+
+#endif // JOBCONTROL_H
@@ -0,0 +1,381 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "levelmeter.h"
+#include "utils.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+
+// Gating blocks consist of four sub-blocks, so they overlap by 75%
+const double SubBlockSeconds = 0.1;
+const int    SubBlocksPerBlock = 4;
+const double AbsoluteGateLufs = -70.0;
+const double RelativeGateLu = -10.0;
+
+// Filters run side by side, each lane covers whole sub-blocks
+const int Lanes = 8;
+
+// Samples are filtered unscaled
+const double FullScale = 32768.0;
+
+// Filter states decaying over silence are zeroed well before they become
+// denormals, which are slow enough to dominate the pass
+const float DenormalGuard = 1e-20f;
+
+const float  RmsTarget = 0.1f;
+const double LoudnessTarget = -23.0;
+const float  MaxGain = 100.0f;
+
+static void flushDenormals(float *values, int count)
+{
+    for (int i = 0; i < count; ++i)
+        values[i] = qAbs(values[i]) < DenormalGuard ? 0.0f : values[i];
+}
+
+static double powerToLoudness(double power)
+{
+    return -0.691 + 10.0 * log10(power);
+}
+
+static double loudnessToPower(double loudness)
+{
+    return pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+// BS.1770 gating of the mean squares of the blocks
+static float gatedLoudness(const QVector<float> &blocks)
+{
+    const double absoluteGate = loudnessToPower(AbsoluteGateLufs);
+    double sum = 0.0;
+    int count = 0;
+    for (float power : blocks) {
+        if (power > absoluteGate) {
+            sum += power;
+            ++count;
+        }
+    }
+    if (count == 0)
+        return -std::numeric_limits<float>::infinity();
+
+    const double gate = qMax(absoluteGate, sum / count * pow(10.0, RelativeGateLu / 10.0));
+    sum = 0.0;
+    count = 0;
+    for (float power : blocks) {
+        if (power > gate) {
+            sum += power;
+            ++count;
+        }
+    }
+    return count > 0 ? powerToLoudness(sum / count) : -std::numeric_limits<float>::infinity();
+}
+
+QVector<float> normalizationGains(const QVector<ChannelLevels> &levels, Normalization mode)
+{
+    QVector<float> result(levels.size(), 1.0f);
+    for (int c = 0; c < levels.size(); ++c) {
+        const ChannelLevels &level = levels[c];
+        switch (mode) {
+        case PeakNormalization:
+            if (level.peak > 0.0f)
+                result[c] = 1.0f / level.peak;
+            break;
+        case RmsNormalization:
+            if (level.rms > 0.0f)
+                result[c] = qMin(MaxGain, RmsTarget / level.rms);
+            break;
+        case LoudnessNormalization:
+            if (qIsFinite(level.loudness))
+                result[c] = qMin(MaxGain, float(pow(10.0, (LoudnessTarget - level.loudness) / 20.0)));
+            break;
+        }
+    }
+    return result;
+}
+
+LevelMeter::LevelMeter(int channels, int sampleRate)
+    : _channels(channels)
+    , _subBlockFrames(qMax(qint64(1), qint64(sampleRate * SubBlockSeconds)))
+    , _states(channels)
+    , _frames(0)
+    , _stretchFrames(0)
+    , _stretchSubBlocks(0)
+    , _subBlockFill(0)
+{
+    // K-weighting of BS.1770, a high shelf and a high pass, designed for the
+    // sample rate of the file
+    double f0 = 1681.974450955533;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / sampleRate);
+    const double vh = pow(10.0, 3.999843853973347 / 20.0);
+    const double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    _shelf = Biquad {
+        float((vh + vb * k / q + k * k) / a0),
+        float(2.0 * (k * k - vh) / a0),
+        float((vh - vb * k / q + k * k) / a0),
+        float(2.0 * (k * k - 1.0) / a0),
+        float((1.0 - k / q + k * k) / a0)
+    };
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / sampleRate);
+    a0 = 1.0 + k / q + k * k;
+    _highPass = Biquad {
+        1.0f,
+        -2.0f,
+        1.0f,
+        float(2.0 * (k * k - 1.0) / a0),
+        float((1.0 - k / q + k * k) / a0)
+    };
+
+    for (ChannelState &state : _states) {
+        std::fill(state.filter, state.filter + 4, 0.0f);
+        std::fill(state.recent, state.recent + 3, 0.0f);
+        state.min = 0;
+        state.max = 0;
+        state.squares = 0.0;
+        state.weighted = 0.0;
+        state.stretchWeighted = 0.0;
+    }
+}
+
+void LevelMeter::process(const qint16 *frames, qint64 count)
+{
+    while (count > 0) {
+        // Lanes are worth it for a few sub-blocks each, the rest goes one by
+        // one up to the next sub-block boundary
+        const qint64 laneSubBlocks = count / _subBlockFrames / Lanes;
+        if (_subBlockFill == 0 && laneSubBlocks >= 2) {
+            processLanes(frames, laneSubBlocks);
+            frames += laneSubBlocks * Lanes * _subBlockFrames * _channels;
+            count -= laneSubBlocks * Lanes * _subBlockFrames;
+            continue;
+        }
+
+        const qint64 length = qMin(count, _subBlockFrames - _subBlockFill);
+        processSerial(frames, length);
+        frames += length * _channels;
+        count -= length;
+    }
+}
+
+void LevelMeter::restart()
+{
+    for (ChannelState &state : _states) {
+        float power;
+        if (stretchPower(state, &power))
+            state.blocks.append(power);
+
+        std::fill(state.filter, state.filter + 4, 0.0f);
+        state.weighted = 0.0;
+        state.stretchWeighted = 0.0;
+    }
+    _stretchFrames = 0;
+    _stretchSubBlocks = 0;
+    _subBlockFill = 0;
+}
+
+QVector<ChannelLevels> LevelMeter::levels() const
+{
+    QVector<ChannelLevels> result(_channels);
+    for (int c = 0; c < _channels; ++c) {
+        const ChannelState &state = _states[c];
+        QVector<float> blocks = state.blocks;
+        float power;
+        if (stretchPower(state, &power))
+            blocks.append(power);
+
+        result[c] = ChannelLevels {
+            qMax(-pcmToReal(state.min), pcmToReal(state.max)),
+            _frames > 0 ? float(sqrt(state.squares / _frames) / FullScale) : 0.0f,
+            gatedLoudness(blocks)
+        };
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+// Peaks and squares are taken apart from the filters, so the filter loops
+// keep their states in registers, but right after them while the frames are
+// still in the cache
+void LevelMeter::scanPlain(const qint16 *frames, qint64 count)
+{
+    for (int c = 0; c < _channels; ++c) {
+        ChannelState &state = _states[c];
+        int min = state.min;
+        int max = state.max;
+        qint64 squares = 0;
+        const qint16 *ptr = frames + c;
+        for (qint64 i = 0; i < count; ++i, ptr += _channels) {
+            const int value = *ptr;
+            min = qMin(min, value);
+            max = qMax(max, value);
+            squares += value * value;
+        }
+        state.min = min;
+        state.max = max;
+        state.squares += squares;
+    }
+}
+
+// Frames within the open sub-block
+void LevelMeter::processSerial(const qint16 *frames, qint64 count)
+{
+    const Biquad s = _shelf;
+    const Biquad h = _highPass;
+    for (int c = 0; c < _channels; ++c) {
+        ChannelState &state = _states[c];
+        float f0 = state.filter[0], f1 = state.filter[1], f2 = state.filter[2], f3 = state.filter[3];
+        float weighted = 0.0f;
+
+        const qint16 *ptr = frames + c;
+        for (qint64 i = 0; i < count; ++i, ptr += _channels) {
+            const float x = *ptr;
+            const float y = s.b0 * x + f0;
+            f0 = s.b1 * x - s.a1 * y + f1;
+            f1 = s.b2 * x - s.a2 * y;
+            const float z = h.b0 * y + f2;
+            f2 = h.b1 * y - h.a1 * z + f3;
+            f3 = h.b2 * y - h.a2 * z;
+            weighted += z * z;
+        }
+
+        state.filter[0] = f0;
+        state.filter[1] = f1;
+        state.filter[2] = f2;
+        state.filter[3] = f3;
+        flushDenormals(state.filter, 4);
+        state.weighted += weighted;
+    }
+    scanPlain(frames, count);
+
+    _frames += count;
+    _stretchFrames += count;
+    _subBlockFill += count;
+    if (_subBlockFill == _subBlockFrames)
+        closeSubBlock();
+}
+
+// Lanes * laneSubBlocks whole sub-blocks, starting at a sub-block boundary.
+// The first lane continues the filters, the others start a sub-block early
+// from silence, which settles the filters long before their own frames.
+// Sub-blocks are taken a row at a time, one of every lane.
+void LevelMeter::processLanes(const qint16 *frames, qint64 laneSubBlocks)
+{
+    const Biquad s = _shelf;
+    const Biquad h = _highPass;
+    const qint64 stride = _channels;
+    const qint64 subBlockFrames = _subBlockFrames;
+    const qint64 laneStride = laneSubBlocks * subBlockFrames * stride;
+
+    // Filter states of every channel, four runs of Lanes values each
+    QVector<float> states(_channels * 4 * Lanes, 0.0f);
+    for (int c = 0; c < _channels; ++c) {
+        float *f = states.data() + c * 4 * Lanes;
+        for (int k = 0; k < 4; ++k)
+            f[k * Lanes] = _states[c].filter[k];
+
+        for (int l = 1; l < Lanes; ++l) {
+            const qint16 *ptr = frames + l * laneStride - subBlockFrames * stride + c;
+            for (qint64 i = 0; i < subBlockFrames; ++i, ptr += stride) {
+                const float x = *ptr;
+                const float y = s.b0 * x + f[l];
+                f[l] = s.b1 * x - s.a1 * y + f[Lanes + l];
+                f[Lanes + l] = s.b2 * x - s.a2 * y;
+                const float z = h.b0 * y + f[2 * Lanes + l];
+                f[2 * Lanes + l] = h.b1 * y - h.a1 * z + f[3 * Lanes + l];
+                f[3 * Lanes + l] = h.b2 * y - h.a2 * z;
+            }
+        }
+    }
+
+    QVector<float> weighted(_channels * Lanes * laneSubBlocks);
+    for (qint64 j = 0; j < laneSubBlocks; ++j) {
+        const qint16 *row = frames + j * subBlockFrames * stride;
+        for (int c = 0; c < _channels; ++c) {
+            float *state = states.data() + c * 4 * Lanes;
+            float f0[Lanes], f1[Lanes], f2[Lanes], f3[Lanes];
+            float sums[Lanes] = {};
+            std::copy(state, state + Lanes, f0);
+            std::copy(state + Lanes, state + 2 * Lanes, f1);
+            std::copy(state + 2 * Lanes, state + 3 * Lanes, f2);
+            std::copy(state + 3 * Lanes, state + 4 * Lanes, f3);
+
+            const qint16 *ptr = row + c;
+            for (qint64 i = 0; i < subBlockFrames; ++i, ptr += stride) {
+                for (int l = 0; l < Lanes; ++l) {
+                    const float x = ptr[l * laneStride];
+                    const float y = s.b0 * x + f0[l];
+                    f0[l] = s.b1 * x - s.a1 * y + f1[l];
+                    f1[l] = s.b2 * x - s.a2 * y;
+                    const float z = h.b0 * y + f2[l];
+                    f2[l] = h.b1 * y - h.a1 * z + f3[l];
+                    f3[l] = h.b2 * y - h.a2 * z;
+                    sums[l] += z * z;
+                }
+            }
+
+            std::copy(f0, f0 + Lanes, state);
+            std::copy(f1, f1 + Lanes, state + Lanes);
+            std::copy(f2, f2 + Lanes, state + 2 * Lanes);
+            std::copy(f3, f3 + Lanes, state + 3 * Lanes);
+            flushDenormals(state, 4 * Lanes);
+            for (int l = 0; l < Lanes; ++l)
+                weighted[(l * laneSubBlocks + j) * _channels + c] = sums[l];
+        }
+
+        for (int l = 0; l < Lanes; ++l)
+            scanPlain(row + l * laneStride, subBlockFrames);
+    }
+
+    for (int c = 0; c < _channels; ++c) {
+        for (int k = 0; k < 4; ++k)
+            _states[c].filter[k] = states[c * 4 * Lanes + k * Lanes + Lanes - 1];
+    }
+
+    // Sub-blocks are closed in order, as if they were filtered one by one
+    for (qint64 i = 0; i < Lanes * laneSubBlocks; ++i) {
+        for (int c = 0; c < _channels; ++c)
+            _states[c].weighted = weighted[i * _channels + c];
+        _frames += _subBlockFrames;
+        _stretchFrames += _subBlockFrames;
+        closeSubBlock();
+    }
+}
+
+void LevelMeter::closeSubBlock()
+{
+    const double scale = 1.0 / (_subBlockFrames * FullScale * FullScale);
+    for (ChannelState &state : _states) {
+        const float power = state.weighted * scale;
+        if (_stretchSubBlocks >= SubBlocksPerBlock - 1)
+            state.blocks.append((state.recent[0] + state.recent[1] + state.recent[2] + power) / SubBlocksPerBlock);
+
+        state.recent[0] = state.recent[1];
+        state.recent[1] = state.recent[2];
+        state.recent[2] = power;
+        state.stretchWeighted += state.weighted;
+        state.weighted = 0.0;
+    }
+    ++_stretchSubBlocks;
+    _subBlockFill = 0;
+}
+
+// The mean square of a stretch too short for a single block
+bool LevelMeter::stretchPower(const ChannelState &state, float *power) const
+{
+    if (_stretchFrames == 0 || _stretchSubBlocks >= SubBlocksPerBlock)
+        return false;
+
+    *power = (state.stretchWeighted + state.weighted) / (_stretchFrames * FullScale * FullScale);
+    return true;
+}
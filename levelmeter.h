@@ -0,0 +1,87 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef LEVELMETER_H
+#define LEVELMETER_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// Levels of a channel relative to full scale: the sample peak, the RMS and
+// the integrated loudness in LUFS (minus infinity for silence)
+struct ChannelLevels
+{
+    float peak;
+    float rms;
+    float loudness;
+};
+
+enum Normalization
+{
+    PeakNormalization,
+    RmsNormalization,
+    LoudnessNormalization
+};
+
+// Gains bringing every channel to a full scale peak, to -20 dBFS RMS or to
+// -23 LUFS (EBU R128), unknown or silent channels get unity gain
+QVector<float> normalizationGains(const QVector<ChannelLevels> &levels, Normalization mode);
+
+// Measures interleaved 16 bit frames passed in order, in a single pass. The
+// loudness follows ITU-R BS.1770: K-weighting by two biquads, 400 ms blocks
+// overlapped by 75%, gated at -70 LUFS and then at 10 LU below the loudness
+// of the blocks left. Every channel is measured on its own. Long runs are
+// split into lanes filtered side by side, each warmed up on the frames
+// before it, so the filters do not serialize the pass.
+class LevelMeter
+{
+public:
+    LevelMeter(int channels, int sampleRate);
+
+    void process(const qint16 *frames, qint64 count);
+
+    // The next frames do not continue the previous ones, a stretch shorter
+    // than a block counts as a block of its own
+    void restart();
+
+    QVector<ChannelLevels> levels() const;
+
+private:
+    struct Biquad
+    {
+        float b0, b1, b2, a1, a2;
+    };
+
+    struct ChannelState
+    {
+        float filter[4];
+        qint16 min;
+        qint16 max;
+        double squares;
+        double weighted;         // K-weighted squares of the open sub-block
+        double stretchWeighted;  // and of the closed sub-blocks of the stretch
+        float recent[3];         // mean squares of the last closed sub-blocks
+        QVector<float> blocks;   // mean squares of the gating blocks
+    };
+
+    void scanPlain(const qint16 *frames, qint64 count);
+    void processSerial(const qint16 *frames, qint64 count);
+    void processLanes(const qint16 *frames, qint64 laneSubBlocks);
+    void closeSubBlock();
+    bool stretchPower(const ChannelState &state, float *power) const;
+
+private:
+    int _channels;
+    qint64 _subBlockFrames;
+    Biquad _shelf;
+    Biquad _highPass;
+    QVector<ChannelState> _states;
+    qint64 _frames;
+    qint64 _stretchFrames;
+    qint64 _stretchSubBlocks;
+    qint64 _subBlockFill;
+};
+
+#endif // LEVELMETER_H
@@ -0,0 +1,151 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "lzcodec.h"
+
+#include <QVector>
+
+#include <cstring>
+
+const int MinMatch = 4;
+const int MaxOffset = 65535;
+const int HashBits = 12;
+
+// As in LZ4, the block ends with literals and no match starts near the end
+const int LastLiterals = 5;
+const int MatchStartLimit = 12;
+
+// Unmatched stretches are stepped through faster the longer they get
+const int SkipShift = 6;
+
+// Counts that do not fit the nibble of the token continue in bytes
+const int NibbleMax = 15;
+
+static quint32 read32(const uchar *p)
+{
+    quint32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int hash(quint32 value)
+{
+    return int((value * 2654435761u) >> (32 - HashBits));
+}
+
+static void writeCount(QByteArray &out, int count)
+{
+    for (count -= NibbleMax; count >= 255; count -= 255)
+        out.append(char(255));
+    out.append(char(count));
+}
+
+static bool readCount(const uchar *&in, const uchar *end, int &count)
+{
+    uchar value;
+    do {
+        if (in == end || count > (1 << 30))
+            return false;
+        value = *in++;
+        count += value;
+    } while (value == 255);
+    return true;
+}
+
+// A match length of 0 ends the block
+static void writeSequence(QByteArray &out, const uchar *literals, int literalCount, int offset, int matchLength)
+{
+    const int matchCount = matchLength > 0 ? matchLength - MinMatch : 0;
+    out.append(char((qMin(literalCount, NibbleMax) << 4) | qMin(matchCount, NibbleMax)));
+    if (literalCount >= NibbleMax)
+        writeCount(out, literalCount);
+    out.append(reinterpret_cast<const char*>(literals), literalCount);
+    if (matchLength == 0)
+        return;
+
+    out.append(char(offset & 0xff));
+    out.append(char(offset >> 8));
+    if (matchCount >= NibbleMax)
+        writeCount(out, matchCount);
+}
+
+QByteArray lzCompress(const char *data, int size)
+{
+    const uchar *in = reinterpret_cast<const uchar*>(data);
+    QByteArray out;
+    out.reserve(size + size / 255 + 16);
+
+    QVector<int> table(1 << HashBits, -1);
+    const int startLimit = size - MatchStartLimit;
+    const int matchLimit = size - LastLiterals;
+    int anchor = 0;
+    int i = 0;
+    while (i < startLimit) {
+        const quint32 prefix = read32(in + i);
+        const int h = hash(prefix);
+        const int candidate = table[h];
+        table[h] = i;
+        if (candidate < 0 || i - candidate > MaxOffset || read32(in + candidate) != prefix) {
+            i += 1 + ((i - anchor) >> SkipShift);
+            continue;
+        }
+
+        int length = MinMatch;
+        while (i + length < matchLimit && in[candidate + length] == in[i + length])
+            ++length;
+        writeSequence(out, in + anchor, i - anchor, i - candidate, length);
+        i += length;
+        anchor = i;
+    }
+
+    writeSequence(out, in + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool lzDecompress(const char *data, int size, char *out, int outSize)
+{
+    const uchar *in = reinterpret_cast<const uchar*>(data);
+    const uchar *inEnd = in + size;
+    uchar *begin = reinterpret_cast<uchar*>(out);
+    uchar *op = begin;
+    uchar *opEnd = begin + outSize;
+
+    while (in < inEnd) {
+        const int token = *in++;
+        int literals = token >> 4;
+        if (literals == NibbleMax && !readCount(in, inEnd, literals))
+            return false;
+        if (literals > inEnd - in || literals > opEnd - op)
+            return false;
+        memcpy(op, in, literals);
+        op += literals;
+        in += literals;
+        if (in == inEnd)
+            break;
+
+        if (inEnd - in < 2)
+            return false;
+        const int offset = in[0] | (in[1] << 8);
+        in += 2;
+        int length = token & NibbleMax;
+        if (length == NibbleMax && !readCount(in, inEnd, length))
+            return false;
+        length += MinMatch;
+        if (offset == 0 || offset > op - begin || length > opEnd - op)
+            return false;
+
+        // Matches may overlap what they produce, which repeats a short pattern
+        const uchar *match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+        } else {
+            for (int k = 0; k < length; ++k)
+                op[k] = match[k];
+        }
+        op += length;
+    }
+
+    return op == opEnd;
+}
@@ -0,0 +1,20 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include <QByteArray>
+
+// Byte oriented LZ77 in the block format of LZ4: every sequence is a token
+// with the literal count and the match length, the literals and a 16-bit
+// little endian offset of the match. Matches are found greedily through a
+// hash of 4-byte prefixes, which is fast rather than tight.
+QByteArray lzCompress(const char *data, int size);
+
+// Fails on malformed input, or if it does not fill exactly outSize bytes
+bool lzDecompress(const char *data, int size, char *out, int outSize);
+
+#endif // LZCODEC_H
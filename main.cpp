@@ -4,6 +4,8 @@
 // Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
 
 #include "antiannotate.h"
+#include "batch.h"
+#include "trace.h"
 #include <QApplication>
 #include <QCommandLineParser>
 
@@ -39,15 +41,38 @@ void debugOutput(QtMsgType type, const QMessageLogContext &context, const QStrin
     fflush(stderr);
 }
 
+static void setupLogging(const QStringList &arguments)
+{
+    const bool verbose = arguments.contains("-v");
+    verbosity = verbose ? QtDebugMsg : QtCriticalMsg;
+    if (verbose)
+        QLoggingCategory::setFilterRules("antiannotate.*.debug=true");
+    qInstallMessageHandler(debugOutput);
+
+    // Tracing is switched on by the environment to keep arguments untouched
+    Tracer::start(QString::fromLocal8Bit(qgetenv("ANTIANNOTATE_TRACE")));
+}
+
 int main(int argc, char *argv[])
 {
+    if (isBatchMode(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        app.setApplicationName("antiannotate");
+
+        setupLogging(app.arguments());
+        const int result = runBatch(app);
+        Tracer::stop();
+        return result;
+    }
+
     QApplication app(argc, argv);
     app.setApplicationName("antiannotate");
 
-    verbosity = app.arguments().contains("-v") ? QtDebugMsg : QtCriticalMsg;
-    qInstallMessageHandler(debugOutput);
+    setupLogging(app.arguments());
     MainWidget w;
     w.show();
 
-    return app.exec();
+    const int result = app.exec();
+    Tracer::stop();
+    return result;
 }
@@ -0,0 +1,153 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "peakpyramid.h"
+#include "utils.h"
+
+#include <QDataStream>
+
+PeakPyramid::PeakPyramid()
+    : _numFrames(0)
+{
+}
+
+void PeakPyramid::reset(qint64 numFrames)
+{
+    _numFrames = numFrames;
+    _levels.clear();
+    _levels.append(QVector<Bin>((numFrames + BinFrames - 1) / BinFrames));
+}
+
+void PeakPyramid::buildLevels()
+{
+    _levels.resize(1);
+    while (_levels.last().size() > 1) {
+        const int level = _levels.size() - 1;
+        const qint64 binFrames = levelBinFrames(level);
+        const QVector<Bin> &lower = _levels[level];
+
+        QVector<Bin> upper((lower.size() + Fanout - 1) / Fanout);
+        for (int i = 0; i < upper.size(); ++i) {
+            const int first = i * Fanout;
+            const int last = qMin(first + Fanout, lower.size());
+            Bin bin = lower[first];
+            qint64 count = qMin(binFrames, _numFrames - first * binFrames);
+            for (int j = first + 1; j < last; ++j) {
+                const qint64 binCount = qMin(binFrames, _numFrames - j * binFrames);
+                bin = merge(bin, count, lower[j], binCount);
+                count += binCount;
+            }
+            upper[i] = bin;
+        }
+
+        _levels.append(upper);
+    }
+}
+
+qint64 PeakPyramid::levelBinFrames(int level) const
+{
+    qint64 result = BinFrames;
+    for (int i = 0; i < level; ++i)
+        result *= Fanout;
+    return result;
+}
+
+PeakPyramid::Bin PeakPyramid::range(qint64 beginFrame, qint64 endFrame) const
+{
+    beginFrame = qBound(qint64(0), beginFrame, _numFrames);
+    endFrame = qBound(beginFrame, endFrame, _numFrames);
+    if (beginFrame == endFrame)
+        return Bin { 0, 0, 0.0f };
+
+    int level = 0;
+    while (level + 1 < _levels.size() && levelBinFrames(level + 1) <= endFrame - beginFrame)
+        ++level;
+
+    const qint64 binFrames = levelBinFrames(level);
+    const QVector<Bin> &bins = _levels[level];
+    const qint64 first = beginFrame / binFrames;
+    const qint64 last = (endFrame - 1) / binFrames;
+
+    Bin result = bins[first];
+    qint64 count = qMin(binFrames, _numFrames - first * binFrames);
+    for (qint64 i = first + 1; i <= last; ++i) {
+        const qint64 binCount = qMin(binFrames, _numFrames - i * binFrames);
+        result = merge(result, count, bins[i], binCount);
+        count += binCount;
+    }
+
+    return result;
+}
+
+void PeakPyramid::write(QDataStream &stream) const
+{
+    stream << _numFrames << qint32(_levels.size());
+    for (const QVector<Bin> &bins : _levels) {
+        stream << qint32(bins.size());
+        stream.writeRawData(reinterpret_cast<const char*>(bins.constData()), bins.size() * sizeof(Bin));
+    }
+}
+
+bool PeakPyramid::read(QDataStream &stream, qint64 numFrames)
+{
+    qint32 levelCount;
+    stream >> _numFrames >> levelCount;
+    if (stream.status() != QDataStream::Ok || _numFrames != numFrames)
+        return false;
+
+    // The counts come from the cache file, so they must be the ones
+    // buildLevels() gives for the frames before anything is allocated
+    QVector<qint64> sizes;
+    sizes.append((numFrames + BinFrames - 1) / BinFrames);
+    while (sizes.last() > 1)
+        sizes.append((sizes.last() + Fanout - 1) / Fanout);
+    if (levelCount != sizes.size())
+        return false;
+
+    _levels.resize(levelCount);
+    for (int level = 0; level < levelCount; ++level) {
+        qint32 size;
+        stream >> size;
+        if (stream.status() != QDataStream::Ok || size != sizes[level])
+            return false;
+
+        QVector<Bin> &bins = _levels[level];
+        const qint64 length = size * qint64(sizeof(Bin));
+        bins.resize(size);
+        if (stream.readRawData(reinterpret_cast<char*>(bins.data()), length) != length)
+            return false;
+    }
+
+    return true;
+}
+
+PeakPyramid::Bin PeakPyramid::scan(const qint16 *data, int stride, qint64 count)
+{
+    if (count <= 0)
+        return Bin { 0, 0, 0.0f };
+
+    qint16 min = *data;
+    qint16 max = *data;
+    float power = 0.0f;
+    for (qint64 i = 0; i < count; ++i, data += stride) {
+        const qint16 value = *data;
+        min = qMin(min, value);
+        max = qMax(max, value);
+        const float real = pcmToReal(value);
+        power += real * real;
+    }
+
+    return Bin { min, max, power / count };
+}
+
+PeakPyramid::Bin PeakPyramid::merge(const Bin &a, qint64 countA, const Bin &b, qint64 countB)
+{
+    const qint64 count = countA + countB;
+    return Bin {
+        qMin(a.min, b.min),
+        qMax(a.max, b.max),
+        count ? (a.power * countA + b.power * countB) / count : 0.0f
+    };
+}
@@ -0,0 +1,53 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef PEAKPYRAMID_H
+#define PEAKPYRAMID_H
+
+#include <QVector>
+
+class QDataStream;
+
+// Multi-resolution min/max/power summary of a single channel. Level 0 holds
+// one bin per BinFrames frames, every next level merges Fanout bins of the
+// previous one, so any frame range is summarized by a handful of bins.
+class PeakPyramid
+{
+public:
+    static const int BinFrames = 256;
+    static const int Fanout = 4;
+
+    struct Bin
+    {
+        qint16 min;
+        qint16 max;
+        float power;    // mean square of pcmToReal() values, without gain
+    };
+
+    PeakPyramid();
+
+    void reset(qint64 numFrames);
+    Bin *baseBins() { return _levels[0].data(); }
+    void buildLevels();
+
+    qint64 numFrames() const { return _numFrames; }
+    int levelCount() const { return _levels.size(); }
+    qint64 levelBinFrames(int level) const;
+    const QVector<Bin> &level(int level) const { return _levels[level]; }
+
+    Bin range(qint64 beginFrame, qint64 endFrame) const;
+
+    void write(QDataStream &stream) const;
+    bool read(QDataStream &stream, qint64 numFrames);
+
+    static Bin scan(const qint16 *data, int stride, qint64 count);
+    static Bin merge(const Bin &a, qint64 countA, const Bin &b, qint64 countB);
+
+private:
+    qint64 _numFrames;
+    QVector<QVector<Bin>> _levels;
+};
+
+#endif // PEAKPYRAMID_H
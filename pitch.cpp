@@ -0,0 +1,140 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "pitch.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+// Dips of the normalized difference below this are periods
+const float Threshold = 0.15f;
+
+// The window is as long as the longest period, and the lags reach one past
+// it for the interpolation
+static int maxLag(int sampleRate)
+{
+    return qMin(sampleRate / PitchTracker::MinFrequency + 1, (1 << FFTMaxLengthPowerOfTwo) / 2 - 1);
+}
+
+static int fftLengthPowerOfTwo(int frames)
+{
+    int powerOfTwo = FFTMinLengthPowerOfTwo;
+    while ((1 << powerOfTwo) < frames)
+        ++powerOfTwo;
+    return powerOfTwo;
+}
+
+PitchTracker::PitchTracker(int sampleRate)
+    : _sampleRate(sampleRate)
+    , _hop(hopFrames(sampleRate))
+    , _window(maxLag(sampleRate))
+    , _minLag(qMax(2, sampleRate / MaxFrequency))
+    , _maxLag(maxLag(sampleRate))
+    , _fft(fftLengthPowerOfTwo(spanFrames(sampleRate)))
+{
+}
+
+int PitchTracker::hopFrames(int sampleRate)
+{
+    return qMax(1, qRound(sampleRate * TrackHopSeconds));
+}
+
+int PitchTracker::spanFrames(int sampleRate)
+{
+    return 2 * maxLag(sampleRate) + 1;
+}
+
+qint64 PitchTracker::valueCount(qint64 numFrames, int sampleRate)
+{
+    const int span = spanFrames(sampleRate);
+    return numFrames >= span ? (numFrames - span) / hopFrames(sampleRate) + 1 : 0;
+}
+
+void PitchTracker::track(const qint16 *data, int channels, int channel, float gain,
+                         qint64 first, qint64 last, float *out) const
+{
+    ANALYSIS_TRACE("PitchTracker::track");
+    ANALYSIS_COUNTER("pitchValues", last - first);
+    const int length = _fft.length();
+    const int half = length / 2;
+    const int span = 2 * _maxLag + 1;
+
+    QVarLengthArray<float, 4096> segment(length);
+    QVarLengthArray<float, 4096> window(length);
+    QVarLengthArray<float, 4096> segmentSpectrum(length);
+    QVarLengthArray<float, 4096> windowSpectrum(length);
+    QVarLengthArray<float, 4096> product(length);
+    QVarLengthArray<float, 4096> correlation(length);
+    QVarLengthArray<float, 4096> scratch(length);
+    QVarLengthArray<double, 2048> energy(span + 1);
+    QVarLengthArray<float, 2048> difference(_maxLag + 2);
+
+    std::fill(segment.begin() + span, segment.end(), 0.0f);
+    std::fill(window.begin() + _window, window.end(), 0.0f);
+
+    for (qint64 value = first; value < last; ++value) {
+        const qint16 *ptr = data + value * _hop * channels + channel;
+        energy[0] = 0.0;
+        for (int i = 0; i < span; ++i, ptr += channels) {
+            const float real = pcmToReal(*ptr) * gain;
+            segment[i] = real;
+            energy[i + 1] = energy[i] + double(real) * real;
+        }
+
+        const double windowEnergy = energy[_window];
+        if (windowEnergy < TrackSilencePower * _window) {
+            out[value - first] = 0.0f;
+            continue;
+        }
+
+        // Correlation of the window with the segment at every lag, as the
+        // inverse of the window spectrum conjugated times the segment one
+        std::copy(segment.begin(), segment.begin() + _window, window.begin());
+        _fft.calculateFFT(windowSpectrum.data(), window.constData(), scratch.data());
+        _fft.calculateFFT(segmentSpectrum.data(), segment.constData(), scratch.data());
+
+        const float *a = windowSpectrum.constData();
+        const float *b = segmentSpectrum.constData();
+        product[0] = a[0] * b[0];
+        product[half] = a[half] * b[half];
+        for (int k = 1; k < half; ++k) {
+            product[k] = a[k] * b[k] + a[half + k] * b[half + k];
+            product[half + k] = a[k] * b[half + k] - a[half + k] * b[k];
+        }
+        _fft.calculateIFFT(correlation.data(), product.constData(), scratch.data());
+
+        // Cumulative mean normalized difference, 1 at lag 0
+        const float scale = 1.0f / length;
+        double sum = 0.0;
+        difference[0] = 1.0f;
+        for (int lag = 1; lag <= _maxLag + 1; ++lag) {
+            const double lagged = energy[lag + _window] - energy[lag];
+            const double d = qMax(0.0, windowEnergy + lagged - 2.0 * correlation[lag] * scale);
+            sum += d;
+            difference[lag] = sum > 0.0 ? float(d * lag / sum) : 1.0f;
+        }
+
+        int lag = _minLag;
+        while (lag <= _maxLag && difference[lag] >= Threshold)
+            ++lag;
+        if (lag > _maxLag) {
+            out[value - first] = 0.0f;
+            continue;
+        }
+        while (lag < _maxLag && difference[lag + 1] < difference[lag])
+            ++lag;
+
+        // Parabola through the dip and its neighbours
+        const float left = difference[lag - 1];
+        const float middle = difference[lag];
+        const float right = difference[lag + 1];
+        const float curvature = left - 2.0f * middle + right;
+        const float shift = curvature > 0.0f ? qBound(-0.5f, 0.5f * (left - right) / curvature, 0.5f) : 0.0f;
+        out[value - first] = float(_sampleRate / (lag + shift));
+    }
+}
@@ -0,0 +1,46 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef PITCH_H
+#define PITCH_H
+
+#include <QtGlobal>
+
+#include "fftreal_wrapper.h"
+
+// Fundamental frequency of a channel by YIN. Every hop the difference of a
+// window with its lagged copies is computed from the energies and a single
+// FFT cross-correlation, normalized by its cumulative mean, and the first dip
+// below the threshold gives the period. Tracking is const and keeps its
+// buffers on the stack of the caller, so one tracker serves all threads.
+class PitchTracker
+{
+public:
+    // Covers speech and most of singing
+    static const int MinFrequency = 60;
+    static const int MaxFrequency = 800;
+
+    explicit PitchTracker(int sampleRate);
+
+    // Value i is estimated from frames [i * hop, i * hop + span)
+    static int hopFrames(int sampleRate);
+    static int spanFrames(int sampleRate);
+    static qint64 valueCount(qint64 numFrames, int sampleRate);
+
+    // Values [first, last) of one channel of interleaved samples, in Hz or 0
+    // where the window is silent or unvoiced
+    void track(const qint16 *data, int channels, int channel, float gain,
+               qint64 first, qint64 last, float *out) const;
+
+private:
+    int _sampleRate;
+    int _hop;
+    int _window;
+    int _minLag;
+    int _maxLag;
+    FFTRealWrapper _fft;
+};
+
+#endif // PITCH_H
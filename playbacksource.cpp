@@ -0,0 +1,315 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "playbacksource.h"
+#include "samplering.h"
+#include "wavfile.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <math.h>
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+// Pause left of every skipped stretch, half of it on each side
+const double KeptSilenceSeconds = 0.3;
+const double CrossfadeSeconds = 0.01;
+
+// Every step of a gain change covers the remaining difference partly, about
+// a sixth of a second to settle
+const double GainStepSeconds = 0.0025;
+const float  GainStepFactor = 0.1f;
+const float  GainTolerance = 0.001f;
+
+// Frames are limited to the ceiling at once and recover within a release
+// time, so loudness normalized peaks do not clip
+const float  LimiterCeiling = 0.95f;
+const double LimiterReleaseSeconds = 0.1;
+
+const int MonitorChunkFrames = 1024;
+
+// The gain of a frame with the given peak, envelope is the limiter state
+// or null without limiting
+static inline float limiterGain(float peak, float *envelope, float release)
+{
+    if (!envelope)
+        return 1.0f;
+
+    *envelope = qMax(peak, *envelope * release);
+    return *envelope > LimiterCeiling ? LimiterCeiling / *envelope : 1.0f;
+}
+
+// Mixes numFrames interleaved frames from in to out
+static void mixFrames(const qint16 *in, qint64 numFrames, int channels,
+                      const float *gains, int channel, float *envelope, float release, qint16 *out)
+{
+    if (channel >= 0) {
+        const float gain = gains[channel];
+        for (qint64 i = 0; i < numFrames; ++i, in += channels) {
+            float real = pcmToReal(in[channel]) * gain;
+            real *= limiterGain(qAbs(real), envelope, release);
+            const qint16 value = realToPcm(qBound(-1.0f, real, 1.0f));
+            for (int c = 0; c < channels; ++c)
+                *out++ = value;
+        }
+    } else if (channel == PlaybackSource::Downmix) {
+        const float scale = 1.0f / channels;
+        for (qint64 i = 0; i < numFrames; ++i, in += channels) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; ++c)
+                sum += pcmToReal(in[c]) * gains[c];
+            sum *= scale;
+            sum *= limiterGain(qAbs(sum), envelope, release);
+            const qint16 value = realToPcm(qBound(-1.0f, sum, 1.0f));
+            for (int c = 0; c < channels; ++c)
+                *out++ = value;
+        }
+    } else {
+        // All channels share the limiter gain, so their balance is kept
+        QVarLengthArray<float, 8> frame(channels);
+        for (qint64 i = 0; i < numFrames; ++i) {
+            float peak = 0.0f;
+            for (int c = 0; c < channels; ++c) {
+                frame[c] = pcmToReal(*in++) * gains[c];
+                peak = qMax(peak, qAbs(frame[c]));
+            }
+            const float gain = limiterGain(peak, envelope, release);
+            for (int c = 0; c < channels; ++c)
+                *out++ = realToPcm(qBound(-1.0f, frame[c] * gain, 1.0f));
+        }
+    }
+}
+
+// Writes the mono sum of numFrames interleaved frames to the monitor, frames
+// which do not fit are lost to it
+static void feedMonitor(SampleRing *monitor, const qint16 *frames, qint64 numFrames, int channels)
+{
+    float mono[MonitorChunkFrames];
+    const float scale = 1.0f / channels;
+    while (numFrames > 0) {
+        const int count = int(qMin<qint64>(numFrames, MonitorChunkFrames));
+        for (int i = 0; i < count; ++i) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; ++c)
+                sum += pcmToReal(*frames++);
+            mono[i] = sum * scale;
+        }
+        monitor->write(mono, count);
+        numFrames -= count;
+    }
+}
+
+PlaybackSource::PlaybackSource(QObject *parent)
+    :   QIODevice(parent)
+    ,   _file(nullptr)
+    ,   _channel(AllChannels)
+    ,   _skipSilence(0)
+    ,   _sourcePosition(0)
+    ,   _skips(nullptr)
+    ,   _limiter(0)
+    ,   _limiterEnvelope(0.0f)
+    ,   _monitor(nullptr)
+{
+}
+
+PlaybackSource::~PlaybackSource()
+{
+}
+
+void PlaybackSource::setFile(const WavFile *file)
+{
+    // The device is closed when the file changes, nothing reads the maps
+    if (file != _file) {
+        _skips.storeRelease(nullptr);
+        _skipMaps.clear();
+        _gains.clear();
+    }
+    _file = file;
+}
+
+void PlaybackSource::setChannel(int channel)
+{
+    _channel.store(channel);
+}
+
+void PlaybackSource::setSilences(const QVector<QPair<qint64, qint64>> &silences)
+{
+    if (!_file)
+        return;
+
+    // The kept pause is at least as long as the crossfade, so every fade
+    // starts after the previous skip
+    QSharedPointer<SkipMap> map(new SkipMap);
+    const int sampleRate = _file->format().sampleRate();
+    map->fadeFrames = qMax<qint64>(1, qint64(CrossfadeSeconds * sampleRate));
+    const qint64 keptFrames = qMax(2 * map->fadeFrames, qint64(KeptSilenceSeconds * sampleRate));
+
+    for (const QPair<qint64, qint64> &silence : silences) {
+        const qint64 from = silence.first + keptFrames / 2;
+        const qint64 to = silence.second - keptFrames / 2;
+        if (to - from > map->fadeFrames)
+            map->ranges.append(qMakePair(from, to));
+    }
+
+    _skipMaps.append(map);
+    _skips.storeRelease(map.data());
+    qCDebug(logEngine) << "PlaybackSource::setSilences" << "skips" << map->ranges.size();
+}
+
+void PlaybackSource::setSkipSilence(bool enabled)
+{
+    _skipSilence.store(enabled);
+}
+
+void PlaybackSource::setLimiter(bool enabled)
+{
+    _limiter.store(enabled);
+}
+
+void PlaybackSource::setMonitor(SampleRing *ring)
+{
+    _monitor.store(ring);
+}
+
+qint64 PlaybackSource::size() const
+{
+    return _file ? _file->payloadLength() : 0;
+}
+
+bool PlaybackSource::seek(qint64 position)
+{
+    _sourcePosition.store(position);
+    return QIODevice::seek(position);
+}
+
+//-----------------------------------------------------------------------------
+// Protected functions
+//-----------------------------------------------------------------------------
+
+qint64 PlaybackSource::readData(char *data, qint64 maxSize)
+{
+    ENGINE_TRACE("PlaybackSource::readData");
+    ENGINE_COUNTER("readSize", maxSize);
+
+    if (!_file)
+        return -1;
+
+    const int channels = _file->channelCount();
+    const qint64 frameBytes = channels * sizeof(qint16);
+    const qint64 position = _sourcePosition.load();
+    // Only the part loaded so far is played, the rest may still be read
+    const qint64 available = qMin(maxSize, _file->loadedLength() - position);
+    const qint64 maxFrames = available / frameBytes;
+
+    if (available <= 0)
+        return 0;
+
+    if (maxFrames == 0) {
+        // Trailing bytes of a truncated frame, nothing to mix there
+        memcpy(data, _file->buffer().constData() + position, available);
+        _sourcePosition.store(position + available);
+        return available;
+    }
+
+    const qint16 *in = _file->data();
+    qint16 *out = reinterpret_cast<qint16*>(data);
+    const qint64 numFrames = _file->numSamples();
+
+    // Gains settling down are stepped for every few frames mixed
+    bool settling = false;
+    if (_gains.size() != channels) {
+        _gains.resize(channels);
+        for (int c = 0; c < channels; ++c)
+            _gains[c] = _file->gain(c);
+    }
+    for (int c = 0; c < channels; ++c)
+        settling = settling || qAbs(_gains[c] - _file->gain(c)) > GainTolerance * _file->gain(c);
+    const qint64 gainStepFrames = qMax<qint64>(1, qint64(GainStepSeconds * _file->format().sampleRate()));
+    auto stepGains = [&] {
+        settling = false;
+        for (int c = 0; c < channels; ++c) {
+            const float target = _file->gain(c);
+            _gains[c] += (target - _gains[c]) * GainStepFactor;
+            if (qAbs(_gains[c] - target) > GainTolerance * target)
+                settling = true;
+            else
+                _gains[c] = target;
+        }
+    };
+    const float *gains = _gains.constData();
+    float *envelope = _limiter.load() ? &_limiterEnvelope : nullptr;
+    const float release = float(exp(-1.0 / (LimiterReleaseSeconds * _file->format().sampleRate())));
+    const int channel = qMin(_channel.load(), channels - 1);
+
+    // The next skip is the first one not passed yet, looked up every time
+    // since the position may have been changed by seek()
+    static const QVector<QPair<qint64, qint64>> NoSkips;
+    const SkipMap *map = _skips.loadAcquire();
+    const QVector<QPair<qint64, qint64>> &skips = map ? map->ranges : NoSkips;
+    const qint64 fadeFrames = map ? map->fadeFrames : 0;
+    qint64 frame = position / frameBytes;
+    int skip = skips.size();
+    if (_skipSilence.load()) {
+        skip = std::upper_bound(skips.constBegin(), skips.constEnd(), frame,
+                [] (qint64 value, const QPair<qint64, qint64> &range) {
+            return value < range.first;
+        }) - skips.constBegin();
+    }
+
+    qint64 written = 0;
+    while (written < maxFrames && frame < numFrames) {
+        const qint64 fadeBegin = skip < skips.size() ? skips[skip].first - fadeFrames : numFrames;
+        if (frame < fadeBegin) {
+            qint64 count = qMin(fadeBegin - frame, maxFrames - written);
+            if (settling)
+                count = qMin(count, gainStepFrames);
+            mixFrames(in + frame * channels, count, channels, gains, channel, envelope, release,
+                      out + written * channels);
+            written += count;
+            frame += count;
+            if (settling)
+                stepGains();
+            continue;
+        }
+
+        // Frames before the skip fade out while the ones before its end fade in,
+        // so playback continues seamlessly from the end
+        const QPair<qint64, qint64> &range = skips[skip];
+        const qint64 count = qMin(range.first - frame, maxFrames - written);
+        QVarLengthArray<qint16, 4096> blend(count * channels);
+        for (qint64 i = 0; i < count; ++i) {
+            const float weight = float(frame + i - fadeBegin + 1) / (fadeFrames + 1);
+            const qint16 *fadeOut = in + (frame + i) * channels;
+            const qint16 *fadeIn = in + (frame + i + range.second - range.first) * channels;
+            for (int c = 0; c < channels; ++c)
+                blend[i * channels + c] = qint16(qRound(fadeOut[c] * (1.0f - weight) + fadeIn[c] * weight));
+        }
+        mixFrames(blend.constData(), count, channels, gains, channel, envelope, release,
+                  out + written * channels);
+        written += count;
+        frame += count;
+        if (settling)
+            stepGains();
+
+        if (frame == range.first) {
+            frame = range.second;
+            ++skip;
+        }
+    }
+
+    SampleRing *monitor = _monitor.load();
+    if (monitor)
+        feedMonitor(monitor, out, written, channels);
+
+    _sourcePosition.store(frame * frameBytes);
+    return written * frameBytes;
+}
+
+qint64 PlaybackSource::writeData(const char * /*data*/, qint64 /*maxSize*/)
+{
+    return -1;
+}
@@ -0,0 +1,90 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef PLAYBACKSOURCE_H
+#define PLAYBACKSOURCE_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QIODevice>
+#include <QPair>
+#include <QSharedPointer>
+#include <QVector>
+
+class SampleRing;
+class WavFile;
+
+// Streams the payload of a WavFile to the audio output, applying the channel
+// gains and routing either all channels, a single one or their downmix.
+// Silent stretches can be shortened to a brief pause, the cuts are
+// crossfaded. The device position then counts the bytes played, while
+// sourcePosition() is the position in the file. Gains changed during
+// playback are approached in small steps instead of at once. An optional
+// limiter keeps the peaks raised by loudness normalization below full scale.
+// The mono sum of the frames played can be fed to a monitor ring, when the
+// device pulls them, so a device buffer ahead of what is heard.
+class PlaybackSource : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    enum Channel {
+        AllChannels = -1,
+        Downmix = -2
+    };
+
+    explicit PlaybackSource(QObject *parent = 0);
+    ~PlaybackSource();
+
+    void setFile(const WavFile *file);
+    int channel() const { return _channel.load(); }
+    void setChannel(int channel);
+
+    // Frame ranges, precomputed once per file, may be set during playback
+    void setSilences(const QVector<QPair<qint64, qint64>> &silences);
+    bool skipsSilence() const { return _skipSilence.load(); }
+    void setSkipSilence(bool enabled);
+    qint64 sourcePosition() const { return _sourcePosition.load(); }
+    bool limits() const { return _limiter.load(); }
+    void setLimiter(bool enabled);
+    void setMonitor(SampleRing *ring);
+
+    // QIODevice
+    bool isSequential() const override { return false; }
+    qint64 size() const override;
+    bool seek(qint64 position) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    const WavFile *_file;
+    QAtomicInt _channel;
+    QAtomicInt _skipSilence;
+    QAtomicInteger<qint64> _sourcePosition;
+
+    // Frames [first, second) replaced by a crossfade ending at second
+    struct SkipMap
+    {
+        QVector<QPair<qint64, qint64>> ranges;
+        qint64 fadeFrames;
+    };
+
+    // Maps are built aside and published whole, the audio thread may still
+    // read a previous one, so all of them are kept until the file changes
+    QAtomicPointer<const SkipMap> _skips;
+    QVector<QSharedPointer<const SkipMap>> _skipMaps;
+
+    // Applied to the last frames read, empty for a new file
+    QVector<float> _gains;
+    QAtomicInt _limiter;
+    float _limiterEnvelope;
+
+    QAtomicPointer<SampleRing> _monitor;
+};
+
+#endif // PLAYBACKSOURCE_H
@@ -0,0 +1,220 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "prefetcher.h"
+#include "wavfile.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QThread>
+#include <QtConcurrent>
+
+const qint64 DefaultMemoryLimit = qint64(1) << 30;
+
+// Samples plus their peaks and spectrograms take about twice the file, the
+// levels of a linear spectrogram alone are half of it at most
+const int EstimatedSizeFactor = 2;
+
+static qint64 analysisBytes(const Analysis &analysis)
+{
+    qint64 result = 0;
+    for (int c = 0; c < analysis.channelCount(); ++c) {
+        result += analysis.spectrum(c).memoryBytes();
+        result += analysis.pitch(c).size() * sizeof(float);
+        result += analysis.formants(c).size() * sizeof(FormantFrame);
+        for (int i = 0; i < analysis.peaks(c).levelCount(); ++i)
+            result += analysis.peaks(c).level(i).size() * sizeof(PeakPyramid::Bin);
+    }
+    return result;
+}
+
+Prefetcher::Prefetcher(QObject *parent)
+    :   QObject(parent)
+    ,   _memoryLimit(DefaultMemoryLimit)
+    ,   _memoryUsed(0)
+{
+    connect(&_loading, &QFutureWatcher<Entry>::finished,
+            this, &Prefetcher::loadFinished);
+}
+
+Prefetcher::~Prefetcher()
+{
+    if (_loadingControl)
+        _loadingControl->cancel();
+    _loading.waitForFinished();
+    finishLoading();
+    while (!_ready.isEmpty())
+        drop(0);
+}
+
+void Prefetcher::setMemoryLimit(qint64 bytes)
+{
+    _memoryLimit = bytes;
+    setQueue(_queue);
+}
+
+void Prefetcher::setQueue(const QStringList &fileNames)
+{
+    _queue = fileNames;
+
+    if (!_loadingName.isEmpty() && !_queue.contains(_loadingName))
+        _loadingControl->cancel();
+
+    for (int i = _ready.size() - 1; i >= 0; --i) {
+        if (!_queue.contains(_ready[i].fileName))
+            drop(i);
+    }
+
+    // A lowered limit evicts the files wanted last
+    while (_memoryUsed > _memoryLimit && !_ready.isEmpty()) {
+        int last = 0;
+        for (int i = 1; i < _ready.size(); ++i) {
+            if (_queue.indexOf(_ready[i].fileName) > _queue.indexOf(_ready[last].fileName))
+                last = i;
+        }
+        drop(last);
+    }
+
+    startNext();
+}
+
+bool Prefetcher::take(const QString &fileName, WavFile **file, Analysis *analysis)
+{
+    if (_loadingName == fileName) {
+        if (!_loading.isFinished()) {
+            qCDebug(logEngine) << "Prefetcher::take" << "cancelled" << fileName;
+            _loadingControl->cancel();
+            return false;
+        }
+        finishLoading();
+    }
+
+    for (int i = 0; i < _ready.size(); ++i) {
+        if (_ready[i].fileName == fileName) {
+            const Entry entry = _ready.takeAt(i);
+            _memoryUsed -= entry.bytes;
+            *file = entry.file;
+            *analysis = entry.analysis;
+            qCDebug(logEngine) << "Prefetcher::take" << fileName;
+            startNext();
+            return true;
+        }
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+// Private slots
+//-----------------------------------------------------------------------------
+
+void Prefetcher::loadFinished()
+{
+    finishLoading();
+    startNext();
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+// Runs on a worker thread, the file is pushed to the thread of the prefetcher
+// afterwards, since only the owning thread may do that
+Prefetcher::Entry Prefetcher::load(const QString &fileName, QThread *target, JobControl *control)
+{
+    ENGINE_TRACE("Prefetcher::load");
+    Entry entry { fileName, new WavFile, Analysis(), 0 };
+    QVector<ChannelLevels> levels;
+    bool ok = entry.file->openHeader(fileName) && isFormatSupported(entry.file->format());
+    if (ok) {
+        entry.file->reservePayload();
+        ok = entry.file->readPayload(control, &levels);
+    }
+    if (ok) {
+        entry.file->setLevels(levels);
+        if (!entry.analysis.load(entry.file)) {
+            entry.analysis.compute(entry.file, Analysis::AllProducts, control);
+            if (!entry.analysis.isEmpty())
+                entry.analysis.save(entry.file);
+        }
+        ok = !entry.analysis.isEmpty();
+    }
+
+    if (!ok) {
+        delete entry.file;
+        entry.file = nullptr;
+        return entry;
+    }
+
+    entry.bytes = entry.file->buffer().size() + analysisBytes(entry.analysis);
+    entry.file->moveToThread(target);
+    return entry;
+}
+
+// Takes the result of the running load, if there is one
+void Prefetcher::finishLoading()
+{
+    if (_loadingName.isEmpty() || !_loading.isFinished())
+        return;
+
+    Entry entry = _loading.result();
+    const bool cancelled = _loadingControl->isCancelled();
+    _loadingName.clear();
+    _loadingControl.reset();
+
+    if (entry.file == nullptr && cancelled)
+        return;
+
+    if (entry.file == nullptr) {
+        qCWarning(logEngine) << "Prefetcher::finishLoading" << "failed" << entry.fileName;
+        _failed.insert(entry.fileName);
+        return;
+    }
+
+    if (!_queue.contains(entry.fileName)) {
+        delete entry.file;
+        return;
+    }
+
+    qCDebug(logEngine) << "Prefetcher::finishLoading" << entry.fileName << "bytes" << entry.bytes;
+    _memoryUsed += entry.bytes;
+    _ready.append(entry);
+    emit prefetched(entry.fileName);
+}
+
+// Queued files are loaded in order, the first one which does not fit stops
+// prefetching, so a large file is not overtaken by the ones after it
+void Prefetcher::startNext()
+{
+    if (!_loadingName.isEmpty())
+        return;
+
+    for (const QString &fileName : _queue) {
+        if (_failed.contains(fileName))
+            continue;
+
+        bool ready = false;
+        for (const Entry &entry : _ready)
+            ready = ready || entry.fileName == fileName;
+        if (ready)
+            continue;
+
+        if (_memoryUsed + QFileInfo(fileName).size() * EstimatedSizeFactor > _memoryLimit)
+            return;
+
+        _loadingName = fileName;
+        _loadingControl.reset(new JobControl);
+        _loading.setFuture(QtConcurrent::run(&Prefetcher::load, fileName, thread(), _loadingControl.data()));
+        return;
+    }
+}
+
+void Prefetcher::drop(int index)
+{
+    const Entry entry = _ready.takeAt(index);
+    _memoryUsed -= entry.bytes;
+    delete entry.file;
+}
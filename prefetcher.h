@@ -0,0 +1,77 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <QFutureWatcher>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+#include "analysis.h"
+#include "jobcontrol.h"
+
+class QThread;
+class WavFile;
+
+// Opens and analyzes the files which are going to be played next on a worker
+// thread, one at a time, while they fit into the memory limit. Prefetched
+// files are kept until they are taken or are not queued anymore, a file
+// which drops out of the queue while it is loaded is cancelled.
+class Prefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Prefetcher(QObject *parent = 0);
+    ~Prefetcher();
+
+    qint64 memoryLimit() const { return _memoryLimit; }
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryUsed() const { return _memoryUsed; }
+
+    // Files wanted next, the most wanted first
+    void setQueue(const QStringList &fileNames);
+
+    // Hands a prefetched file over to the caller, who owns it then. A file
+    // which is still being loaded is cancelled instead, so the caller never
+    // waits and loads it on its own.
+    bool take(const QString &fileName, WavFile **file, Analysis *analysis);
+
+signals:
+    void prefetched(const QString &fileName);
+
+private slots:
+    void loadFinished();
+
+private:
+    struct Entry
+    {
+        QString fileName;
+        WavFile *file;
+        Analysis analysis;
+        qint64 bytes;
+    };
+
+    static Entry load(const QString &fileName, QThread *target, JobControl *control);
+    void finishLoading();
+    void startNext();
+    void drop(int index);
+
+private:
+    QStringList _queue;
+    QList<Entry> _ready;
+    QSet<QString> _failed;
+    qint64 _memoryLimit;
+    qint64 _memoryUsed;
+
+    QFutureWatcher<Entry> _loading;
+    QString _loadingName;
+    JobControlPointer _loadingControl;
+};
+
+#endif // PREFETCHER_H
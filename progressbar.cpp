@@ -5,14 +5,15 @@
 
 #include "progressbar.h"
 #include "wavfile.h"
+#include "trace.h"
 #include <QPainter>
 #include <QMouseEvent>
-#include <QDebug>
 
 ProgressBar::ProgressBar(QWidget *parent)
     :   QWidget(parent)
     ,   _multiplier(0)
     ,   _bufferLength(0)
+    ,   _loadedLength(0)
     ,   _playPosition(0)
 {
     setAutoFillBackground(false);
@@ -24,10 +25,16 @@ ProgressBar::~ProgressBar()
 
 void ProgressBar::paintEvent(QPaintEvent * /*event*/)
 {
+    PAINT_TRACE("ProgressBar::paintEvent");
     QPainter painter(this);
 
     const int pos = static_cast<qreal>(_playPosition) / _bufferLength * width();
     painter.fillRect(rect(), QColor(0, 0, 0, 0));
+    if (_loadedLength < _bufferLength) {
+        // The part which is not loaded yet is shaded
+        const int loaded = static_cast<qreal>(_loadedLength) / _bufferLength * width();
+        painter.fillRect(loaded, 0, width() - loaded, height(), QColor(0, 0, 0, 96));
+    }
     painter.setPen(QPen(Qt::white));
     painter.drawLine(pos, 0, pos, height());
     painter.drawText(0, 0, width(), height(), 0, QString("%0/%1")
@@ -48,14 +55,22 @@ void ProgressBar::fileChanged(WavFile* file)
         _multiplier = file->format().sampleRate() * file->format().channelCount() * file->format().sampleSize() / 8;
         _playPosition = 0;
         _bufferLength = file->payloadLength();
+        _loadedLength = file->loadedLength();
     } else {
         _multiplier = 0;
         _playPosition = 0;
         _bufferLength = 0;
+        _loadedLength = 0;
     }
     update();
 }
 
+void ProgressBar::loadProgressChanged(qint64 loaded, qint64 /*total*/)
+{
+    _loadedLength = loaded;
+    update();
+}
+
 void ProgressBar::playPositionChanged(qint64 playPosition)
 {
     Q_ASSERT(playPosition >= 0);
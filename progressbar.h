@@ -24,6 +24,7 @@ public:
 public slots:
     void fileChanged(WavFile* file);
     void playPositionChanged(qint64 playPosition);
+    void loadProgressChanged(qint64 loaded, qint64 total);
 
 signals:
     void selectionPositionChanged(qint64 position);
@@ -31,6 +32,7 @@ signals:
 private:
     qint64 _playPosition;
     qint64 _bufferLength;
+    qint64 _loadedLength;
     qint64 _multiplier;
 };
 
@@ -0,0 +1,242 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "render.h"
+#include "analysis.h"
+#include "formants.h"
+#include "pitch.h"
+#include "wavfile.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const QRgb WaveformColor = qRgb(255, 255, 255);
+const QRgb PitchColor = qRgb(255, 200, 0);
+const QRgb FormantColor = qRgb(255, 64, 64);
+
+// Pixels are written straight into the bits of an RGB32 image, a pixel
+// column at a time, so nothing goes through QPainter
+class Raster
+{
+public:
+    explicit Raster(QImage &image)
+        : _bits(reinterpret_cast<QRgb*>(image.bits()))
+        , _stride(image.bytesPerLine() / sizeof(QRgb))
+    {
+    }
+
+    QRgb *pixel(int x, int y) const { return _bits + qint64(y) * _stride + x; }
+    int stride() const { return _stride; }
+
+    // Both ends are included, in either order
+    void fillColumn(int x, int y0, int y1, QRgb color) const
+    {
+        QRgb *out = pixel(x, qMin(y0, y1));
+        for (int y = qMin(y0, y1); y <= qMax(y0, y1); ++y, out += _stride)
+            *out = color;
+    }
+
+private:
+    QRgb *_bits;
+    int _stride;
+};
+
+static quint32 sumBytes(const uchar *data, int count)
+{
+    quint32 sum = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    // Sums of absolute differences against zero add up 16 bytes at once
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(bytes, zero));
+    }
+    sum = quint32(_mm_cvtsi128_si32(sums)) + quint32(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+#endif
+    for (; i < count; ++i)
+        sum += data[i];
+    return sum;
+}
+
+// Peaks of every pixel column as a vertical span, from the pyramid or from
+// the samples themselves when the column is narrower than a bin
+static void drawPeaks(const Raster &raster, const WavFile *file, const PeakPyramid &peaks, int channel,
+                      qint64 numFrames, int width, int top, int height)
+{
+    const int channels = file->channelCount();
+    const float gain = file->peakGain(channel);
+    for (int x = 0; x < width; ++x) {
+        const qint64 begin = numFrames * x / width;
+        const qint64 end = qMin(qMax(begin + 1, numFrames * (x + 1) / width), numFrames);
+        const PeakPyramid::Bin bin = end - begin < PeakPyramid::BinFrames
+                ? PeakPyramid::scan(file->data() + begin * channels + channel, channels, end - begin)
+                : peaks.range(begin, end);
+
+        const float min = qBound(-1.0f, pcmToReal(bin.min) * gain, 1.0f);
+        const float max = qBound(-1.0f, pcmToReal(bin.max) * gain, 1.0f);
+        raster.fillColumn(x, top + qMin(static_cast<int>((1.0f - max) / 2 * height), height - 1),
+                          top + qMin(static_cast<int>((1.0f - min) / 2 * height), height - 1), WaveformColor);
+    }
+}
+
+// Box filter in both directions: every pixel gets the mean level of the
+// spectrum columns and rows under it, or the nearest one where the area is
+// larger than the spectrum. Levels are dB, so it is the geometric mean of
+// the power. Columns only move forward, so every tile is unpacked once.
+static void drawSpectrum(const Raster &raster, const Spectrogram &spectrum, const QVector<QRgb> &colors,
+                         const QRect &area)
+{
+    if (spectrum.isEmpty() || area.isEmpty())
+        return;
+
+    const int width = area.width();
+    const int height = area.height();
+    const int rows = spectrum.height();
+    QVector<int> firstRow(height), lastRow(height);
+    for (int y = 0; y < height; ++y) {
+        firstRow[y] = qMin(rows - 1, static_cast<int>(qint64(rows) * y / height));
+        lastRow[y] = qMax(firstRow[y] + 1, static_cast<int>(qint64(rows) * (y + 1) / height));
+    }
+
+    QVector<quint64> sums(rows);
+    QByteArray buffer;
+    int current = -1;
+    const uchar *levels = nullptr;
+    for (int x = 0; x < width; ++x) {
+        const int begin = qMin(spectrum.width() - 1, static_cast<int>(qint64(spectrum.width()) * x / width));
+        const int end = qMax(begin + 1, static_cast<int>(qint64(spectrum.width()) * (x + 1) / width));
+
+        sums.fill(0);
+        for (int column = begin; column < end; ) {
+            const int tile = column / Spectrogram::TileColumns;
+            const int offset = column % Spectrogram::TileColumns;
+            const int count = qMin(end - column, Spectrogram::TileColumns - offset);
+            if (tile != current) {
+                levels = spectrum.tile(tile, &buffer);
+                current = tile;
+            }
+            for (int j = 0; j < rows; ++j)
+                sums[j] += sumBytes(levels + j * Spectrogram::TileColumns + offset, count);
+            column += count;
+        }
+
+        QRgb *out = raster.pixel(area.left() + x, area.top());
+        for (int y = 0; y < height; ++y, out += raster.stride()) {
+            quint64 sum = 0;
+            for (int j = firstRow[y]; j < lastRow[y]; ++j)
+                sum += sums[j];
+            const quint64 count = quint64(end - begin) * (lastRow[y] - firstRow[y]);
+            *out = colors[(sum + count / 2) / count];
+        }
+    }
+}
+
+// Every column gets the mean of the voiced values under it on a log scale,
+// when at least half of them are voiced. Unvoiced columns break the line.
+static void drawPitch(const Raster &raster, const QVector<float> &pitch, int sampleRate,
+                      qint64 numFrames, const QRect &area)
+{
+    if (pitch.isEmpty() || area.isEmpty())
+        return;
+
+    const qint64 hop = PitchTracker::hopFrames(sampleRate);
+    const qint64 center = PitchTracker::spanFrames(sampleRate) / 2;
+    const float logMin = log2f(PitchTracker::MinFrequency);
+    const float logRange = log2f(PitchTracker::MaxFrequency) - logMin;
+    const int width = area.width();
+
+    int previousY = -1;
+    for (int x = 0; x < width; ++x) {
+        const qint64 begin = qMax(qint64(0), numFrames * x / width - center);
+        const qint64 end = qMax(qint64(0), numFrames * (x + 1) / width - center);
+        const int first = int(qMin(qint64(pitch.size()), (begin + hop - 1) / hop));
+        const int last = int(qMin(qint64(pitch.size()), qMax(first + qint64(1), (end + hop - 1) / hop)));
+
+        float sum = 0.0f;
+        int voiced = 0;
+        for (int i = first; i < last; ++i) {
+            if (pitch[i] > 0.0f) {
+                sum += log2f(pitch[i]);
+                ++voiced;
+            }
+        }
+
+        if (voiced == 0 || voiced * 2 < last - first) {
+            previousY = -1;
+            continue;
+        }
+
+        // The step from the previous column is a span of this one
+        const float position = qBound(0.0f, (sum / voiced - logMin) / logRange, 1.0f);
+        const int y = area.bottom() - static_cast<int>(position * (area.height() - 1));
+        raster.fillColumn(area.left() + x, previousY < 0 ? y : previousY, y, PitchColor);
+        previousY = y;
+    }
+}
+
+// Dots on the frequency axis of the spectrum image, from the row nearest to
+// the middle of every column
+static void drawFormants(const Raster &raster, const FormantTable &formants, const FrequencyAxis &axis,
+                         int sampleRate, qint64 numFrames, const QRect &area)
+{
+    if (formants.isEmpty() || area.isEmpty())
+        return;
+
+    const qint64 hop = FormantTracker::hopFrames(sampleRate);
+    const qint64 center = FormantTracker::spanFrames(sampleRate) / 2;
+    const int width = area.width();
+    const int rows = axis.rows();
+
+    for (int x = 0; x < width; ++x) {
+        const qint64 middle = numFrames * (2 * x + 1) / (2 * width);
+        const qint64 row = qBound(qint64(0), (middle - center + hop / 2) / hop, formants.size() - 1);
+        for (quint16 frequency : formants[row].frequency) {
+            const double position = rows - 0.5 - axis.rowOf(frequency);
+            if (frequency > 0 && position >= 0.0 && position < rows) {
+                const int y = area.top() + static_cast<int>(position / rows * area.height());
+                *raster.pixel(area.left() + x, y) = FormantColor;
+            }
+        }
+    }
+}
+
+QImage renderWaveform(const WavFile *file, const Analysis &analysis, const QSize &size,
+                      const SpectrumDisplay &display)
+{
+    WAVEFORM_TRACE("renderWaveform");
+    QImage image(size, QImage::Format_RGB32);
+    image.fill(Qt::black);
+    if (analysis.isEmpty() || size.isEmpty() || size.height() < 2 * analysis.channelCount())
+        return image;
+
+    const int channels = analysis.channelCount();
+    const qint64 numFrames = analysis.numFrames();
+    const int width = size.width();
+    const int laneHeight = size.height() / channels;
+    const int half = laneHeight / 2;
+    const int sampleRate = file->format().sampleRate();
+    const FrequencyAxis axis(analysis.frequencyScale(), Analysis::spectrumLength(), sampleRate);
+    const QVector<QRgb> colors = spectrumColors(display);
+    const Raster raster(image);
+
+    for (int c = 0; c < channels; ++c) {
+        const int top = c * laneHeight;
+        drawPeaks(raster, file, analysis.peaks(c), c, numFrames, width, top, half);
+
+        const QRect spectrumArea(0, top + half, width, laneHeight - half);
+        drawSpectrum(raster, analysis.spectrum(c), colors, spectrumArea);
+        drawFormants(raster, analysis.formants(c), axis, sampleRate, numFrames, spectrumArea);
+        drawPitch(raster, analysis.pitch(c), sampleRate, numFrames, spectrumArea);
+    }
+
+    return image;
+}
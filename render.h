@@ -0,0 +1,26 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <QImage>
+
+#include "spectrumdisplay.h"
+
+class Analysis;
+class WavFile;
+
+// Draws channel lanes (waveform on top, spectrum below with low frequencies
+// at the bottom) of the whole file, the spectrum coloured as the display says.
+// The pitch contour goes over the spectrum on a log scale of its own, from
+// PitchTracker::MinFrequency at the bottom to MaxFrequency at the top.
+// Formants are dots on the frequency axis of the spectrum itself.
+// Pixels are written directly, the spectrum box filtered down to the size.
+// Only QImage is touched, so it is safe for worker threads and headless runs.
+QImage renderWaveform(const WavFile *file, const Analysis &analysis, const QSize &size,
+                      const SpectrumDisplay &display = SpectrumDisplay());
+
+#endif // RENDER_H
@@ -0,0 +1,73 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <QAtomicInteger>
+#include <QVector>
+
+// Lock-free ring of samples between one producer and one consumer thread.
+// The producer never waits: samples which do not fit are dropped. Each side
+// only moves its own index, the indices run freely and wrap at 2^32.
+class SampleRing
+{
+public:
+    // Capacity is rounded up to a power of two
+    explicit SampleRing(int capacity)
+        : _readIndex(0)
+        , _writeIndex(0)
+    {
+        int size = 1;
+        while (size < capacity)
+            size *= 2;
+        _samples.resize(size);
+        _mask = size - 1;
+    }
+
+    int capacity() const { return _samples.size(); }
+    int available() const { return int(_writeIndex.loadAcquire() - _readIndex.load()); }
+
+    // Producer side, returns the number of samples written
+    int write(const float *samples, int count)
+    {
+        const quint32 write = _writeIndex.load();
+        const int space = capacity() - int(write - _readIndex.loadAcquire());
+        count = qMin(count, space);
+        float *data = _samples.data();
+        for (int i = 0; i < count; ++i)
+            data[(write + i) & _mask] = samples[i];
+        _writeIndex.storeRelease(write + count);
+        return count;
+    }
+
+    // Consumer side, returns the number of samples read
+    int read(float *samples, int maxCount)
+    {
+        const quint32 read = _readIndex.load();
+        const int count = qMin(maxCount, int(_writeIndex.loadAcquire() - read));
+        const float *data = _samples.constData();
+        for (int i = 0; i < count; ++i)
+            samples[i] = data[(read + i) & _mask];
+        _readIndex.storeRelease(read + count);
+        return count;
+    }
+
+    // Consumer side, drops everything written so far
+    void skip()
+    {
+        _readIndex.storeRelease(_writeIndex.loadAcquire());
+    }
+
+private:
+    Q_DISABLE_COPY(SampleRing)
+
+    QVector<float> _samples;
+    quint32 _mask;
+    QAtomicInteger<quint32> _readIndex;
+    QAtomicInteger<quint32> _writeIndex;
+};
+
+#endif // SAMPLERING_H
@@ -0,0 +1,119 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "snapping.h"
+#include "analysis.h"
+#include "wavfile.h"
+
+// Half width of the searched window
+const qint64 SnapWindowUs = 50000;
+
+// Rounded up, so converting back to frames gives the same frame
+static qint64 frameToUs(qint64 frame, qint64 sampleRate)
+{
+    return (frame * 1000000 + sampleRate - 1) / sampleRate;
+}
+
+static int sampleAt(const qint16 *data, int channels, int channel, qint64 frame)
+{
+    if (channel >= 0)
+        return data[frame * channels + channel];
+
+    int sum = 0;
+    for (int c = 0; c < channels; ++c)
+        sum += data[frame * channels + c];
+    return sum;
+}
+
+// Walks outwards from center, the first sign change within [first, last]
+// wins, and of its two frames the one closer to zero
+static qint64 nearestZeroCrossing(const WavFile *file, int channel,
+                                  qint64 center, qint64 first, qint64 last)
+{
+    const qint16 *data = file->data();
+    const int channels = file->channelCount();
+
+    auto crossing = [&] (qint64 frame) -> qint64 {
+        const int a = sampleAt(data, channels, channel, frame);
+        if (a == 0)
+            return frame;
+        const int b = sampleAt(data, channels, channel, frame + 1);
+        if ((a < 0) == (b < 0))
+            return -1;
+        return qAbs(a) <= qAbs(b) ? frame : frame + 1;
+    };
+
+    for (qint64 distance = 0; center - distance > first || center + distance < last; ++distance) {
+        if (center + distance < last) {
+            const qint64 result = crossing(center + distance);
+            if (result >= 0)
+                return result;
+        }
+        if (center - distance - 1 >= first) {
+            const qint64 result = crossing(center - distance - 1);
+            if (result >= 0)
+                return result;
+        }
+    }
+    return -1;
+}
+
+// The base bin with the least power of the channel (or of all channels),
+// ties go to the bin nearest to center
+static qint64 quietestBin(const Analysis &analysis, int channel,
+                          qint64 center, qint64 first, qint64 last)
+{
+    const qint64 firstBin = first / PeakPyramid::BinFrames;
+    const qint64 lastBin = last / PeakPyramid::BinFrames;
+    const qint64 centerBin = center / PeakPyramid::BinFrames;
+
+    qint64 result = -1;
+    float resultPower = 0.0f;
+    for (qint64 i = firstBin; i <= lastBin; ++i) {
+        float power = 0.0f;
+        for (int c = 0; c < analysis.channelCount(); ++c) {
+            if (channel < 0 || channel == c)
+                power += analysis.peaks(c).level(0)[i].power;
+        }
+
+        if (result < 0 || power < resultPower
+                || (power == resultPower && qAbs(i - centerBin) < qAbs(result - centerBin))) {
+            result = i;
+            resultPower = power;
+        }
+    }
+    return result;
+}
+
+qint64 snapBoundary(const WavFile *file, const Analysis &analysis, qint64 timeUs,
+                    SnapMode mode, int channel)
+{
+    const qint64 numFrames = file->numSamples();
+    const qint64 sampleRate = file->format().sampleRate();
+    if (mode == NoSnap || numFrames < 2 || sampleRate <= 0 || !file->isLoaded())
+        return timeUs;
+
+    channel = qMin(channel, file->channelCount() - 1);
+    const qint64 window = SnapWindowUs * sampleRate / 1000000;
+    const qint64 center = qBound(qint64(0), timeUs * sampleRate / 1000000, numFrames - 1);
+    qint64 first = qMax(qint64(0), center - window);
+    qint64 last = qMin(numFrames - 1, center + window);
+    qint64 target = center;
+
+    // Without an analysis of this file the energy search degrades to the
+    // zero crossing one
+    if (mode == EnergyMinimumSnap
+            && analysis.channelCount() == file->channelCount() && analysis.numFrames() == numFrames) {
+        const qint64 bin = quietestBin(analysis, channel, center, first, last);
+        first = bin * PeakPyramid::BinFrames;
+        last = qMin(numFrames - 1, first + PeakPyramid::BinFrames);
+        target = (first + last) / 2;
+    }
+
+    const qint64 frame = nearestZeroCrossing(file, channel, target, first, last);
+    if (frame >= 0)
+        return frameToUs(frame, sampleRate);
+    return mode == EnergyMinimumSnap ? frameToUs(target, sampleRate) : timeUs;
+}
@@ -0,0 +1,33 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef SNAPPING_H
+#define SNAPPING_H
+
+#include <QtGlobal>
+
+#include "playbacksource.h"
+
+class Analysis;
+class WavFile;
+
+enum SnapMode
+{
+    NoSnap,
+    ZeroCrossingSnap,
+    EnergyMinimumSnap
+};
+
+// Moves a boundary at timeUs (microseconds) to the nearest zero crossing or
+// to the quietest spot of a short window around it, with sample precision.
+// Zero crossings are searched in the samples of the channel (the sum of all
+// channels for AllChannels and Downmix). Energy minima are found among the
+// base bins of the peak pyramids and refined to the zero crossing nearest to
+// the middle of the quietest bin. The time is returned as is if nothing
+// suitable is found.
+qint64 snapBoundary(const WavFile *file, const Analysis &analysis, qint64 timeUs,
+                    SnapMode mode, int channel = PlaybackSource::AllChannels);
+
+#endif // SNAPPING_H
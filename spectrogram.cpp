@@ -0,0 +1,107 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "spectrogram.h"
+#include "lzcodec.h"
+
+#include <QDataStream>
+#include <QtConcurrent>
+
+#include <limits>
+
+// Tiles which do not shrink at least by a quarter stay raw, they are read on
+// every draw and unpacking them would cost more than it saves
+const int PackedNumerator = 3;
+const int PackedDenominator = 4;
+
+Spectrogram::Spectrogram()
+    : _width(0)
+    , _height(0)
+{
+}
+
+Spectrogram::Spectrogram(int width, int height)
+    : _width(width)
+    , _height(height)
+    , _tiles((width + TileColumns - 1) / TileColumns)
+{
+    for (Tile &tile : _tiles)
+        tile = Tile { QByteArray(tileBytes(), 0), false };
+}
+
+qint64 Spectrogram::memoryBytes() const
+{
+    qint64 result = _tiles.size() * qint64(sizeof(Tile));
+    for (const Tile &tile : _tiles)
+        result += tile.data.capacity();
+    return result;
+}
+
+void Spectrogram::compress()
+{
+    Tile *tiles = _tiles.data();
+    QVector<int> indices(_tiles.size());
+    for (int i = 0; i < indices.size(); ++i)
+        indices[i] = i;
+
+    QtConcurrent::blockingMap(indices, [tiles] (int i) {
+        Tile &tile = tiles[i];
+        if (tile.packed)
+            return;
+
+        QByteArray packed = lzCompress(tile.data.constData(), tile.data.size());
+        if (packed.size() * qint64(PackedDenominator) <= tile.data.size() * qint64(PackedNumerator)) {
+            packed.squeeze();
+            tile = Tile { packed, true };
+        }
+    });
+}
+
+const uchar *Spectrogram::tile(int tile, QByteArray *buffer) const
+{
+    const Tile &source = _tiles[tile];
+    if (!source.packed)
+        return reinterpret_cast<const uchar*>(source.data.constData());
+
+    // Broken tiles are only possible with a damaged cache, they show as silence
+    buffer->resize(tileBytes());
+    if (!lzDecompress(source.data.constData(), source.data.size(), buffer->data(), buffer->size()))
+        buffer->fill(0);
+    return reinterpret_cast<const uchar*>(buffer->constData());
+}
+
+void Spectrogram::write(QDataStream &stream) const
+{
+    stream << qint32(_width) << qint32(_height);
+    for (const Tile &tile : _tiles) {
+        stream << tile.packed << qint32(tile.data.size());
+        stream.writeRawData(tile.data.constData(), tile.data.size());
+    }
+}
+
+bool Spectrogram::read(QDataStream &stream)
+{
+    qint32 width, height;
+    stream >> width >> height;
+    if (stream.status() != QDataStream::Ok || width < 0 || height < 0
+            || qint64(height) * TileColumns > std::numeric_limits<int>::max())
+        return false;
+
+    _width = width;
+    _height = height;
+    _tiles.resize((width + TileColumns - 1) / TileColumns);
+    for (Tile &tile : _tiles) {
+        qint32 size;
+        stream >> tile.packed >> size;
+        if (stream.status() != QDataStream::Ok || size < 0 || size > tileBytes()
+                || (!tile.packed && size != tileBytes()))
+            return false;
+
+        tile.data.resize(size);
+        if (stream.readRawData(tile.data.data(), size) != size)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include <QByteArray>
+#include <QVector>
+
+class QDataStream;
+
+// Spectrum levels of a channel, one byte each, split into tiles of
+// TileColumns columns. Within a tile the levels are planar, line j starting
+// at j * TileColumns, and the last tile is padded to the full width. After
+// compress() every tile is either raw or packed by lzCompress(), whichever
+// is worth it, which is mostly the case for silence and steady noise.
+class Spectrogram
+{
+public:
+    static const int TileColumns = 1024;
+
+    Spectrogram();
+    Spectrogram(int width, int height);
+
+    bool isEmpty() const { return _width == 0 || _height == 0; }
+    int width() const { return _width; }
+    int height() const { return _height; }
+    int tileCount() const { return _tiles.size(); }
+    int tileBytes() const { return TileColumns * _height; }
+    qint64 memoryBytes() const;
+
+    // Raw levels to be filled, valid until compress()
+    uchar *tileData(int tile) { return reinterpret_cast<uchar*>(_tiles[tile].data.data()); }
+    void compress();
+
+    // Levels of the tile, unpacked into the buffer if it is packed
+    const uchar *tile(int tile, QByteArray *buffer) const;
+
+    void write(QDataStream &stream) const;
+    bool read(QDataStream &stream);
+
+private:
+    struct Tile
+    {
+        QByteArray data;
+        bool packed;
+    };
+
+    int _width;
+    int _height;
+    QVector<Tile> _tiles;
+};
+
+#endif // SPECTROGRAM_H
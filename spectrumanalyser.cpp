@@ -0,0 +1,223 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "spectrumanalyser.h"
+#include "trace.h"
+
+#include <math.h>
+
+#include <QPainter>
+#include <QtConcurrent>
+
+// About a second and a half of mono samples at 44.1 kHz
+const int RingCapacity = 1 << 16;
+const int RefreshIntervalMs = 33;
+
+// Windows overlap by half, at most the newest ones are averaged per refresh
+const int SpectrumHop = FFTRealWrapper::FFTLength / 2;
+const int MaxAveragedWindows = 16;
+
+// Bars rise at once and fall at a fixed rate, peak marks fall slower
+const float FloorDb = -90.0f;
+const float FallDbPerSecond = 40.0f;
+const float PeakFallDbPerSecond = 10.0f;
+const double MaxFallSeconds = 0.1;
+
+const int MeterWidth = 16;
+const int MeterGap = 4;
+
+static float powerToDb(float power)
+{
+    return qMax(FloorDb, 10.0f * log10f(qMax(power, 1e-12f)));
+}
+
+SpectrumAnalyser::SpectrumAnalyser(QWidget *parent)
+    :   QWidget(parent)
+    ,   _ring(RingCapacity)
+    ,   _restart(true)
+    ,   _latency(0)
+    ,   _window(FFTRealWrapper::FFTLength)
+    ,   _spectrum(FFTRealWrapper::FFTLength / 2, FloorDb)
+    ,   _spectrumPeaks(FFTRealWrapper::FFTLength / 2, FloorDb)
+    ,   _level(FloorDb)
+    ,   _levelPeak(FloorDb)
+{
+    // Hann window
+    for (int i = 0; i < _window.size(); ++i)
+        _window[i] = float(0.5 - 0.5 * cos(2.0 * M_PI * i / _window.size()));
+
+    _refreshTimer.setInterval(RefreshIntervalMs);
+    connect(&_refreshTimer, &QTimer::timeout,
+            this, &SpectrumAnalyser::refresh);
+    connect(&_rendering, &QFutureWatcher<QImage>::finished,
+            this, &SpectrumAnalyser::renderFinished);
+    _refreshTimer.start();
+}
+
+SpectrumAnalyser::~SpectrumAnalyser()
+{
+    _refreshTimer.stop();
+    _rendering.waitForFinished();
+}
+
+void SpectrumAnalyser::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    PAINT_TRACE("SpectrumAnalyser::paintEvent");
+
+    QPainter painter(this);
+    if (_image.isNull())
+        painter.fillRect(rect(), Qt::black);
+    else
+        painter.drawImage(0, 0, _image);
+}
+
+void SpectrumAnalyser::fileChanged(WavFile *file)
+{
+    Q_UNUSED(file);
+    _restart = true;
+}
+
+void SpectrumAnalyser::setOutputLatency(int frames)
+{
+    _latency.store(frames);
+}
+
+//-----------------------------------------------------------------------------
+// Private slots
+//-----------------------------------------------------------------------------
+
+// Nothing new is rendered while playback is paused, the picture stays
+void SpectrumAnalyser::refresh()
+{
+    if (_rendering.isRunning() || !isVisible() || width() <= 0 || height() <= 0)
+        return;
+    if (!_restart && audibleSamples() == 0)
+        return;
+
+    const QSize size = this->size();
+    const bool restart = _restart;
+    _restart = false;
+    _rendering.setFuture(QtConcurrent::run([this, size, restart] {
+        return render(size, restart);
+    }));
+}
+
+void SpectrumAnalyser::renderFinished()
+{
+    _image = _rendering.result();
+    update();
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+// The ring holds a mono sample per frame, the ones not heard yet stay there
+int SpectrumAnalyser::audibleSamples() const
+{
+    const int latency = qBound(0, _latency.load(), _ring.capacity() / 2);
+    return qMax(0, _ring.available() - latency);
+}
+
+// Runs on a worker, the ring is drained into the samples, which keep the
+// part of a window not complete yet
+QImage SpectrumAnalyser::render(const QSize &size, bool restart)
+{
+    ANALYSIS_TRACE("SpectrumAnalyser::render");
+    const int length = FFTRealWrapper::FFTLength;
+    const int bins = length / 2;
+
+    if (restart) {
+        _ring.skip();
+        _samples.clear();
+        _spectrum.fill(FloorDb);
+        _spectrumPeaks.fill(FloorDb);
+        _level = FloorDb;
+        _levelPeak = FloorDb;
+        _clock.invalidate();
+    }
+
+    // The ring fills up while nobody drains it, those samples are stale
+    if (_ring.available() >= _ring.capacity())
+        _ring.skip();
+
+    const int audible = audibleSamples();
+    const int kept = _samples.size();
+    _samples.resize(kept + audible);
+    _samples.resize(kept + _ring.read(_samples.data() + kept, audible));
+    const int fresh = _samples.size() - kept;
+    ANALYSIS_COUNTER("monitorSamples", fresh);
+
+    float peak = 0.0f;
+    float squares = 0.0f;
+    for (int i = kept; i < _samples.size(); ++i) {
+        peak = qMax(peak, qAbs(_samples[i]));
+        squares += _samples[i] * _samples[i];
+    }
+
+    // Powers are scaled so that a full scale sine reads 0 dB
+    const int windows = _samples.size() >= length ? (_samples.size() - length) / SpectrumHop + 1 : 0;
+    const int firstWindow = qMax(0, windows - MaxAveragedWindows);
+    QVector<float> power(bins, 0.0f);
+    float input[FFTRealWrapper::FFTLength];
+    float output[FFTRealWrapper::FFTLength];
+    float scratch[FFTRealWrapper::FFTLength];
+    for (int w = firstWindow; w < windows; ++w) {
+        const float *samples = _samples.constData() + w * SpectrumHop;
+        for (int i = 0; i < length; ++i)
+            input[i] = samples[i] * _window[i];
+        _fft.calculateFFT(output, input, scratch);
+
+        power[0] += output[0] * output[0];
+        for (int k = 1; k < bins; ++k)
+            power[k] += output[k] * output[k] + output[bins + k] * output[bins + k];
+    }
+    if (windows > 0)
+        _samples.remove(0, windows * SpectrumHop);
+
+    const double elapsed = _clock.isValid() ? _clock.restart() / 1000.0 : 0.0;
+    if (!_clock.isValid())
+        _clock.start();
+    const float seconds = float(qMin(elapsed, MaxFallSeconds));
+
+    const float scale = 16.0f / (float(length) * length * qMax(1, windows - firstWindow));
+    for (int k = 0; k < bins; ++k) {
+        const float db = windows > 0 ? powerToDb(power[k] * scale) : FloorDb;
+        _spectrum[k] = qMax(db, _spectrum[k] - FallDbPerSecond * seconds);
+        _spectrumPeaks[k] = qMax(_spectrum[k], _spectrumPeaks[k] - PeakFallDbPerSecond * seconds);
+    }
+
+    if (fresh > 0) {
+        _level = qMax(powerToDb(squares / fresh), _level - FallDbPerSecond * seconds);
+        _levelPeak = qMax(powerToDb(peak * peak), _levelPeak - PeakFallDbPerSecond * seconds);
+    }
+
+    // Bars of the bins above DC side by side, the meter on the right
+    QImage image(size, QImage::Format_RGB32);
+    image.fill(Qt::black);
+    QPainter painter(&image);
+
+    const int height = size.height();
+    const int spectrumWidth = qMax(1, size.width() - MeterWidth - MeterGap);
+    auto dbToY = [height] (float db) {
+        return height - qRound((db - FloorDb) / -FloorDb * height);
+    };
+
+    for (int k = 1; k < bins; ++k) {
+        const int x0 = (k - 1) * spectrumWidth / (bins - 1);
+        const int x1 = qMax(x0 + 1, k * spectrumWidth / (bins - 1) - 1);
+        const int y = dbToY(_spectrum[k]);
+        painter.fillRect(x0, y, x1 - x0, height - y, QColor(255, 255, 255, 160));
+        painter.fillRect(x0, dbToY(_spectrumPeaks[k]), x1 - x0, 1, QColor(255, 200, 0, 160));
+    }
+
+    const int meterX = size.width() - MeterWidth;
+    const int levelY = dbToY(_level);
+    painter.fillRect(meterX, levelY, MeterWidth, height - levelY, QColor(255, 255, 255, 160));
+    painter.fillRect(meterX, dbToY(_levelPeak), MeterWidth, 1, QColor(255, 200, 0, 160));
+
+    return image;
+}
@@ -0,0 +1,72 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef SPECTRUMANALYSER_H
+#define SPECTRUMANALYSER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+
+#include "fftreal_wrapper.h"
+#include "samplering.h"
+
+class WavFile;
+
+// Live spectrum and level of what is being played. The playback source
+// writes into the ring, at display rate a worker drains it, averages the
+// spectra of the newest windows and renders the picture, so the GUI thread
+// only blits it and never competes with the audio. Samples are written as
+// the device pulls them, so the last output latency of them is left in the
+// ring until it is heard.
+class SpectrumAnalyser : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SpectrumAnalyser(QWidget *parent = 0);
+    ~SpectrumAnalyser();
+
+    SampleRing *ring() { return &_ring; }
+
+    // QWidget
+    void paintEvent(QPaintEvent *event) override;
+
+public slots:
+    void fileChanged(WavFile* file);
+    void setOutputLatency(int frames);
+
+private slots:
+    void refresh();
+    void renderFinished();
+
+private:
+    int audibleSamples() const;
+    QImage render(const QSize &size, bool restart);
+
+private:
+    SampleRing _ring;
+    QTimer _refreshTimer;
+    QFutureWatcher<QImage> _rendering;
+    QImage _image;
+    bool _restart;
+    QAtomicInt _latency;
+
+    // Used by one render at a time, on the worker
+    FFTRealWrapper _fft;
+    QVector<float> _window;
+    QVector<float> _samples;
+    QVector<float> _spectrum;
+    QVector<float> _spectrumPeaks;
+    float _level;
+    float _levelPeak;
+    QElapsedTimer _clock;
+};
+
+#endif // SPECTRUMANALYSER_H
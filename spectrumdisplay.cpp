@@ -0,0 +1,60 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "spectrumdisplay.h"
+#include "analysis.h"
+
+const float DefaultFloorDb = -90.0f;
+const float DefaultCeilingDb = -30.0f;
+
+// Colours evenly spaced over the map, linearly interpolated between
+const QRgb GrayStops[] = { qRgb(0, 0, 0), qRgb(255, 255, 255) };
+const QRgb HeatStops[] = {
+    qRgb(0, 0, 0), qRgb(128, 0, 0), qRgb(230, 60, 0), qRgb(255, 190, 0), qRgb(255, 255, 255)
+};
+const QRgb ViridisStops[] = {
+    qRgb(68, 1, 84), qRgb(59, 82, 139), qRgb(33, 145, 140), qRgb(94, 201, 98), qRgb(253, 231, 37)
+};
+
+SpectrumDisplay::SpectrumDisplay()
+    : floorDb(DefaultFloorDb)
+    , ceilingDb(DefaultCeilingDb)
+    , colormap(GrayColormap)
+{
+}
+
+template<int N> static QRgb interpolate(const QRgb (&stops)[N], float position)
+{
+    const float scaled = position * (N - 1);
+    const int first = qMin(static_cast<int>(scaled), N - 2);
+    const float fraction = scaled - first;
+    const QRgb a = stops[first];
+    const QRgb b = stops[first + 1];
+    return qRgb(qRound(qRed(a) + (qRed(b) - qRed(a)) * fraction),
+                qRound(qGreen(a) + (qGreen(b) - qGreen(a)) * fraction),
+                qRound(qBlue(a) + (qBlue(b) - qBlue(a)) * fraction));
+}
+
+QVector<QRgb> spectrumColors(const SpectrumDisplay &display)
+{
+    const float range = qMax(display.ceilingDb - display.floorDb, 1.0f);
+
+    QVector<QRgb> colors(Analysis::SpectrumLevels);
+    for (int level = 0; level < colors.size(); ++level) {
+        const float position = qBound(0.0f, (Analysis::spectrumDb(level) - display.floorDb) / range, 1.0f);
+        switch (display.colormap) {
+        case HeatColormap:
+            colors[level] = interpolate(HeatStops, position);
+            break;
+        case ViridisColormap:
+            colors[level] = interpolate(ViridisStops, position);
+            break;
+        default:
+            colors[level] = interpolate(GrayStops, position);
+            break;
+        }
+    }
+    return colors;
+}
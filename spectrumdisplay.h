@@ -0,0 +1,34 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef SPECTRUMDISPLAY_H
+#define SPECTRUMDISPLAY_H
+
+#include <QRgb>
+#include <QVector>
+
+enum Colormap
+{
+    GrayColormap,
+    HeatColormap,
+    ViridisColormap
+};
+
+// How the quantized levels of spectrums are shown: levels at or below the
+// floor get the first colour of the map, at or above the ceiling the last one
+struct SpectrumDisplay
+{
+    SpectrumDisplay();
+
+    float floorDb;
+    float ceilingDb;
+    Colormap colormap;
+};
+
+// Colour of every level a spectrum pixel can hold. It is built once per
+// change of the display, drawing is then a lookup per pixel.
+QVector<QRgb> spectrumColors(const SpectrumDisplay &display);
+
+#endif // SPECTRUMDISPLAY_H
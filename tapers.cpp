@@ -0,0 +1,145 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "tapers.h"
+
+#include <math.h>
+
+const int BisectionSteps = 100;
+const int InverseIterations = 4;
+
+// Number of eigenvalues of the matrix below x
+static int sturmCount(const QVector<double> &diagonal, const QVector<double> &offDiagonal, double x)
+{
+    int count = 0;
+    double q = 1.0;
+    for (int i = 0; i < diagonal.size(); ++i) {
+        const double coupling = i > 0 ? offDiagonal[i] * offDiagonal[i] : 0.0;
+        q = diagonal[i] - x - (i > 0 ? coupling / q : 0.0);
+        if (q == 0.0)
+            q = 1e-300;
+        if (q < 0.0)
+            ++count;
+    }
+    return count;
+}
+
+// Solves (T - shift) x = b in place: LU factorization of the tridiagonal
+// matrix with partial pivoting, which gives the upper factor a second
+// superdiagonal, then the two triangular solves
+static void solveShifted(const QVector<double> &diagonal, const QVector<double> &offDiagonal,
+                         double shift, QVector<double> &b)
+{
+    const int n = diagonal.size();
+    QVector<double> d(n), lower(n, 0.0), upper(n, 0.0), upper2(n, 0.0);
+    QVector<bool> swapped(n, false);
+    for (int i = 0; i < n; ++i)
+        d[i] = diagonal[i] - shift;
+    for (int i = 0; i + 1 < n; ++i) {
+        lower[i] = offDiagonal[i + 1];
+        upper[i] = offDiagonal[i + 1];
+    }
+
+    for (int i = 0; i + 1 < n; ++i) {
+        if (qAbs(d[i]) >= qAbs(lower[i])) {
+            if (d[i] == 0.0)
+                d[i] = 1e-300;
+            lower[i] /= d[i];
+            d[i + 1] -= lower[i] * upper[i];
+        } else {
+            const double factor = d[i] / lower[i];
+            swapped[i] = true;
+            d[i] = lower[i];
+            lower[i] = factor;
+            const double next = upper[i];
+            upper[i] = d[i + 1];
+            d[i + 1] = next - factor * d[i + 1];
+            if (i + 2 < n) {
+                upper2[i] = upper[i + 1];
+                upper[i + 1] = -factor * upper[i + 1];
+            }
+        }
+    }
+    if (d[n - 1] == 0.0)
+        d[n - 1] = 1e-300;
+
+    for (int i = 0; i + 1 < n; ++i) {
+        if (swapped[i]) {
+            const double value = b[i];
+            b[i] = b[i + 1];
+            b[i + 1] = value - lower[i] * b[i];
+        } else {
+            b[i + 1] -= lower[i] * b[i];
+        }
+    }
+
+    for (int i = n - 1; i >= 0; --i) {
+        double sum = b[i];
+        if (i + 1 < n)
+            sum -= upper[i] * b[i + 1];
+        if (i + 2 < n)
+            sum -= upper2[i] * b[i + 2];
+        b[i] = sum / d[i];
+    }
+}
+
+QVector<QVector<float>> dpssTapers(int length, double halfBandwidth, int count)
+{
+    const int n = length;
+    const double bandwidth = halfBandwidth / n;
+
+    QVector<double> diagonal(n), offDiagonal(n, 0.0);
+    for (int i = 0; i < n; ++i) {
+        const double centre = (n - 1) / 2.0 - i;
+        diagonal[i] = centre * centre * cos(2.0 * M_PI * bandwidth);
+        if (i > 0)
+            offDiagonal[i] = i * double(n - i) / 2.0;
+    }
+
+    // Gershgorin bounds of the spectrum
+    double low = 0.0, high = 0.0;
+    for (int i = 0; i < n; ++i) {
+        const double radius = offDiagonal[i] + (i + 1 < n ? offDiagonal[i + 1] : 0.0);
+        low = qMin(low, diagonal[i] - radius);
+        high = qMax(high, diagonal[i] + radius);
+    }
+
+    QVector<QVector<float>> tapers(count);
+    for (int k = 0; k < count; ++k) {
+        // The k-th largest eigenvalue has n - 1 - k others below it
+        double a = low, b = high;
+        for (int step = 0; step < BisectionSteps && b - a > 1e-12 * qMax(1.0, qAbs(b)); ++step) {
+            const double middle = (a + b) / 2.0;
+            if (sturmCount(diagonal, offDiagonal, middle) > n - 1 - k)
+                b = middle;
+            else
+                a = middle;
+        }
+        const double eigenvalue = (a + b) / 2.0;
+
+        QVector<double> vector(n);
+        for (int i = 0; i < n; ++i)
+            vector[i] = 1.0 + 0.01 * i;
+        for (int iteration = 0; iteration < InverseIterations; ++iteration) {
+            solveShifted(diagonal, offDiagonal, eigenvalue + 1e-10 * qMax(1.0, qAbs(eigenvalue)), vector);
+            double norm = 0.0;
+            for (double value : vector)
+                norm += value * value;
+            norm = sqrt(norm);
+            for (double &value : vector)
+                value /= norm;
+        }
+
+        // Even tapers sum to a positive value, odd ones are positive first
+        double sign = 0.0;
+        for (int i = 0; i < n; ++i)
+            sign += vector[i] * (k % 2 == 0 ? 1.0 : (n - 1) / 2.0 - i);
+        tapers[k].resize(n);
+        for (int i = 0; i < n; ++i)
+            tapers[k][i] = float(sign < 0.0 ? -vector[i] : vector[i]);
+    }
+
+    return tapers;
+}
@@ -0,0 +1,18 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef TAPERS_H
+#define TAPERS_H
+
+#include <QVector>
+
+// Discrete prolate spheroidal sequences: the count orthonormal windows of
+// the length with the most energy within halfBandwidth / length cycles per
+// sample of DC. They are the eigenvectors with the largest eigenvalues of a
+// tridiagonal matrix commuting with the concentration problem, so they are
+// found by bisection on Sturm counts and a few steps of inverse iteration.
+QVector<QVector<float>> dpssTapers(int length, double halfBandwidth, int count);
+
+#endif // TAPERS_H
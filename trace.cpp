@@ -0,0 +1,168 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QScopedArrayPointer>
+#include <QThread>
+#include <QVector>
+
+#include <atomic>
+
+Q_LOGGING_CATEGORY(logEngine, "antiannotate.engine", QtInfoMsg)
+Q_LOGGING_CATEGORY(logAnalysis, "antiannotate.analysis", QtInfoMsg)
+Q_LOGGING_CATEGORY(logWaveform, "antiannotate.waveform", QtInfoMsg)
+Q_LOGGING_CATEGORY(logAnnotations, "antiannotate.annotations", QtInfoMsg)
+
+struct TraceEvent
+{
+    const char *category;
+    const char *name;
+    char phase;
+    qint64 timestamp;
+    qint64 value;       // duration for complete events
+    quintptr thread;
+};
+
+// Only the latest events are kept, the older ones are overwritten
+const int TraceCapacity = 1 << 18;
+
+// A slot is claimed by a ticket and holds the ticket in its sequence once
+// written, -1 while it is being written, so events are added from any
+// thread, the audio one included, without locking or allocating
+struct TraceSlot
+{
+    QAtomicInteger<qint64> sequence;
+    TraceEvent event;
+};
+
+QAtomicInt Tracer::_enabled(0);
+
+static QScopedArrayPointer<TraceSlot> traceSlots;
+static QAtomicInteger<qint64> traceNext(0);
+static QString traceFileName;
+static QElapsedTimer traceClock;
+
+static void appendEvent(const TraceEvent &event)
+{
+    const qint64 ticket = traceNext.fetchAndAddRelaxed(1);
+    TraceSlot &slot = traceSlots[ticket % TraceCapacity];
+    slot.sequence.store(-1);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.sequence.storeRelease(ticket);
+}
+
+// The event of the ticket, unless it was overwritten or is being written
+static bool readEvent(qint64 ticket, TraceEvent *event)
+{
+    const TraceSlot &slot = traceSlots[ticket % TraceCapacity];
+    if (slot.sequence.loadAcquire() != ticket)
+        return false;
+    *event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load() == ticket;
+}
+
+qint64 Tracer::now()
+{
+    return traceClock.nsecsElapsed();
+}
+
+void Tracer::start(const QString &fileName)
+{
+    if (fileName.isEmpty())
+        return;
+
+    if (isEnabled())
+        return;
+
+    // Scopes still open from a previous trace may write into the slots, so
+    // they are allocated once and never freed
+    if (!traceSlots) {
+        traceSlots.reset(new TraceSlot[TraceCapacity]);
+        for (int i = 0; i < TraceCapacity; ++i)
+            traceSlots[i].sequence.store(-1);
+    }
+
+    traceFileName = fileName;
+    traceNext.store(0);
+    traceClock.start();
+    _enabled.storeRelease(1);
+}
+
+void Tracer::stop()
+{
+    if (!isEnabled())
+        return;
+
+    _enabled.store(0);
+
+    const qint64 next = traceNext.load();
+    const qint64 first = qMax<qint64>(0, next - TraceCapacity);
+    if (first > 0)
+        qCWarning(logEngine) << "Tracer::stop" << "kept the last" << TraceCapacity << "of" << next << "events";
+
+    QVector<TraceEvent> traceEvents;
+    traceEvents.reserve(int(next - first));
+    for (qint64 ticket = first; ticket < next; ++ticket) {
+        TraceEvent event;
+        if (readEvent(ticket, &event))
+            traceEvents.append(event);
+    }
+
+    QFile file(traceFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(logEngine) << "Tracer::stop" << "could not write" << traceFileName;
+        return;
+    }
+
+    // Timestamps are in microseconds, as the trace event format wants
+    QByteArray json("{\"traceEvents\":[\n");
+    for (int i = 0; i < traceEvents.size(); ++i) {
+        const TraceEvent &event = traceEvents[i];
+        json += "{\"cat\":\"";
+        json += event.category;
+        json += "\",\"name\":\"";
+        json += event.name;
+        json += "\",\"ph\":\"";
+        json += event.phase;
+        json += "\",\"pid\":1,\"tid\":";
+        json += QByteArray::number(quint64(event.thread));
+        json += ",\"ts\":";
+        json += QByteArray::number(event.timestamp / 1000.0, 'f', 3);
+        if (event.phase == 'X') {
+            json += ",\"dur\":";
+            json += QByteArray::number(event.value / 1000.0, 'f', 3);
+        } else {
+            json += ",\"args\":{\"value\":";
+            json += QByteArray::number(event.value);
+            json += "}";
+        }
+        json += i + 1 < traceEvents.size() ? "},\n" : "}\n";
+    }
+    json += "]}\n";
+
+    file.write(json);
+}
+
+void Tracer::complete(const char *category, const char *name, qint64 begin)
+{
+    const qint64 end = now();
+    appendEvent(TraceEvent {
+        category, name, 'X', begin, end - begin,
+        reinterpret_cast<quintptr>(QThread::currentThreadId())
+    });
+}
+
+void Tracer::counter(const char *category, const char *name, qint64 value)
+{
+    appendEvent(TraceEvent {
+        category, name, 'C', now(), value,
+        reinterpret_cast<quintptr>(QThread::currentThreadId())
+    });
+}
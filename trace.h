@@ -0,0 +1,97 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QLoggingCategory>
+#include <QString>
+
+Q_DECLARE_LOGGING_CATEGORY(logEngine)
+Q_DECLARE_LOGGING_CATEGORY(logAnalysis)
+Q_DECLARE_LOGGING_CATEGORY(logWaveform)
+Q_DECLARE_LOGGING_CATEGORY(logAnnotations)
+
+// Collects scoped timings and counters in a bounded ring and dumps the latest
+// of them as Chrome trace events (chrome://tracing, Perfetto) when stopped.
+// Names and categories must be string literals, nothing is formatted while
+// tracing.
+class Tracer
+{
+public:
+    static bool isEnabled() { return _enabled.loadAcquire(); }
+    static qint64 now();
+
+    static void start(const QString &fileName);
+    static void stop();
+
+    static void complete(const char *category, const char *name, qint64 begin);
+    static void counter(const char *category, const char *name, qint64 value);
+
+private:
+    static QAtomicInt _enabled;
+};
+
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name)
+        : _category(category)
+        , _name(name)
+        , _begin(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (_begin >= 0)
+            Tracer::complete(_category, _name, _begin);
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *_category;
+    const char *_name;
+    qint64 _begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(category, name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(category, name)
+#define TRACE_COUNTER(category, name, value) \
+    do { if (Tracer::isEnabled()) Tracer::counter(category, name, value); } while (0)
+
+// Every category is compiled in only with its define from antiannotate.pro
+#ifdef LOG_ENGINE
+#  define ENGINE_TRACE(name) TRACE_SCOPE("engine", name)
+#  define ENGINE_COUNTER(name, value) TRACE_COUNTER("engine", name, value)
+#else
+#  define ENGINE_TRACE(name)
+#  define ENGINE_COUNTER(name, value)
+#endif
+
+#ifdef LOG_SPECTRUMANALYSER
+#  define ANALYSIS_TRACE(name) TRACE_SCOPE("analysis", name)
+#  define ANALYSIS_COUNTER(name, value) TRACE_COUNTER("analysis", name, value)
+#else
+#  define ANALYSIS_TRACE(name)
+#  define ANALYSIS_COUNTER(name, value)
+#endif
+
+#ifdef LOG_WAVEFORM
+#  define WAVEFORM_TRACE(name) TRACE_SCOPE("waveform", name)
+#else
+#  define WAVEFORM_TRACE(name)
+#endif
+
+#ifdef PAINT_EVENT_TRACE
+#  define PAINT_TRACE(name) TRACE_SCOPE("paint", name)
+#else
+#  define PAINT_TRACE(name)
+#endif
+
+#endif // TRACE_H
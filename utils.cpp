@@ -4,6 +4,11 @@
 // Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
 
 #include <QAudioFormat>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
 #include "utils.h"
 
 QString formatToString(const QAudioFormat &format)
@@ -57,6 +62,15 @@ QString formatToString(const QAudioFormat &format)
     return result;
 }
 
+bool isFormatSupported(const QAudioFormat &format)
+{
+    return format.codec() == "audio/pcm"
+        && format.sampleType() == QAudioFormat::SignedInt
+        && format.sampleSize() == 16
+        && format.byteOrder() == QAudioFormat::LittleEndian
+        && (format.sampleRate() == 8000 || format.sampleRate() == 16000);
+}
+
 const qint16  PCMS16MaxValue     =  32767;
 const quint16 PCMS16MaxAmplitude =  32768; // because minimum is -32768
 
@@ -69,3 +83,45 @@ qint16 realToPcm(float real)
 {
     return real * PCMS16MaxValue;
 }
+
+// Lists are expanded once, so lists including each other do not recurse
+static QStringList collectWavFiles(const QStringList &paths, QSet<QString> *expanded)
+{
+    QStringList result;
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (info.isDir()) {
+            QStringList files;
+            QDirIterator it(path, QStringList() << "*.wav" << "*.WAV",
+                            QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                files << it.next();
+            files.sort();
+            result << files;
+        } else if (info.suffix().compare("txt", Qt::CaseInsensitive) == 0
+                   || info.suffix().compare("m3u", Qt::CaseInsensitive) == 0) {
+            QFile list(path);
+            if (expanded->contains(info.canonicalFilePath()) || !list.open(QIODevice::ReadOnly | QIODevice::Text))
+                continue;
+            expanded->insert(info.canonicalFilePath());
+
+            QStringList entries;
+            while (!list.atEnd()) {
+                const QString line = QString::fromUtf8(list.readLine()).trimmed();
+                if (!line.isEmpty() && !line.startsWith('#'))
+                    entries << info.dir().filePath(line);
+            }
+            result << collectWavFiles(entries, expanded);
+        } else {
+            result << path;
+        }
+    }
+
+    return result;
+}
+
+QStringList collectWavFiles(const QStringList &paths)
+{
+    QSet<QString> expanded;
+    return collectWavFiles(paths, &expanded);
+}
@@ -7,11 +7,28 @@
 #define UTILS_H
 
 #include <QtCore/qglobal.h>
+#include <QString>
+#include <QStringList>
+
+class QAudioFormat;
+
+// Shared by the pitch and formant trackers, so their values line up: the hop
+// between values, and the mean power after the gain (-60 dBFS) of windows
+// which are too quiet to be tracked
+const double TrackHopSeconds = 0.01;
+const double TrackSilencePower = 1e-6;
 
 QString formatToString(const QAudioFormat &format);
 
+bool isFormatSupported(const QAudioFormat &format);
+
 float pcmToReal(qint16 pcm);
 
 qint16 realToPcm(float real);
 
+// WAV files of the given files, directories (recursively) and lists (.txt or
+// .m3u files with one path per line, relative to the list), in list order
+// with directory contents sorted
+QStringList collectWavFiles(const QStringList &paths);
+
 #endif // UTILS_H
@@ -0,0 +1,275 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#include "vad.h"
+#include "analysis.h"
+#include "wavfile.h"
+#include "trace.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+const double FrameSeconds = 0.02;
+
+// Frames quieter than this are never speech, whatever the noise floor is
+const float SilenceDb = -60.0f;
+const float NoisePercentile = 0.1f;
+const float ThresholdAboveNoiseDb = 9.0f;
+
+// Fricatives are weak but have a high zero crossing rate
+const float FricativeMarginDb = 6.0f;
+const float FricativeZcr = 0.25f;
+
+// Frames not far above the threshold are dropped if their spectrum is flat
+const float NoiseFlatness = 0.6f;
+const float FlatnessMarginDb = 6.0f;
+
+const double MinSilenceSeconds = 0.3;
+const double MinSpeechSeconds = 0.15;
+const double PaddingSeconds = 0.05;
+
+const char *SpeechTierName = "speech";
+
+struct FrameFeatures
+{
+    float energyDb;
+    float zcr;
+};
+
+// Single pass over interleaved samples, every frame of every channel gets its
+// mean energy and the rate of sign changes. Sums are kept in integers, so the
+// inner loops have no dependencies besides the accumulators.
+static QVector<QVector<FrameFeatures>> measureFrames(const WavFile *file, int frameLength)
+{
+    const int channels = file->channelCount();
+    const qint64 numSamples = file->numSamples();
+    const qint64 numFrames = (numSamples + frameLength - 1) / frameLength;
+    const qint16 *data = file->data();
+
+    QVector<QVector<FrameFeatures>> frames(channels);
+    for (int c = 0; c < channels; ++c)
+        frames[c].resize(numFrames);
+
+    const double fullScale = 32768.0 * 32768.0;
+    for (qint64 f = 0; f < numFrames; ++f) {
+        const qint64 begin = f * frameLength;
+        const qint64 length = qMin<qint64>(frameLength, numSamples - begin);
+
+        for (int c = 0; c < channels; ++c) {
+            const qint16 *samples = data + begin * channels + c;
+
+            qint64 energy = 0;
+            for (qint64 i = 0; i < length; ++i) {
+                const qint32 sample = samples[i * channels];
+                energy += sample * sample;
+            }
+
+            // The first sample is compared with the last one of the previous frame
+            int crossings = begin > 0 && (samples[0] ^ samples[-channels]) < 0;
+            for (qint64 i = 1; i < length; ++i)
+                crossings += (samples[i * channels] ^ samples[(i - 1) * channels]) < 0;
+
+            frames[c][f] = FrameFeatures {
+                float(10.0 * std::log10(energy / (fullScale * length) + 1e-10)),
+                float(crossings) / length
+            };
+        }
+    }
+
+    return frames;
+}
+
+// Geometric over arithmetic mean of every spectrum column, averaged over the
+// columns starting within each frame, or -1 for frames without columns
+static QVector<float> measureFlatness(const Spectrogram &spectrum, int frameLength, qint64 numFrames)
+{
+    // Magnitudes of the levels relative to the lowest one, the ratio does
+    // not depend on the reference
+    float logs[Analysis::SpectrumLevels];
+    float magnitudes[Analysis::SpectrumLevels];
+    for (int v = 0; v < Analysis::SpectrumLevels; ++v) {
+        logs[v] = (Analysis::spectrumDb(v) - Analysis::spectrumDb(0)) / 20.0f * std::log(10.0f);
+        magnitudes[v] = std::exp(logs[v]);
+    }
+
+    // Tiles are walked in memory order, the lowest row with DC is skipped
+    const int width = spectrum.width();
+    const int bins = spectrum.height() - 1;
+    QVector<float> logSums(width, 0.0f);
+    QVector<float> sums(width, 0.0f);
+    QByteArray buffer;
+    for (int t = 0; t < spectrum.tileCount(); ++t) {
+        const uchar *levels = spectrum.tile(t, &buffer);
+        const int first = t * Spectrogram::TileColumns;
+        const int columns = qMin(Spectrogram::TileColumns, width - first);
+        for (int j = 0; j < bins; ++j) {
+            const uchar *line = levels + j * Spectrogram::TileColumns;
+            for (int i = 0; i < columns; ++i) {
+                logSums[first + i] += logs[line[i]];
+                sums[first + i] += magnitudes[line[i]];
+            }
+        }
+    }
+
+    QVector<float> flatness(numFrames, 0.0f);
+    QVector<int> counts(numFrames, 0);
+    for (int i = 0; i < width && bins > 0; ++i) {
+        const qint64 f = qint64(i) * Analysis::spectrumHop() / frameLength;
+        if (f >= numFrames)
+            break;
+        flatness[f] += std::exp(logSums[i] / bins) / (sums[i] / bins);
+        ++counts[f];
+    }
+
+    for (qint64 f = 0; f < numFrames; ++f)
+        flatness[f] = counts[f] ? flatness[f] / counts[f] : -1.0f;
+    return flatness;
+}
+
+static float speechThreshold(const QVector<FrameFeatures> &frames)
+{
+    QVector<float> energies(frames.size());
+    for (int f = 0; f < frames.size(); ++f)
+        energies[f] = frames[f].energyDb;
+
+    const int nth = int(energies.size() * NoisePercentile);
+    std::nth_element(energies.begin(), energies.begin() + nth, energies.end());
+    return qMax(SilenceDb, energies[nth] + ThresholdAboveNoiseDb);
+}
+
+// Speech frames are joined into runs, short gaps are bridged, short runs are
+// dropped and the rest are padded
+static QVector<Annotation> segment(const QVector<bool> &speech, double duration)
+{
+    const int minSilence = qRound(MinSilenceSeconds / FrameSeconds);
+    const int minSpeech = qRound(MinSpeechSeconds / FrameSeconds);
+
+    QVector<QPair<int, int>> runs;
+    for (int f = 0; f < speech.size(); ) {
+        if (!speech[f]) {
+            ++f;
+            continue;
+        }
+
+        const int begin = f;
+        while (f < speech.size() && speech[f])
+            ++f;
+
+        if (!runs.isEmpty() && begin - runs.last().second < minSilence)
+            runs.last().second = f;
+        else
+            runs.append(qMakePair(begin, f));
+    }
+
+    QVector<Annotation> result;
+    for (const QPair<int, int> &run : runs) {
+        if (run.second - run.first < minSpeech)
+            continue;
+
+        result.append(Annotation {
+            0,
+            qMax(0.0, run.first * FrameSeconds - PaddingSeconds),
+            qMin(duration, run.second * FrameSeconds + PaddingSeconds),
+            QString()
+        });
+    }
+    return result;
+}
+
+QVector<QVector<Annotation>> detectSpeech(const WavFile *file, const Analysis *analysis)
+{
+    ANALYSIS_TRACE("detectSpeech");
+
+    const int channels = file->channelCount();
+    const int frameLength = qMax(1, qRound(file->format().sampleRate() * FrameSeconds));
+    const QVector<QVector<FrameFeatures>> frames = measureFrames(file, frameLength);
+    const bool useFlatness = analysis != nullptr && analysis->channelCount() == channels
+            && (analysis->products() & Analysis::Spectrums);
+
+    QVector<QVector<Annotation>> result(channels);
+    for (int c = 0; c < channels; ++c) {
+        const QVector<FrameFeatures> &features = frames[c];
+        if (features.isEmpty())
+            continue;
+
+        const QVector<float> flatness = useFlatness
+                ? measureFlatness(analysis->spectrum(c), frameLength, features.size())
+                : QVector<float>();
+        const float threshold = speechThreshold(features);
+
+        QVector<bool> speech(features.size());
+        for (int f = 0; f < features.size(); ++f) {
+            const FrameFeatures &frame = features[f];
+            bool voiced = frame.energyDb > threshold
+                    || (frame.energyDb > threshold - FricativeMarginDb && frame.zcr > FricativeZcr);
+            if (voiced && !flatness.isEmpty()
+                    && flatness[f] > NoiseFlatness && frame.energyDb < threshold + FlatnessMarginDb)
+                voiced = false;
+            speech[f] = voiced;
+        }
+
+        result[c] = segment(speech, file->duration());
+
+        qCDebug(logAnalysis) << "detectSpeech"
+                 << "channel" << c
+                 << "threshold" << threshold
+                 << "segments" << result[c].size();
+    }
+
+    return result;
+}
+
+QVector<QPair<qint64, qint64>> detectSilence(const WavFile *file, double minDuration)
+{
+    const int sampleRate = file->format().sampleRate();
+    const qint64 minFrames = qMax<qint64>(1, qint64(minDuration * sampleRate));
+
+    // Speech of all channels merged into one sorted list
+    QVector<QPair<qint64, qint64>> speech;
+    for (const QVector<Annotation> &segments : detectSpeech(file)) {
+        for (const Annotation &segment : segments)
+            speech.append(qMakePair(qint64(segment.begin * sampleRate), qint64(segment.end * sampleRate)));
+    }
+    std::sort(speech.begin(), speech.end());
+
+    QVector<QPair<qint64, qint64>> result;
+    qint64 silenceBegin = 0;
+    for (const QPair<qint64, qint64> &segment : speech) {
+        if (segment.first - silenceBegin >= minFrames)
+            result.append(qMakePair(silenceBegin, segment.first));
+        silenceBegin = qMax(silenceBegin, segment.second);
+    }
+    if (file->numSamples() - silenceBegin >= minFrames)
+        result.append(qMakePair(silenceBegin, file->numSamples()));
+
+    return result;
+}
+
+int addSpeechTiers(Annotations *annotations, const WavFile *file, const Analysis *analysis)
+{
+    const QVector<QVector<Annotation>> segments = detectSpeech(file, analysis);
+
+    int first = -1;
+    for (int c = 0; c < segments.size(); ++c) {
+        const QString name = segments.size() == 1
+                ? QString(SpeechTierName)
+                : QString("%1 %2").arg(SpeechTierName).arg(c + 1);
+        const int tier = annotations->addTier(name, AnnotationTier::IntervalTier, segments[c]);
+        if (first < 0)
+            first = tier;
+    }
+    return first;
+}
+
+bool hasSpeechTiers(const Annotations &annotations)
+{
+    for (const AnnotationTier &tier : annotations.tiers()) {
+        if (tier.name().startsWith(SpeechTierName))
+            return true;
+    }
+    return false;
+}
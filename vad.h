@@ -0,0 +1,33 @@
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+// Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
+
+#ifndef VAD_H
+#define VAD_H
+
+#include <QPair>
+#include <QVector>
+
+#include "annotations.h"
+
+class Analysis;
+class WavFile;
+
+// Candidate speech segments of every channel. Short-time energy and zero
+// crossing rate of all channels are measured in a single pass over the
+// samples, the energy threshold follows the noise floor of each channel.
+// When an analysis is given, noise-like frames are also rejected by the
+// spectral flatness of its spectrogram.
+QVector<QVector<Annotation>> detectSpeech(const WavFile *file, const Analysis *analysis = nullptr);
+
+// Stretches of frames [first, second) without speech on any channel, which
+// are at least minDuration seconds long
+QVector<QPair<qint64, qint64>> detectSilence(const WavFile *file, double minDuration);
+
+// Speech tiers are named "speech" (or "speech N" for every channel of
+// multichannel files), one is added per channel. Returns the first tier.
+int addSpeechTiers(Annotations *annotations, const WavFile *file, const Analysis *analysis = nullptr);
+bool hasSpeechTiers(const Annotations &annotations);
+
+#endif // VAD_H
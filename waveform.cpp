@@ -5,34 +5,55 @@
 
 #include "waveform.h"
 #include "wavfile.h"
-#include "utils.h"
+#include "annotations.h"
+#include "render.h"
+#include "trace.h"
+#include <QBitArray>
 #include <QPainter>
 #include <QResizeEvent>
-#include <QDebug>
+#include <QtConcurrent>
 
-template<int N> class PowerOfTwo
-{ public: static const int Result = PowerOfTwo<N-1>::Result * 2; };
-
-template<> class PowerOfTwo<0>
-{ public: static const int Result = 1; };
-
-const int SpectrumLengthSamples = PowerOfTwo<FFTLengthPowerOfTwo>::Result;
+const int MinLabelWidth = 24;
+const int LabelPadding = 2;
+const int ProgressIntervalMs = 200;
 
 Waveform::Waveform(QWidget *parent)
     :   QWidget(parent)
+    ,   _file(nullptr)
+    ,   _annotations(nullptr)
+    ,   _activeTier(0)
+    ,   _frequencyScale(MelScale)
+    ,   _multitaper(false)
+    ,   _analysisComplete(false)
 {
     setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
     setMinimumHeight(50);
+
+    _progressTimer.setInterval(ProgressIntervalMs);
+    connect(&_progressTimer, &QTimer::timeout,
+            this, static_cast<void (QWidget::*)()>(&QWidget::update));
+    connect(&_analysisJob, &QFutureWatcher<Analysis>::finished,
+            this, &Waveform::analysisStageFinished);
 }
 
 Waveform::~Waveform()
 {
+    cancelAnalysis();
 }
 
-void Waveform::paintEvent(QPaintEvent * /*event*/)
+void Waveform::paintEvent(QPaintEvent *event)
 {
+    PAINT_TRACE("Waveform::paintEvent");
     QPainter painter(this);
-    painter.drawPixmap(rect(), _pixmap, _pixmap.rect());
+    painter.drawImage(0, 0, _image);
+    drawAnnotations(painter, event->rect());
+
+    if (_analysisControl && _analysisControl->total() > 0) {
+        painter.setPen(Qt::white);
+        painter.drawText(rect(), Qt::AlignRight | Qt::AlignBottom, QString("%1 %2%")
+                         .arg(_analysis.isEmpty() ? "Analyzing" : "Spectrum")
+                         .arg(100 * _analysisControl->done() / _analysisControl->total()));
+    }
 }
 
 void Waveform::resizeEvent(QResizeEvent *event)
@@ -41,81 +62,279 @@ void Waveform::resizeEvent(QResizeEvent *event)
         updatePixmap(event->size());
 }
 
+void Waveform::setAnnotations(const Annotations *annotations)
+{
+    if (_annotations)
+        disconnect(_annotations, nullptr, this, nullptr);
+
+    _annotations = annotations;
+    if (_annotations)
+        connect(_annotations, &Annotations::changed, this, static_cast<void (QWidget::*)()>(&QWidget::update));
+    update();
+}
+
+void Waveform::setActiveTier(int tier)
+{
+    _activeTier = tier;
+    update();
+}
+
+double Waveform::timeAt(int x) const
+{
+    if (_file == nullptr || width() <= 0)
+        return 0.0;
+
+    return qBound(0.0, static_cast<double>(x) / width() * _file->duration(), _file->duration());
+}
+
+void Waveform::setPrefetchedAnalysis(const QString &fileName, const Analysis &analysis)
+{
+    _prefetchedFileName = fileName;
+    _prefetchedAnalysis = analysis;
+}
+
+void Waveform::setFrequencyScale(FrequencyScale scale)
+{
+    if (scale == _frequencyScale)
+        return;
+
+    _frequencyScale = scale;
+    qCDebug(logWaveform) << "Waveform::setFrequencyScale" << scale;
+    spectrumSettingsChanged();
+}
+
+void Waveform::setMultitaper(bool enabled)
+{
+    if (enabled == _multitaper)
+        return;
+
+    _multitaper = enabled;
+    qCDebug(logWaveform) << "Waveform::setMultitaper" << enabled;
+    spectrumSettingsChanged();
+}
+
+void Waveform::setSpectrumDisplay(const SpectrumDisplay &display)
+{
+    _spectrumDisplay = display;
+    qCDebug(logWaveform) << "Waveform::setSpectrumDisplay"
+             << "floorDb" << display.floorDb
+             << "ceilingDb" << display.ceilingDb
+             << "colormap" << display.colormap;
+    updatePixmap(size());
+}
+
+// Samples may still be loading, so the analysis waits for fileLoaded()
 void Waveform::fileChanged(WavFile* file)
 {
+    cancelAnalysis();
     _file = file;
     if (_file != nullptr)
     {
-        qDebug() << "Waveform::bufferChanged"
+        qCDebug(logWaveform) << "Waveform::bufferChanged"
                  << "format" << file->format()
                  << "payloadLength" << file->payloadLength();
-        updateSpectrum();
-        updatePixmap(size());
     } else {
-        qDebug() << "Waveform::reset";
+        qCDebug(logWaveform) << "Waveform::reset";
+    }
+
+    _analysis.clear();
+    _analysisComplete = false;
+    _image = QImage();
+    update();
+}
+
+// The cache or the peaks are loaded first and shown, the rest follows
+void Waveform::fileLoaded(WavFile* file)
+{
+    WAVEFORM_TRACE("Waveform::fileLoaded");
+    cancelAnalysis();
+    _analysisComplete = false;
+    const Analysis prefetched = _prefetchedAnalysis;
+    const bool matches = file->fileName() == _prefetchedFileName
+            && prefetched.numFrames() == file->numSamples()
+            && prefetched.channelCount() == file->channelCount();
+    _prefetchedAnalysis.clear();
+    _prefetchedFileName.clear();
+    if (!prefetched.isEmpty() && matches) {
+        _analysis = prefetched;
+        _analysis.setFrequencyScale(_frequencyScale);
+        _analysis.setMultitaper(_multitaper);
+        updatePixmap(size());
+        computeMissingProducts();
+        return;
     }
+
+    _analysisControl.reset(new JobControl);
+    const JobControlPointer control = _analysisControl;
+    const FrequencyScale scale = _frequencyScale;
+    const bool multitaper = _multitaper;
+    _analysisJob.setFuture(QtConcurrent::run([file, control, scale, multitaper] {
+        Analysis analysis;
+        if (!analysis.load(file))
+            analysis.compute(file, Analysis::Peaks, control.data());
+        analysis.setFrequencyScale(scale);
+        analysis.setMultitaper(multitaper);
+        return analysis;
+    }));
+    _progressTimer.start();
 }
 
-void Waveform::updateSpectrum()
+void Waveform::updatePixmap(const QSize &newSize)
 {
-    const int spectrumHalf = SpectrumLengthSamples / 2;
-    _spectrum = QImage(_file->numSamples() / spectrumHalf - 2, spectrumHalf, QImage::Format_ARGB32);
+    WAVEFORM_TRACE("Waveform::updatePixmap");
+    if (_file == nullptr || _analysis.isEmpty())
+        return;
 
-    float input[SpectrumLengthSamples];
-    float output[SpectrumLengthSamples];
+    qCDebug(logWaveform) << "Waveform::updatePixmap"
+             << "numSamples" << _analysis.numFrames()
+             << "channels" << _analysis.channelCount()
+             << "redSamples" << newSize.width();
 
-    int offset = 0;
-    float max = 0;
-    for (int i=0; i<_spectrum.width(); ++i) {
-        for (int j = 0; j < SpectrumLengthSamples; ++j) {
-            const qint16* ptr = _file->data() + (offset + j) * _file->format().channelCount();
-            input[j] = pcmToReal(*ptr);
-        }
-        _fft.calculateFFT(output, input);
-        for (int j = 0; j < spectrumHalf; ++j) {
-            float power = qMin(qAbs(output[j]), 1.0f);
-            _spectrum.setPixelColor(i, j, QColor::fromHsv(0, 0, static_cast<int>(power * 255)));
-        }
+    // Rendered in device pixels, so painting is a plain copy
+    const qreal ratio = devicePixelRatioF();
+    _image = renderWaveform(_file, _analysis, newSize * ratio, _spectrumDisplay);
+    _image.setDevicePixelRatio(ratio);
+    update();
+}
+
+//-----------------------------------------------------------------------------
+// Private slots
+//-----------------------------------------------------------------------------
+
+void Waveform::analysisStageFinished()
+{
+    if (!_analysisControl || _analysisControl->isCancelled())
+        return;
+
+    _analysis = _analysisJob.result();
+    _analysis.setFrequencyScale(_frequencyScale);
+    _analysis.setMultitaper(_multitaper);
+    _analysisControl.reset();
+    updatePixmap(size());
+    computeMissingProducts();
+}
+
+//-----------------------------------------------------------------------------
+// Private functions
+//-----------------------------------------------------------------------------
+
+// A running job gets the new settings applied once it finishes
+void Waveform::spectrumSettingsChanged()
+{
+    if (_file == nullptr || _analysis.isEmpty() || _analysisControl)
+        return;
 
-        offset += spectrumHalf;
+    _analysis.setFrequencyScale(_frequencyScale);
+    _analysis.setMultitaper(_multitaper);
+    updatePixmap(size());
+    computeMissingProducts();
+}
+
+// Complete analyses are saved, so the cache follows the frequency scale
+void Waveform::computeMissingProducts()
+{
+    const int missing = Analysis::AllProducts & ~_analysis.products();
+    if (missing == 0) {
+        _progressTimer.stop();
+        update();
+        if (!_analysisComplete) {
+            _analysisComplete = true;
+            emit analysisFinished();
+        }
+        return;
     }
+
+    // The job saves over the cache the analysis may still be mapped from
+    _analysis.detachFromCache();
+    WavFile *file = _file;
+    Analysis analysis = _analysis;
+    _analysisControl.reset(new JobControl);
+    const JobControlPointer control = _analysisControl;
+    _analysisJob.setFuture(QtConcurrent::run([file, control, analysis, missing] () mutable {
+        analysis.compute(file, missing, control.data());
+        if (analysis.products() == Analysis::AllProducts)
+            analysis.save(file);
+        return analysis;
+    }));
+    _progressTimer.start();
 }
 
-void Waveform::updatePixmap(const QSize &newSize)
+// Jobs read the samples of the file, so they are waited for before it goes
+void Waveform::cancelAnalysis()
+{
+    _progressTimer.stop();
+    if (_analysisControl)
+        _analysisControl->cancel();
+    _analysisJob.waitForFinished();
+    _analysisControl.reset();
+}
+
+void Waveform::drawAnnotations(QPainter &painter, const QRect &region) const
 {
-    if (_file == nullptr)
+    PAINT_TRACE("Waveform::drawAnnotations");
+    if (_file == nullptr || _annotations == nullptr || _file->duration() <= 0.0)
         return;
 
-    const int redSamples = newSize.width();
-    const int half = _pixmap.height() / 2;
+    const double scale = width() / _file->duration();
+    const double viewBegin = region.left() / scale;
+    const double viewEnd = (region.right() + 1) / scale;
+    const QFontMetrics metrics = painter.fontMetrics();
+    const int bandHeight = metrics.height() + 2 * LabelPadding;
 
-    qDebug() << "Waveform::updatePixmap"
-             << "numSamples" << _file->numSamples()
-             << "redSamples" << redSamples;
+    // Every annotation overlapping the visible range is visited, so the cost
+    // grows with the number of them in view. Boundaries falling on the same
+    // column share a single line, so at most one line per column is drawn.
+    QBitArray columns(width() + 1);
+    QVector<QLine> boundaries;
+    QVector<QLine> points;
 
-    _pixmap = QPixmap(newSize);
-    QPainter painter(&_pixmap);
+    for (int t = 0; t < _annotations->tierCount(); ++t) {
+        const AnnotationTier &tier = _annotations->tier(t);
+        const QRect band(0, t * bandHeight, width(), bandHeight);
+        const bool isPointTier = tier.type() == AnnotationTier::PointTier;
 
-    painter.fillRect(_pixmap.rect(), Qt::black);
-    painter.setPen(QPen(Qt::white));
+        painter.fillRect(band, t == _activeTier ? QColor(255, 255, 255, 64) : QColor(255, 255, 255, 24));
+        painter.setPen(QColor(255, 255, 255, 96));
+        painter.drawText(band.adjusted(LabelPadding, 0, -LabelPadding, 0),
+                         Qt::AlignRight | Qt::AlignVCenter, tier.name());
 
-    const int originY = ((pcmToReal(*_file->data()) + 1.0) / 2) * half;
-    const QPoint origin(0, originY);
+        columns.fill(false);
+        boundaries.clear();
+        points.clear();
+        int labelEnd = -1;
 
-    QLine line(origin, origin);
+        painter.setPen(Qt::white);
+        tier.forEachOverlapping(viewBegin, viewEnd, [&] (int index) {
+            const Annotation &annotation = tier.at(index);
+            const int x1 = qBound(0, qRound(annotation.begin * scale), width());
+            const int x2 = qBound(0, qRound(annotation.end * scale), width());
 
-    for (int i=0; i<_file->numSamples(); ++i) {
-        const qint16* ptr = _file->data() + i * _file->format().channelCount();
+            QVector<QLine> &lines = isPointTier ? points : boundaries;
+            if (!columns.testBit(x1)) {
+                columns.setBit(x1);
+                lines.append(QLine(x1, band.top(), x1, height()));
+            }
+            if (!columns.testBit(x2)) {
+                columns.setBit(x2);
+                lines.append(QLine(x2, band.top(), x2, height()));
+            }
 
-        const float realValue = pcmToReal(*ptr);
+            if (annotation.label.isEmpty() || x1 < labelEnd)
+                return;
 
-        const int x = static_cast<qreal>(i) / _file->numSamples() * redSamples;
-        const int y = ((realValue + 1.0) / 2) * half;
+            const int available = isPointTier ? width() - x1 : x2 - x1;
+            if (available < MinLabelWidth)
+                return;
 
-        line.setP2(QPoint(x, y));
-        painter.drawLine(line);
-        line.setP1(line.p2());
-    }
+            const QString text = metrics.elidedText(annotation.label, Qt::ElideRight, available - 2 * LabelPadding);
+            const QRect textRect(x1 + LabelPadding, band.top(), metrics.width(text), bandHeight);
+            painter.drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, text);
+            labelEnd = textRect.right() + LabelPadding;
+        });
 
-    painter.drawImage(QRect(0, half, newSize.width(), half), _spectrum);
+        painter.setPen(QColor(255, 255, 255, 128));
+        painter.drawLines(boundaries);
+        painter.setPen(QColor(255, 200, 0, 160));
+        painter.drawLines(points);
+    }
 }
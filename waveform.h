@@ -6,11 +6,17 @@
 #ifndef WAVEFORM_H
 #define WAVEFORM_H
 
-#include <QPixmap>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QTimer>
 #include <QWidget>
 
-#include "fftreal_wrapper.h"
+#include "analysis.h"
+#include "jobcontrol.h"
+#include "spectrumdisplay.h"
 
+class Annotations;
+class QPainter;
 class WavFile;
 
 class Waveform : public QWidget
@@ -25,16 +31,59 @@ public:
     void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
 
+    void setAnnotations(const Annotations *annotations);
+    void setActiveTier(int tier);
+    double timeAt(int x) const;
+    const Analysis &analysis() const { return _analysis; }
+
+    // Used instead of loading or computing one when the named file is loaded
+    // next, dropped by any other one
+    void setPrefetchedAnalysis(const QString &fileName, const Analysis &analysis);
+
+    FrequencyScale frequencyScale() const { return _frequencyScale; }
+    void setFrequencyScale(FrequencyScale scale);
+    bool multitaper() const { return _multitaper; }
+    void setMultitaper(bool enabled);
+
+    // Only redraws, the spectrums keep their levels
+    const SpectrumDisplay &spectrumDisplay() const { return _spectrumDisplay; }
+    void setSpectrumDisplay(const SpectrumDisplay &display);
+
 public slots:
     void fileChanged(WavFile* file);
-    void updateSpectrum();
+    void fileLoaded(WavFile* file);
     void updatePixmap(const QSize &newSize);
 
+signals:
+    void analysisFinished();
+
+private slots:
+    void analysisStageFinished();
+
+private:
+    void cancelAnalysis();
+    void spectrumSettingsChanged();
+    void computeMissingProducts();
+    void drawAnnotations(QPainter &painter, const QRect &region) const;
+
 private:
     WavFile* _file;
-    FFTRealWrapper _fft;
-    QPixmap _pixmap;
-    QImage _spectrum;
+    const Annotations *_annotations;
+    int _activeTier;
+    Analysis _analysis;
+    Analysis _prefetchedAnalysis;
+    QString _prefetchedFileName;
+    QImage _image;
+    FrequencyScale _frequencyScale;
+    bool _multitaper;
+    SpectrumDisplay _spectrumDisplay;
+
+    // Peaks are computed first, the other products by a second job.
+    // analysisFinished() is emitted once per file.
+    bool _analysisComplete;
+    JobControlPointer _analysisControl;
+    QFutureWatcher<Analysis> _analysisJob;
+    QTimer _progressTimer;
 };
 
 #endif // WAVEFORM_H
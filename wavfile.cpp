@@ -4,10 +4,24 @@
 // Copyright 2019 Artem Yamshanov, me [at] anticode.ninja
 
 #include <qendian.h>
-#include <QDebug>
 
 #include "wavfile.h"
+#include "jobcontrol.h"
 #include "utils.h"
+#include "trace.h"
+
+#include <cstring>
+
+// Read at once by readPayload(), between cancellation checks
+const qint64 LoadChunkBytes = 4 * 1024 * 1024;
+
+// Spread evenly over the payload by estimateLevels(), 1 MB in total
+const int    GainSampleBlocks     = 256;
+const qint64 GainSampleBlockBytes = 4096;
+
+// The sample may miss the loudest spot, so gains of estimated levels are
+// 6 dB lower and playback does not clip until the exact ones arrive
+const float  EstimatedGainMargin  = 0.5f;
 
 struct chunk
 {
@@ -48,6 +62,9 @@ WavFile::WavFile(QObject *parent)
     , _headerLength(0)
     , _payloadLength(0)
     , _numSamples(0)
+    , _loadedLength(0)
+    , _levelsEstimated(false)
+    , _normalization(PeakNormalization)
 {
 }
 
@@ -58,7 +75,15 @@ bool WavFile::open(const QString &fileName)
     return QFile::open(QIODevice::ReadOnly) && readFile();
 }
 
-bool WavFile::readFile()
+// Reads only the format and the payload length, samples are not loaded
+bool WavFile::openHeader(const QString &fileName)
+{
+    close();
+    setFileName(fileName);
+    return QFile::open(QIODevice::ReadOnly) && readHeader();
+}
+
+bool WavFile::readHeader()
 {
     seek(0);
     CombinedHeader header;
@@ -103,31 +128,166 @@ bool WavFile::readFile()
         }
     }
 
-    _headerLength = pos();
+    if (!result || _format.channelCount() <= 0)
+        return false;
 
+    _headerLength = pos();
     _payloadLength = size() - pos();
+    _numSamples = _payloadLength / (2 * _format.channelCount());
+    _loadedLength.store(0);
+    _levels.clear();
+    _levelsEstimated = false;
+    _gains.reset(new QAtomicInteger<quint32>[_format.channelCount()]);
+    storeGains(QVector<float>(_format.channelCount(), 1.0f));
+    _peakGains.fill(1.0f, _format.channelCount());
+
+    return result;
+}
+
+bool WavFile::readFile()
+{
+    ENGINE_TRACE("WavFile::readFile");
+    if (!readHeader())
+        return false;
+
+    reservePayload();
+    QVector<ChannelLevels> levels;
+    if (!readPayload(nullptr, &levels))
+        return false;
+
+    setLevels(levels);
+    return true;
+}
+
+// Allocated up front, so the buffer never moves while it is being filled
+void WavFile::reservePayload()
+{
     _buffer.resize(_payloadLength);
-    read(_buffer.data(), _payloadLength);
-    qDebug() << "WavFile::readed" << _payloadLength << "bytes from file" << fileName();
+    _loadedLength.store(0);
+}
 
-    _numSamples = _payloadLength / (2 * _format.channelCount());
+// Reads the samples in chunks, the levels for the normalization gains are
+// measured on every chunk while it is still in the cache
+bool WavFile::readPayload(JobControl *control, QVector<ChannelLevels> *levels)
+{
+    ENGINE_TRACE("WavFile::readPayload");
+    const int channels = _format.channelCount();
+    const qint64 frameBytes = channels * sizeof(qint16);
+    LevelMeter meter(channels, _format.sampleRate());
+
+    char *buffer = _buffer.data();
+    seek(_headerLength);
+    for (qint64 offset = 0; offset < _payloadLength; ) {
+        if (control && control->isCancelled())
+            return false;
+
+        // Chunks hold whole frames, so every one is scanned on its own
+        const qint64 length = qMin(LoadChunkBytes / frameBytes * frameBytes, _payloadLength - offset);
+        if (read(buffer + offset, length) != length) {
+            qCWarning(logEngine) << "WavFile::readPayload" << "short read" << fileName();
+            return false;
+        }
 
-    qint16* basePtr = reinterpret_cast<qint16*>(_buffer.data());
-    qreal max = 0.0;
-    for (int i=0; i<_numSamples; ++i)
-    {
-        const qint16* ptr = basePtr + i * _format.channelCount();
-        const qreal realValue = abs(pcmToReal(*ptr));
-        if (realValue > max)
-            max = realValue;
+        meter.process(reinterpret_cast<const qint16*>(buffer + offset), length / frameBytes);
+        offset += length;
+        _loadedLength.storeRelease(offset);
+        if (control)
+            control->advance(length);
     }
 
-    float mult = 1.0 / max;
-    for (int i=0; i<_numSamples; ++i)
-    {
-        qint16* ptr = basePtr + i * _format.channelCount();
-        *ptr = realToPcm(mult * pcmToReal(*ptr));
+    qCDebug(logEngine) << "WavFile::readed" << _payloadLength << "bytes from file" << fileName();
+    *levels = meter.levels();
+    return true;
+}
+
+// Levels of a sparse sample of the payload, read straight from the file
+// before the payload is loaded, every block measured on its own. The sample
+// may miss the loudest spot, so they are replaced by the exact ones later.
+bool WavFile::estimateLevels(QVector<ChannelLevels> *levels)
+{
+    ENGINE_TRACE("WavFile::estimateLevels");
+    const int channels = _format.channelCount();
+    const qint64 frameBytes = channels * sizeof(qint16);
+    const qint64 blockBytes = qMax(frameBytes, GainSampleBlockBytes / frameBytes * frameBytes);
+    const qint64 numBlocks = _payloadLength / blockBytes;
+    if (numBlocks == 0)
+        return false;
+
+    LevelMeter meter(channels, _format.sampleRate());
+    QByteArray block(blockBytes, 0);
+    const qint64 samples = qMin(numBlocks, qint64(GainSampleBlocks));
+    for (qint64 i = 0; i < samples; ++i) {
+        const qint64 offset = numBlocks * i / samples * blockBytes;
+        if (!seek(_headerLength + offset) || read(block.data(), blockBytes) != blockBytes)
+            return false;
+        meter.process(reinterpret_cast<const qint16*>(block.constData()), blockBytes / frameBytes);
+        meter.restart();
     }
 
-    return result;
+    *levels = meter.levels();
+    qCDebug(logEngine) << "WavFile::estimateLevels" << "from" << samples << "blocks";
+    return true;
+}
+
+void WavFile::setLevels(const QVector<ChannelLevels> &levels)
+{
+    _levels = levels;
+    _levelsEstimated = false;
+    _peakGains = normalizationGains(levels, PeakNormalization);
+    updateGains();
+}
+
+// Levels from estimateLevels(), until setLevels() replaces them
+void WavFile::setEstimatedLevels(const QVector<ChannelLevels> &levels)
+{
+    _levels = levels;
+    _levelsEstimated = true;
+    _peakGains = normalizationGains(levels, PeakNormalization);
+    updateGains();
+}
+
+void WavFile::setNormalization(Normalization mode)
+{
+    _normalization = mode;
+    if (_levels.size() == channelCount())
+        updateGains();
+}
+
+float WavFile::gain(int channel) const
+{
+    const quint32 bits = _gains[channel].loadAcquire();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void WavFile::updateGains()
+{
+    QVector<float> gains = normalizationGains(_levels, _normalization);
+    if (_levelsEstimated) {
+        for (float &gain : gains)
+            gain *= EstimatedGainMargin;
+    }
+    storeGains(gains);
+}
+
+// Gains are stored one by one in place, so readers never see a reallocated
+// array, only an old or a new value of every channel
+void WavFile::storeGains(const QVector<float> &gains)
+{
+    for (int c = 0; c < qMin(gains.size(), channelCount()); ++c) {
+        quint32 bits;
+        memcpy(&bits, &gains[c], sizeof(bits));
+        _gains[c].storeRelease(bits);
+    }
+}
+
+void WavFile::normalize()
+{
+    ENGINE_TRACE("WavFile::normalize");
+    // Samples stay untouched, every channel gets its own normalization gain
+    // which is applied by the consumers while they read the data
+    LevelMeter meter(_format.channelCount(), _format.sampleRate());
+    meter.process(data(), _numSamples);
+    setLevels(meter.levels());
 }
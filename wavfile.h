@@ -6,10 +6,22 @@
 #ifndef WAVFILE_H
 #define WAVFILE_H
 
+#include <QAtomicInteger>
 #include <QObject>
 #include <QFile>
 #include <QAudioFormat>
+#include <QScopedArrayPointer>
+#include <QVector>
 
+#include "levelmeter.h"
+
+class JobControl;
+
+// A 16 bit PCM file read into memory. Samples are either read at once by
+// open(), or after openHeader() by readPayload(), which may run on a worker
+// thread while the part loaded so far is already used by others. The levels
+// measured on the way give the playback gains of the normalization mode,
+// while the waveform and spectrum are always shown peak normalized.
 class WavFile : public QFile
 {
 public:
@@ -17,15 +29,36 @@ public:
 
     using QFile::open;
     bool open(const QString &fileName);
+    bool openHeader(const QString &fileName);
+    void reservePayload();
+    bool readPayload(JobControl *control, QVector<ChannelLevels> *levels);
+    bool estimateLevels(QVector<ChannelLevels> *levels);
+    // Acquire pairs with the release in readPayload(), so the bytes below it
+    // are seen as written
+    qint64 loadedLength() const { return _loadedLength.loadAcquire(); }
+    bool isLoaded() const { return loadedLength() == _payloadLength; }
     const QAudioFormat &format() const { return _format; }
     const QByteArray &buffer() const { return _buffer; }
     const qint16 *data() const { return reinterpret_cast<const qint16*>(_buffer.constData()); }
     qint64 headerLength() const { return _headerLength; }
     qint64 payloadLength() const { return _payloadLength; }
     qint64 numSamples() const { return _numSamples; }
+    int channelCount() const { return _format.channelCount(); }
+    double duration() const { return _format.sampleRate() > 0 ? double(_numSamples) / _format.sampleRate() : 0.0; }
+    const QVector<ChannelLevels> &levels() const { return _levels; }
+    void setLevels(const QVector<ChannelLevels> &levels);
+    void setEstimatedLevels(const QVector<ChannelLevels> &levels);
+    Normalization normalization() const { return _normalization; }
+    void setNormalization(Normalization mode);
+    float gain(int channel) const;
+    float peakGain(int channel) const { return _peakGains[channel]; }
+    void normalize();
 
 private:
+    bool readHeader();
     bool readFile();
+    void updateGains();
+    void storeGains(const QVector<float> &gains);
 
 private:
     QByteArray _buffer;
@@ -33,6 +66,14 @@ private:
     qint64 _headerLength;
     qint64 _payloadLength;
     qint64 _numSamples;
+    QAtomicInteger<qint64> _loadedLength;
+    QVector<ChannelLevels> _levels;
+    bool _levelsEstimated;
+    Normalization _normalization;
+    // Replaced by the GUI thread while the audio thread plays, so they are
+    // atomics holding the bits of the floats, allocated once per header
+    QScopedArrayPointer<QAtomicInteger<quint32>> _gains;
+    QVector<float> _peakGains;
 };
 
 #endif // WAVFILE_H